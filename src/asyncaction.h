@@ -0,0 +1,218 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: actions that run on worker threads instead of the dispatching thread.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <stdint.h>
+#include <thread>
+#include "tsm.h"
+
+namespace tsmlib {
+
+namespace impl {
+
+struct AsyncTask {
+  enum { StorageSize = 48 };
+
+  void (*run)(void* storage);
+  alignas(alignof(std::max_align_t)) unsigned char storage[StorageSize];
+};
+
+template<class A, class Event>
+struct AsyncTaskRunner {
+  static_assert(sizeof(Event) <= AsyncTask::StorageSize, "Event is too large to be copied into the task");
+  static_assert(alignof(Event) <= alignof(std::max_align_t), "Event alignment is not supported");
+
+  static void run(void* storage) {
+    Event* ev = static_cast<Event*>(storage);
+    A().perform(*ev);
+    ev->~Event();
+  }
+};
+
+/**
+  Bounded queue for several producers and one consumer. Each cell has a sequence number that tells
+  whether it is free for the producer of position pos (sequence == pos) or filled (sequence == pos + 1).
+*/
+template<size_t Capacity>
+class AsyncLane {
+public:
+  static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  AsyncLane() {
+    for (size_t n = 0; n < Capacity; n++) {
+      cells_[n].sequence.store(n, std::memory_order_relaxed);
+    }
+  }
+
+  template<class A, class Event>
+  bool push(const Event& ev) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[pos & (Capacity - 1)];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->task.run = &AsyncTaskRunner<A, Event>::run;
+    new (cell->task.storage) Event(ev);
+    enqueued_.fetch_add(1, std::memory_order_relaxed);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false if the queue is empty.
+  bool runOne() {
+    Cell* cell = &cells_[head_ & (Capacity - 1)];
+    if (cell->sequence.load(std::memory_order_acquire) != head_ + 1) return false;
+
+    cell->task.run(cell->task.storage);
+    cell->sequence.store(head_ + Capacity, std::memory_order_release);
+    head_++;
+    completed_.fetch_add(1, std::memory_order_release);
+    return true;
+  }
+
+  uint64_t enqueued() const {
+    return enqueued_.load(std::memory_order_acquire);
+  }
+
+  uint64_t completed() const {
+    return completed_.load(std::memory_order_acquire);
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    AsyncTask task;
+  };
+
+  Cell cells_[Capacity];
+  alignas(64) std::atomic<size_t> tail_{ 0 };
+  alignas(64) size_t head_ = 0;
+  std::atomic<uint64_t> enqueued_{ 0 };
+  std::atomic<uint64_t> completed_{ 0 };
+};
+}
+
+/**
+  Worker threads with one lane each. The lane is chosen by the machine id given to dispatch, so the actions
+  of a state machine run in dispatch order, whichever thread dispatches. Actions of dispatches without
+  machine id go into the first lane; with Workers = 1 all actions of all state machines keep their order.
+*/
+template<uint8_t Workers = 1, size_t Capacity = 1024>
+class AsyncExecutor {
+public:
+  static_assert(Workers > 0, "The executor needs at least one worker");
+
+  static AsyncExecutor& instance() {
+    static AsyncExecutor executor;
+    return executor;
+  }
+
+  AsyncExecutor() {
+    for (uint8_t n = 0; n < Workers; n++) {
+      workers_[n] = std::thread([this, n]() { _work(lanes_[n]); });
+    }
+  }
+
+  ~AsyncExecutor() {
+    flush();
+    stop_.store(true, std::memory_order_release);
+    for (uint8_t n = 0; n < Workers; n++) {
+      workers_[n].join();
+    }
+  }
+
+  // Dispatches the event, the actions it posts go into the lane of machineId.
+  template<class Sm, class Event>
+  DispatchResult<typename Sm::StatePolicy> dispatch(Sm& sm, uint32_t machineId, const Event& ev) {
+    const uint8_t outer = _lane();
+    _lane() = (uint8_t)(machineId % Workers);
+    const auto result = sm.dispatch(ev);
+    _lane() = outer;
+    return result;
+  }
+
+  // Copies the event; A().perform(event) is called on the worker of the lane of the dispatched machine.
+  template<class A, class Event>
+  void post(const Event& ev) {
+    impl::AsyncLane<Capacity>& lane = lanes_[_lane()];
+    while (!lane.template push<A>(ev)) {
+      std::this_thread::yield();
+    }
+  }
+
+  // Waits until the actions posted before are done.
+  void flush() {
+    for (uint8_t n = 0; n < Workers; n++) {
+      const uint64_t enqueued = lanes_[n].enqueued();
+      while (lanes_[n].completed() < enqueued) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  static uint8_t& _lane() {
+    static thread_local uint8_t lane = 0;
+    return lane;
+  }
+
+  void _work(impl::AsyncLane<Capacity>& lane) {
+    unsigned idle = 0;
+    while (!stop_.load(std::memory_order_acquire)) {
+      if (lane.runOne()) {
+        idle = 0;
+      } else if (++idle < 64) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+    }
+    while (lane.runOne()) {}
+  }
+
+  impl::AsyncLane<Capacity> lanes_[Workers];
+  std::thread workers_[Workers];
+  std::atomic<bool> stop_{ false };
+};
+
+/**
+  Action that runs A on a worker thread, in the lane of the machine dispatched with Executor::dispatch. A only gets a copy of the event, "template<class Event> void perform(const Event&)",
+  because the state may have changed (or be deleted) when A runs.
+*/
+template<class A, class Executor = AsyncExecutor<> >
+struct AsyncAction {
+  template<class StateType, class EventType>
+  void perform(StateType&, const EventType& ev) {
+    Executor::instance().template post<A>(ev);
+  }
+};
+}
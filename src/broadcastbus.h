@@ -0,0 +1,166 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: broadcasts events only to the state machines whose active state has a transition for them.
+
+#include <stdint.h>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "tsm.h"
+
+namespace tsmlib {
+
+namespace impl {
+
+// Bit n is set if S has a transition for the n-th event of Events.
+template<class Transitions, class S, class Events, uint8_t Index = 0>
+struct StateEventMask;
+template<class Transitions, class S, uint8_t Index>
+struct StateEventMask<Transitions, S, LokiLight::NullType, Index> {
+  enum : uint32_t { value = 0 };
+};
+template<class Transitions, class S, class Event, class Tail, uint8_t Index>
+struct StateEventMask<Transitions, S, LokiLight::Typelist<Event, Tail>, Index> {
+  enum : uint32_t {
+    value = (is_same<typename ResolveTransition<Transitions, Event, S>::Result, LokiLight::NullType>::value ? 0u : (1u << Index))
+      | (uint32_t)StateEventMask<Transitions, S, Tail, Index + 1>::value
+  };
+};
+
+template<class Sm, class Events, class States, class Indices>
+struct EventMasks;
+template<class Sm, class Events, class States, uint8_t... I>
+struct EventMasks<Sm, Events, States, IndexSequence<I...> > {
+  // Mask of the events of the state with index stateIndex, 0 for NoStateIndex.
+  static uint32_t of(uint8_t stateIndex) {
+    static const uint32_t masks[] = {
+      (uint32_t)StateEventMask<typename Sm::TransitionsType, typename LokiLight::TypeAt<States, I>::Result, Events>::value..., 0
+    };
+    return stateIndex < sizeof...(I) ? masks[stateIndex] : 0;
+  }
+};
+
+// Index of the lowest set bit, bits must not be 0.
+inline uint8_t lowestBit(uint64_t bits) {
+#if defined(__GNUC__)
+  return (uint8_t)__builtin_ctzll(bits);
+#elif defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return (uint8_t)index;
+#else
+  uint8_t index = 0;
+  while ((bits & 1) == 0) {
+    bits >>= 1;
+    index++;
+  }
+  return index;
+#endif
+}
+}
+
+/**
+  Registered state machines with one bitset per event type: the bit of a machine is set when its active state
+  has a transition for the event (see impl::ResolveTransition). broadcast only dispatches to the machines whose bit
+  is set. The bits are updated after each dispatch through the bus that consumes, a new active state can have the
+  address of the one it replaced; call update after dispatching to a machine directly. Events must be listed in Events (at most 32).
+*/
+template<class Sm, class Events>
+class BroadcastBus {
+public:
+  using StatePolicy = typename Sm::StatePolicy;
+
+  static_assert(LokiLight::Length<Events>::value <= 32, "The event masks have 32 bits");
+
+  // Returns the id of the machine in the bus. The machine must outlive the bus.
+  uint32_t add(Sm& sm) {
+    const uint32_t id = (uint32_t)machines_.size();
+    machines_.push_back(&sm);
+    stateIndices_.push_back((uint8_t)impl::NoStateIndex);
+    if ((id & 63) == 0) {
+      for (uint8_t n = 0; n < NumberOfEvents; n++) {
+        subscribers_[n].push_back(0);
+      }
+    }
+    update(id);
+    return id;
+  }
+
+  // Updates the bits of the machine from its active state.
+  void update(uint32_t id) {
+    StatePolicy* activeState = machines_[id]->_activeState();
+    const uint8_t stateIndex = activeState != nullptr ? impl::StateIndex<States>::of(activeState) : (uint8_t)impl::NoStateIndex;
+    if (stateIndex == stateIndices_[id]) return;
+
+    uint32_t changed = Masks::of(stateIndices_[id]) ^ Masks::of(stateIndex);
+    stateIndices_[id] = stateIndex;
+    while (changed != 0) {
+      const uint8_t event = impl::lowestBit(changed);
+      subscribers_[event][id >> 6] ^= (uint64_t)1 << (id & 63);
+      changed &= changed - 1;
+    }
+  }
+
+  template<class Event>
+  DispatchResult<StatePolicy> dispatch(uint32_t id, const Event& ev) {
+    const auto result = machines_[id]->dispatch(ev);
+    if (result.consumed) update(id);
+    return result;
+  }
+
+  // Returns the number of machines the event was dispatched to.
+  template<class Event>
+  uint32_t broadcast(const Event& ev) {
+    enum { Id = LokiLight::IndexOf<Events, Event>::Result };
+    static_assert(Id != -1, "Event is not in the events of the bus");
+
+    std::vector<uint64_t>& subscribers = subscribers_[Id];
+    uint32_t count = 0;
+    for (size_t word = 0; word < subscribers.size(); word++) {
+      // The dispatches change the bits of the word.
+      uint64_t bits = subscribers[word];
+      while (bits != 0) {
+        dispatch((uint32_t)(word * 64 + impl::lowestBit(bits)), ev);
+        bits &= bits - 1;
+        count++;
+      }
+    }
+    return count;
+  }
+
+  template<class Event>
+  bool subscribed(uint32_t id) const {
+    enum { Id = LokiLight::IndexOf<Events, Event>::Result };
+    return (subscribers_[Id][id >> 6] >> (id & 63)) & 1;
+  }
+
+  uint32_t size() const {
+    return (uint32_t)machines_.size();
+  }
+
+private:
+  using States = typename impl::StatesOf<Sm>::Result;
+  using Masks = impl::EventMasks<Sm, Events, States, typename impl::MakeIndexSequence<LokiLight::Length<States>::value>::Result>;
+  enum { NumberOfEvents = LokiLight::Length<Events>::value };
+
+  std::vector<Sm*> machines_;
+  std::vector<uint8_t> stateIndices_;
+  std::vector<uint64_t> subscribers_[NumberOfEvents];
+};
+}
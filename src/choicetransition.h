@@ -16,6 +16,7 @@
 */
 #include "state.h"
 #include "lokilight.h"
+#include "transition.h"
 
 namespace tsmlib {
 
@@ -66,9 +67,6 @@ private:
   template<class To>
   DispatchResult<StatePolicy> execute(StatePolicy* activeState, const EventType& ev) {
 
-    using ToFactory = typename To::CreatorType;
-    using FromFactory = typename From::CreatorType;
-
     // Self transition
     if (is_same<To, From>().value) {
       static_cast<To*>(activeState)->_doit(ev);
@@ -79,16 +77,7 @@ private:
       return DispatchResult<StatePolicy>(false, activeState);
     }
 
-    static_cast<From*>(activeState)->template _exit<EventType>(ev);
-    FromFactory::destroy(static_cast<From*>(activeState));
-
-    To* toState = ToFactory::create();
-    toState->template _entry<EventType>(ev);
-
-    if (To::BasicDoit) {
-      toState->_doit(ev);
-    }
-    return DispatchResult<StatePolicy>(true, toState);
+    return ChangeState<From, To, EventType, true, true>::execute(activeState, ev);
   }
 };
 
@@ -146,9 +135,6 @@ private:
   template<class To>
   DispatchResult<StatePolicy> execute(StatePolicy* activeState, const EventType& ev) {
 
-    using ToFactory = typename To::CreatorType;
-    using FromFactory = typename From::CreatorType;
-
     // Self transition
     if (is_same<To, From>().value) {
       static_cast<To*>(activeState)->_doit(ev);
@@ -159,16 +145,7 @@ private:
       return DispatchResult<StatePolicy>(false, activeState);
     }
 
-    static_cast<From*>(activeState)->template _exit<EventType>(ev);
-    FromFactory::destroy(static_cast<From*>(activeState));
-
-    To* toState = ToFactory::create();
-    toState->template _entry<EventType>(ev);
-
-    if (To::BasicDoit) {
-      toState->_doit(ev);
-    }
-    return DispatchResult<StatePolicy>(true, toState);
+    return ChangeState<From, To, EventType, true, true>::execute(activeState, ev);
   }
 };
 
@@ -212,8 +189,6 @@ struct Exit2Declaration {
   }
 
   DispatchResult<StatePolicy> dispatch(StatePolicy* activeState, const EventType& ev) {
-    using FromFactory = typename From::CreatorType;
-
     FromType* fromState = static_cast<FromType*>(activeState);
 
     const bool consumed = static_cast<From*>(activeState)->template _doit<EventType>(ev);
@@ -221,27 +196,14 @@ struct Exit2Declaration {
       return DispatchResult<StatePolicy>(true, activeState);
     }
 
+    // The guard is evaluated after the exit, so From is exited here and only destroyed by ChangeState.
     static_cast<From*>(activeState)->template _exit<EventType>(ev);
 
     if (Guard1().eval(*fromState, ev)) {
-      using ToFactory = typename To1::CreatorType;
-      auto toState = ToFactory::create();
-      toState->template _entry<EventType>(ev);
-      if (To1::BasicDoit) {
-        toState->template _doit<EventType>(ev);
-      }
-      FromFactory::destroy(static_cast<From*>(activeState));
-      return DispatchResult<StatePolicy>(true, toState);
+      return impl::ChangeState<From, To1, EventType, false, false, true>::execute(activeState, ev);
     }
     else {
-      using ToFactory = typename To2::CreatorType;
-      auto toState = ToFactory::create();
-      toState->template _entry<EventType>(ev);
-      if (To2::BasicDoit) {
-        toState->template _doit<EventType>(ev);
-      }
-      FromFactory::destroy(static_cast<From*>(activeState));
-      return DispatchResult<StatePolicy>(true, toState);
+      return impl::ChangeState<From, To2, EventType, false, false, true>::execute(activeState, ev);
     }
   }
 };
@@ -0,0 +1,145 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: state machine that can be used from several threads.
+
+#include <atomic>
+#include <thread>
+#include "tsm.h"
+
+namespace tsmlib {
+
+/**
+  Serializes begin, end and dispatch of a Statemachine with flat combining: each caller publishes
+  its request, and the thread that holds the lock executes the requests of all waiting threads.
+  The index of the active state (see impl::StateIndex) is published after each request and can be
+  read wait-free from any thread.
+*/
+template<class Transitions, class Initialtransition>
+class ConcurrentStatemachine {
+public:
+  using StatemachineType = Statemachine<Transitions, Initialtransition>;
+  using StatePolicy = typename StatemachineType::StatePolicy;
+
+  DispatchResult<StatePolicy> begin() {
+    Request request(&_begin, nullptr);
+    return _execute(request);
+  }
+
+  DispatchResult<StatePolicy> end() {
+    Request request(&_end, nullptr);
+    return _execute(request);
+  }
+
+  template<class Event>
+  DispatchResult<StatePolicy> dispatch() {
+    return dispatch(Event{});
+  }
+
+  template<class Event>
+  DispatchResult<StatePolicy> dispatch(const Event& ev) {
+    Request request(&_dispatch<Event>, &ev);
+    return _execute(request);
+  }
+
+  // impl::NoStateIndex if there is no active state.
+  uint8_t activeStateIndex() const {
+    return activeStateIndex_.load(std::memory_order_acquire);
+  }
+
+private:
+  typedef DispatchResult<StatePolicy> (*Run)(StatemachineType&, const void*);
+
+  struct Request {
+    Request(Run run, const void* event)
+      : run(run), event(event), next(nullptr), result(DispatchResult<StatePolicy>::null), done(false) {}
+
+    Run run;
+    const void* event;
+    Request* next;
+    DispatchResult<StatePolicy> result;
+    std::atomic<bool> done;
+  };
+
+  static DispatchResult<StatePolicy> _begin(StatemachineType& sm, const void*) {
+    return sm.begin();
+  }
+
+  static DispatchResult<StatePolicy> _end(StatemachineType& sm, const void*) {
+    return sm.end();
+  }
+
+  template<class Event>
+  static DispatchResult<StatePolicy> _dispatch(StatemachineType& sm, const void* ev) {
+    return sm.dispatch(*static_cast<const Event*>(ev));
+  }
+
+  DispatchResult<StatePolicy> _execute(Request& request) {
+    Request* head = pending_.load(std::memory_order_relaxed);
+    do {
+      request.next = head;
+    } while (!pending_.compare_exchange_weak(head, &request, std::memory_order_release, std::memory_order_relaxed));
+
+    // Either this thread combines, or another thread executes the request while this one waits.
+    while (!request.done.load(std::memory_order_acquire)) {
+      if (!locked_.exchange(true, std::memory_order_acquire)) {
+        _combine();
+        locked_.store(false, std::memory_order_release);
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    return request.result;
+  }
+
+  void _combine() {
+    Request* batch = pending_.exchange(nullptr, std::memory_order_acquire);
+    while (batch != nullptr) {
+      // The list is in reverse order of arrival.
+      Request* ordered = nullptr;
+      while (batch != nullptr) {
+        Request* next = batch->next;
+        batch->next = ordered;
+        ordered = batch;
+        batch = next;
+      }
+
+      while (ordered != nullptr) {
+        Request* next = ordered->next;
+        ordered->result = ordered->run(statemachine_, ordered->event);
+        _publish();
+        // The request lives on the stack of its thread and must not be touched after done.
+        ordered->done.store(true, std::memory_order_release);
+        ordered = next;
+      }
+      batch = pending_.exchange(nullptr, std::memory_order_acquire);
+    }
+  }
+
+  void _publish() {
+    using States = typename impl::StatesOf<StatemachineType>::Result;
+    StatePolicy* activeState = statemachine_._activeState();
+    const uint8_t index = activeState != nullptr ? impl::StateIndex<States>::of(activeState) : (uint8_t)impl::NoStateIndex;
+    activeStateIndex_.store(index, std::memory_order_release);
+  }
+
+  StatemachineType statemachine_;
+  std::atomic<Request*> pending_{ nullptr };
+  std::atomic<bool> locked_{ false };
+  std::atomic<uint8_t> activeStateIndex_{ (uint8_t)impl::NoStateIndex };
+};
+}
@@ -0,0 +1,238 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only, C++20: do-activities written as coroutines.
+
+#include "tsm.h"
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+
+namespace tsmlib {
+
+namespace impl {
+
+// What the activity waits for. Written by the awaiters, read by CoroutineState::_doit.
+struct ActivityContext {
+  const void* event = nullptr;
+  const void* tick = nullptr;
+  uint16_t ticksLeft = 0;
+  const void* received = nullptr;
+};
+}
+
+/**
+  Return type of the do-activity of a CoroutineState. The frame is allocated in the state, see CoroutineState.
+*/
+class Activity {
+public:
+  struct promise_type {
+    template<class S>
+    static void* operator new(size_t size, S& state) noexcept {
+      return state._allocateFrame(size);
+    }
+    static void operator delete(void*, size_t) noexcept {}
+
+    static Activity get_return_object_on_allocation_failure() {
+      return Activity();
+    }
+
+    Activity get_return_object() {
+      return Activity(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+
+    impl::ActivityContext* context = nullptr;
+  };
+
+  Activity() = default;
+  Activity(Activity&& other) noexcept : handle_(other.handle_) {
+    other.handle_ = nullptr;
+  }
+  Activity& operator=(Activity&& other) noexcept {
+    if (this != &other) {
+      _destroy();
+      handle_ = other.handle_;
+      other.handle_ = nullptr;
+    }
+    return *this;
+  }
+  ~Activity() {
+    _destroy();
+  }
+
+  bool done() const {
+    return !handle_ || handle_.done();
+  }
+
+  void _start(impl::ActivityContext* context) {
+    if (!handle_) return;
+    handle_.promise().context = context;
+    handle_.resume();
+  }
+
+  void _resume() {
+    if (!done()) handle_.resume();
+  }
+
+private:
+  explicit Activity(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  void _destroy() {
+    if (handle_) {
+      handle_.destroy();
+      handle_ = nullptr;
+    }
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace impl {
+
+template<class Event, class Tick>
+struct EventAwaiter {
+  // Waiting for 0 ticks does not suspend, like a timeout that has expired.
+  bool await_ready() const noexcept {
+    return !is_same<Tick, LokiLight::NullType>::value && ticks == 0;
+  }
+
+  void await_suspend(std::coroutine_handle<Activity::promise_type> handle) {
+    context = handle.promise().context;
+    context->event = is_same<Event, LokiLight::NullType>::value ? nullptr : &TypeTag<Event>::id;
+    context->tick = is_same<Tick, LokiLight::NullType>::value ? nullptr : &TypeTag<Tick>::id;
+    context->ticksLeft = ticks;
+    context->received = nullptr;
+  }
+
+  uint16_t ticks;
+  ActivityContext* context = nullptr;
+};
+}
+
+// co_await next<Event>() resumes with a copy of the next Event that reaches the state's doit.
+template<class Event>
+auto next() {
+  struct Awaiter : impl::EventAwaiter<Event, LokiLight::NullType> {
+    Event await_resume() {
+      return *static_cast<const Event*>(this->context->received);
+    }
+  };
+  return Awaiter{ { 0 } };
+}
+
+// co_await next<Event, Tick>(ticks) resumes with true for Event, or with false after ticks Tick events.
+// With 0 ticks it does not wait and returns false.
+template<class Event, class Tick>
+auto next(uint16_t ticks) {
+  struct Awaiter : impl::EventAwaiter<Event, Tick> {
+    bool await_resume() {
+      // The context is not set if the awaiter did not suspend.
+      return this->context != nullptr && this->context->received != nullptr;
+    }
+  };
+  return Awaiter{ { ticks } };
+}
+
+// co_await after<Tick>(ticks) resumes after ticks Tick events, with 0 ticks at once.
+template<class Tick>
+auto after(uint16_t ticks) {
+  struct Awaiter : impl::EventAwaiter<LokiLight::NullType, Tick> {
+    void await_resume() {}
+  };
+  return Awaiter{ { ticks } };
+}
+
+/**
+  State whose do-activity is the coroutine "Activity activity()" of Derived. It is started on entry, runs until the
+  first co_await, and is resumed by the events that reach doit (self transitions, choices back to the state).
+  The coroutine frame lives in the state; FrameSize must be large enough, otherwise the activity is not started.
+*/
+template<class Derived, class StatePolicy, size_t FrameSize, bool HasEntry = false, bool HasExit = false>
+class CoroutineState : public StatePolicy {
+public:
+  using Policy = StatePolicy;
+  enum { BasicDoit = false };
+
+  template<class Event>
+  void _entry(const Event& ev) {
+    __entry(ev, LokiLight::Int2Type<HasEntry>());
+    // The previous frame is destroyed before the new one is created in the same storage.
+    activity_ = Activity();
+    context_ = impl::ActivityContext();
+    activity_ = static_cast<Derived*>(this)->activity();
+    activity_._start(&context_);
+  }
+
+  template<class Event>
+  void _exit(const Event& ev) {
+    activity_ = Activity();
+    __exit(ev, LokiLight::Int2Type<HasExit>());
+  }
+
+  template<class Event>
+  bool _doit(const Event& ev) {
+    if (activity_.done()) return true;
+
+    const void* type = &impl::TypeTag<Event>::id;
+    if (type == context_.event) {
+      context_.received = &ev;
+      activity_._resume();
+    } else if (type == context_.tick && context_.ticksLeft > 0 && --context_.ticksLeft == 0) {
+      context_.received = nullptr;
+      activity_._resume();
+    }
+    return true;
+  }
+
+  // True when the do-activity has finished (or could not be started).
+  bool activityDone() const {
+    return activity_.done();
+  }
+
+  void* _allocateFrame(size_t size) {
+    return size <= FrameSize ? static_cast<void*>(frame_) : nullptr;
+  }
+
+private:
+  template<class Event>
+  void __entry(const Event&, const LokiLight::Int2Type<false>&) {
+  }
+  template<class Event>
+  void __entry(const Event& ev, const LokiLight::Int2Type<true>&) {
+    static_cast<Derived*>(this)->template entry<Event>(ev);
+  }
+  template<class Event>
+  void __exit(const Event&, const LokiLight::Int2Type<false>&) {
+  }
+  template<class Event>
+  void __exit(const Event& ev, const LokiLight::Int2Type<true>&) {
+    static_cast<Derived*>(this)->template exit<Event>(ev);
+  }
+
+  alignas(alignof(std::max_align_t)) unsigned char frame_[FrameSize];
+  impl::ActivityContext context_;
+  Activity activity_;
+};
+}
+#endif
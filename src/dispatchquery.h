@@ -0,0 +1,278 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "lokilight.h"
+#include "statemachinetraits.h"
+
+namespace tsmlib {
+
+/**
+  Specialize for guards without side effects. Only pure guards are evaluated by canDispatch,
+  other guards are assumed to return true.
+*/
+template<class Guard>
+struct IsPureGuard {
+  enum { value = false };
+};
+template<>
+struct IsPureGuard<NoGuard> {
+  enum { value = true };
+};
+
+namespace impl {
+
+// The transitions for Event. Is NullType when no transition of the level handles Event.
+template<class Transitions, class Event>
+struct TransitionsFor;
+template<class Event>
+struct TransitionsFor<LokiLight::NullType, Event> {
+  typedef LokiLight::NullType Result;
+};
+template<class Head, class Tail, class Event>
+struct TransitionsFor<LokiLight::Typelist<Head, Tail>, Event> {
+private:
+  typedef typename TransitionsFor<Tail, Event>::Result Later;
+
+public:
+  typedef typename LokiLight::Select<
+    is_same<typename Head::EventType, Event>::value,
+    LokiLight::Typelist<Head, Later>,
+    Later>::Result Result;
+};
+
+template<class Transitions, class Event>
+struct HandlesEvent {
+  enum { value = !is_same<typename TransitionsFor<Transitions, Event>::Result, LokiLight::NullType>::value };
+};
+
+/**
+  True if comparing the active state with a From state of the transitions creates a state: typeOf of
+  VirtualTypeIdComparator creates one to read its type id, with the FactoryCreator on the heap.
+*/
+template<class TList>
+struct QueryCreatesStates;
+template<>
+struct QueryCreatesStates<LokiLight::NullType> {
+  enum { value = false };
+};
+template<class Head, class Tail>
+struct QueryCreatesStates< LokiLight::Typelist<Head, Tail> > {
+  using From = typename Head::FromType::ObjectType;
+  enum {
+    value = (is_same<typename Head::StatePolicy, State<VirtualTypeIdComparator, false> >::value
+      && is_same<typename From::CreatorType, FactoryCreator<From> >::value)
+      || QueryCreatesStates<Tail>::value
+  };
+};
+
+/**
+  Guards are evaluated if they are pure and the state is known. The states of a nested state machine
+  that begins again are not known (nullptr), their guards are assumed to return true.
+*/
+template<class Guard, bool Pure = IsPureGuard<Guard>::value>
+struct GuardQuery {
+  template<class StateType>
+  static bool known(const StateType*) {
+    return false;
+  }
+
+  template<class StateType, class Event>
+  static bool eval(const StateType*, const Event&) {
+    return true;
+  }
+};
+template<class Guard>
+struct GuardQuery<Guard, true> {
+  template<class StateType>
+  static bool known(const StateType* state) {
+    return state != nullptr;
+  }
+
+  template<class StateType, class Event>
+  static bool eval(const StateType* state, const Event& ev) {
+    return state == nullptr || Guard().eval(*state, ev);
+  }
+};
+
+template<class Transition>
+struct TransitionQuery;
+
+template<class Transition>
+struct ResolvedQuery {
+  template<class StatePolicy, class Event>
+  static bool query(StatePolicy* activeState, const Event& ev) {
+    return TransitionQuery<Transition>::query(activeState, ev);
+  }
+};
+template<>
+struct ResolvedQuery<LokiLight::NullType> {
+  template<class StatePolicy, class Event>
+  static bool query(StatePolicy*, const Event&) {
+    return false;
+  }
+};
+
+// The nested state machine Sm begins with its initial state, like FlatStatemachine's ReenteredPath.
+template<class Sm, class Event>
+struct InitialQuery {
+  static bool query(const Event& ev) {
+    using Initial = typename Sm::InitialtransitionType::ToType::ObjectType;
+    using Resolved = typename ResolveTransition<typename Sm::TransitionsType, Event, Initial>::Result;
+    return ResolvedQuery<Resolved>::query(static_cast<typename Sm::StatePolicy*>(nullptr), ev);
+  }
+};
+
+// Result of _doit: basic states always consume, holders if their nested state machine does.
+template<class S, bool Holder = IsSubstatesHolder<S>::value>
+struct DoitQuery {
+  template<class Event>
+  static bool query(S*, const Event&, bool) {
+    return true;
+  }
+};
+template<class S>
+struct DoitQuery<S, true> {
+  template<class Event>
+  static bool query(S* state, const Event& ev, bool reentered) {
+    if (state == nullptr || reentered) return InitialQuery<typename S::SubstatemachineType, Event>::query(ev);
+    return state->_substatemachine().canDispatch(ev);
+  }
+};
+
+// Same decisions as the dispatch methods of the transitions, without the side effects.
+template<class Event, class To, class From, class Guard, class Action, bool E, bool X, bool R, bool D>
+struct TransitionQuery< TransitionBase<Event, To, From, Guard, Action, E, X, R, D> > {
+  template<class StatePolicy>
+  static bool query(StatePolicy* activeState, const Event& ev) {
+    if (E) return true;
+
+    From* fromState = static_cast<From*>(activeState);
+    if (!GuardQuery<Guard>::eval(fromState, ev)) return false;
+
+    // Exit declarations either consume in the nested state machine or exit to To.
+    if (D) return true;
+    // A reentered holder begins its nested state machine again.
+    if (is_same<To, From>::value) return DoitQuery<From>::query(fromState, ev, R);
+    return !X;
+  }
+};
+
+template<class Event, class From, class Guard, class Action>
+struct TransitionQuery< FinalTransitionExplicit<Event, From, Guard, Action> > {
+  template<class StatePolicy>
+  static bool query(StatePolicy* activeState, const Event& ev) {
+    return GuardQuery<Guard>::eval(static_cast<From*>(activeState), ev);
+  }
+};
+
+// Exiting choices only consume if they choose From. Either choice may be taken if the guard is not evaluated.
+template<class Event, class To_true, class To_false, class From, class Guard, class Action, bool X>
+struct TransitionQuery< ChoiceTransitionBase<Event, To_true, To_false, From, Guard, Action, X> > {
+  template<class StatePolicy>
+  static bool query(StatePolicy* activeState, const Event& ev) {
+    const bool selfTrue = is_same<To_true, From>::value;
+    const bool selfFalse = is_same<To_false, From>::value;
+    if (!X || (selfTrue && selfFalse)) return true;
+    if (!selfTrue && !selfFalse) return false;
+
+    From* fromState = static_cast<From*>(activeState);
+    if (!GuardQuery<Guard>::known(fromState)) return selfTrue || selfFalse;
+    return GuardQuery<Guard>::eval(fromState, ev) ? selfTrue : selfFalse;
+  }
+};
+
+template<class Event, class To1, class To2, class To_false, class From, class Guard1, class Guard2, class Action, bool X>
+struct TransitionQuery< Choice2TransitionBase<Event, To1, To2, To_false, From, Guard1, Guard2, Action, X> > {
+  template<class StatePolicy>
+  static bool query(StatePolicy* activeState, const Event& ev) {
+    const bool self1 = is_same<To1, From>::value;
+    const bool self2 = is_same<To2, From>::value;
+    const bool selfFalse = is_same<To_false, From>::value;
+    if (!X || (self1 && self2 && selfFalse)) return true;
+    if (!self1 && !self2 && !selfFalse) return false;
+
+    From* fromState = static_cast<From*>(activeState);
+    const bool known1 = GuardQuery<Guard1>::known(fromState);
+    if (known1 && GuardQuery<Guard1>::eval(fromState, ev)) return self1;
+
+    const bool second = GuardQuery<Guard2>::known(fromState)
+      ? (GuardQuery<Guard2>::eval(fromState, ev) ? self2 : selfFalse)
+      : self2 || selfFalse;
+    return known1 ? second : self1 || second;
+  }
+};
+
+template<class Event, class To1, class To2, class From, class Guard1>
+struct TransitionQuery< Exit2Declaration<Event, To1, To2, From, Guard1> > {
+  template<class StatePolicy>
+  static bool query(StatePolicy*, const Event&) {
+    return true;
+  }
+};
+
+template<class T>
+struct TransitionQuery< LikelyTransition<T> > : TransitionQuery<T> {};
+
+// Returns true if a transition of TList matches the active state, the last match decides about consumed.
+template<class TList>
+struct FindQuery;
+template<>
+struct FindQuery<LokiLight::NullType> {
+  template<class StatePolicy, class Event>
+  static bool find(StatePolicy*, const Event&, bool&) {
+    return false;
+  }
+};
+template<class Head, class Tail>
+struct FindQuery< LokiLight::Typelist<Head, Tail> > {
+  template<class StatePolicy, class Event>
+  static bool find(StatePolicy* activeState, const Event& ev, bool& consumed) {
+    if (FindQuery<Tail>::find(activeState, ev, consumed)) return true;
+    if (!activeState->template typeOf<typename Head::FromType::ObjectType>()) return false;
+
+    consumed = TransitionQuery<Head>::query(activeState, ev);
+    return true;
+  }
+};
+
+/**
+  Finds the transition like the EventDispatcher. Only the transitions for Event are searched;
+  for events without transitions the result is known at compile time.
+  The states are compared with typeOf. States of the FactoryCreator compared with VirtualTypeIdComparator
+  are rejected at compile time: typeOf would create and destroy them.
+*/
+template<class Transitions, class Event, bool Handled = HandlesEvent<Transitions, Event>::value>
+struct DispatchQuery {
+  template<class StatePolicy>
+  static bool query(StatePolicy*, const Event&) {
+    return false;
+  }
+};
+template<class Transitions, class Event>
+struct DispatchQuery<Transitions, Event, true> {
+  template<class StatePolicy>
+  static bool query(StatePolicy* activeState, const Event& ev) {
+    static_assert(!QueryCreatesStates<typename TransitionsFor<Transitions, Event>::Result>::value,
+      "canDispatch would create states: use singletons or the RttiComparator for the From states of Event");
+    if (activeState == nullptr) return false;
+
+    bool consumed = false;
+    FindQuery<typename TransitionsFor<Transitions, Event>::Result>::find(activeState, ev, consumed);
+    return consumed;
+  }
+};
+}
+}
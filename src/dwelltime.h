@@ -0,0 +1,304 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: time spent in each state, aggregated over the instances and threads.
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif defined(__linux__)
+#include <time.h>
+#else
+#include <chrono>
+#endif
+#include "transitiontable.h"
+
+namespace tsmlib {
+
+/**
+  Cheap clock of the dwell time: the time stamp counter on x86, the coarse monotonic clock on other
+  Linux targets. The ticks are only comparable on the same machine.
+*/
+struct DwellClock {
+  static uint64_t now() {
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+    return __rdtsc();
+#elif defined(__linux__)
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+  }
+};
+
+namespace impl {
+
+// Counters of one thread, only this thread writes them.
+struct DwellShard {
+  enum { Slots = NoStateIndex };
+
+  DwellShard() {
+    for (size_t n = 0; n < Slots; n++) {
+      ticks[n].store(0, std::memory_order_relaxed);
+      entries[n].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Single writer, no read-modify-write needed.
+  static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> ticks[Slots];
+  std::atomic<uint64_t> entries[Slots];
+};
+
+// The shards of all threads for one level, merged on read. Shards of ended threads are added to retired.
+template<class Tag>
+class DwellShards {
+public:
+  static DwellShard& local() {
+    static thread_local Owner owner;
+    return owner.shard;
+  }
+
+  static void read(uint8_t index, uint64_t& ticks, uint64_t& entries) {
+    Registry& registry = _registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    ticks = registry.retired.ticks[index].load(std::memory_order_relaxed);
+    entries = registry.retired.entries[index].load(std::memory_order_relaxed);
+    for (DwellShard* shard : registry.live) {
+      ticks += shard->ticks[index].load(std::memory_order_relaxed);
+      entries += shard->entries[index].load(std::memory_order_relaxed);
+    }
+  }
+
+  static void reset() {
+    Registry& registry = _registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    _clear(registry.retired);
+    for (DwellShard* shard : registry.live) _clear(*shard);
+  }
+
+private:
+  struct Registry {
+    std::mutex mutex;
+    std::vector<DwellShard*> live;
+    DwellShard retired;
+  };
+
+  struct Owner {
+    Owner() {
+      Registry& registry = _registry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      registry.live.push_back(&shard);
+    }
+    ~Owner() {
+      Registry& registry = _registry();
+      std::lock_guard<std::mutex> lock(registry.mutex);
+      for (size_t n = 0; n < DwellShard::Slots; n++) {
+        DwellShard::add(registry.retired.ticks[n], shard.ticks[n].load(std::memory_order_relaxed));
+        DwellShard::add(registry.retired.entries[n], shard.entries[n].load(std::memory_order_relaxed));
+      }
+      for (size_t n = 0; n < registry.live.size(); n++) {
+        if (registry.live[n] == &shard) registry.live.erase(registry.live.begin() + n);
+      }
+    }
+
+    DwellShard shard;
+  };
+
+  // Constructed before the first Owner, so it outlives the thread local shards.
+  static Registry& _registry() {
+    static Registry registry;
+    return registry;
+  }
+
+  static void _clear(DwellShard& shard) {
+    for (size_t n = 0; n < DwellShard::Slots; n++) {
+      shard.ticks[n].store(0, std::memory_order_relaxed);
+      shard.entries[n].store(0, std::memory_order_relaxed);
+    }
+  }
+};
+}
+
+/**
+  Observer for Statemachine that accounts the time the active state of its level was active and
+  how often it was entered. Tag names the level: use one Tag per state machine type, the instances
+  of that type share the counters. Self transitions that reenter the state do not count as entry.
+*/
+template<class Tag, class Clock = DwellClock>
+class DwellTimeObserver {
+public:
+  void publish(uint8_t index) {
+    if (index == index_) return;
+
+    const uint64_t now = Clock::now();
+    impl::DwellShard& shard = impl::DwellShards<Tag>::local();
+    if (index_ != impl::NoStateIndex) impl::DwellShard::add(shard.ticks[index_], now - since_);
+    if (index != impl::NoStateIndex) impl::DwellShard::add(shard.entries[index], 1);
+    index_ = index;
+    since_ = now;
+  }
+
+private:
+  uint64_t since_ = 0;
+  uint8_t index_ = impl::NoStateIndex;
+};
+
+namespace impl {
+
+template<class Sm>
+struct ObserverOf;
+template<class Transitions, class Initialtransition, class Observer>
+struct ObserverOf< Statemachine<Transitions, Initialtransition, Observer> > {
+  typedef Observer Result;
+};
+
+// Levels with another observer have no dwell time.
+template<class Observer>
+struct DwellLevel {
+  static void read(uint8_t, uint64_t& ticks, uint64_t& entries) {
+    ticks = entries = 0;
+  }
+  static void reset() {}
+};
+template<class Tag, class Clock>
+struct DwellLevel< DwellTimeObserver<Tag, Clock> > {
+  static void read(uint8_t index, uint64_t& ticks, uint64_t& entries) {
+    DwellShards<Tag>::read(index, ticks, entries);
+  }
+  static void reset() {
+    DwellShards<Tag>::reset();
+  }
+};
+
+template<class Statemachines, class S>
+struct DwellOfState {
+  static void read(uint64_t& ticks, uint64_t& entries) {
+    using Sm = typename LokiLight::TypeAt<Statemachines, LevelOfState<Statemachines, S>::value>::Result;
+    const uint8_t index = (uint8_t)LokiLight::IndexOf<typename StatesOf<Sm>::Result, S>::Result;
+    DwellLevel<typename ObserverOf<Sm>::Result>::read(index, ticks, entries);
+  }
+};
+
+template<class Statemachines, class States, class Indices>
+struct DwellReaders;
+template<class Statemachines, class States, uint8_t... I>
+struct DwellReaders<Statemachines, States, IndexSequence<I...> > {
+  static void read(uint8_t id, uint64_t& ticks, uint64_t& entries) {
+    static void (*const readers[])(uint64_t&, uint64_t&) = {
+      &DwellOfState<Statemachines, typename LokiLight::TypeAt<States, I>::Result>::read..., nullptr
+    };
+    if (id < sizeof...(I)) readers[id](ticks, entries);
+    else ticks = entries = 0;
+  }
+};
+
+template<class Statemachines>
+struct DwellReset;
+template<>
+struct DwellReset<LokiLight::NullType> {
+  static void reset() {}
+};
+template<class Sm, class Tail>
+struct DwellReset< LokiLight::Typelist<Sm, Tail> > {
+  static void reset() {
+    DwellLevel<typename ObserverOf<Sm>::Result>::reset();
+    DwellReset<Tail>::reset();
+  }
+};
+}
+
+/**
+  The dwell times of the states of Sm and its nested state machines, by state id of the
+  TransitionTable. Only levels with a DwellTimeObserver are accounted, and only completed stays:
+  the time in the currently active states is added when they are left.
+*/
+template<class Sm>
+struct DwellTimes {
+  using Table = TransitionTable<Sm>;
+
+  // Ticks of the Clock of the level's observer.
+  static uint64_t ticks(uint8_t id) {
+    uint64_t ticks, entries;
+    _read(id, ticks, entries);
+    return ticks;
+  }
+
+  static uint64_t entries(uint8_t id) {
+    uint64_t ticks, entries;
+    _read(id, ticks, entries);
+    return entries;
+  }
+
+  template<class S>
+  static uint64_t ticks() {
+    return ticks((uint8_t)LokiLight::IndexOf<typename Table::States, S>::Result);
+  }
+
+  template<class S>
+  static uint64_t entries() {
+    return entries((uint8_t)LokiLight::IndexOf<typename Table::States, S>::Result);
+  }
+
+  // Clears all levels. No thread should dispatch meanwhile, or its counts may be kept.
+  static void reset() {
+    impl::DwellReset<typename Table::Statemachines>::reset();
+  }
+
+  /**
+    The DOT graph of toDot with the states filled by their share of the dwell time on their level,
+    from white (none) to red (all of it), and the share as external label.
+  */
+  static std::string heatMap() {
+    std::vector<uint64_t> stateTicks(Table::NumberOfStates);
+    std::vector<uint64_t> levelTicks(Table::NumberOfStatemachines, 0);
+    for (uint8_t s = 0; s < Table::NumberOfStates; s++) {
+      stateTicks[s] = ticks(s);
+      levelTicks[Table::levels[s]] += stateTicks[s];
+    }
+
+    std::vector<std::string> attributes(Table::NumberOfStates);
+    for (uint8_t s = 0; s < Table::NumberOfStates; s++) {
+      const uint64_t total = levelTicks[Table::levels[s]];
+      const double share = total > 0 ? (double)stateTicks[s] / (double)total : 0.0;
+      char attribute[96];
+      snprintf(attribute, sizeof(attribute), "style=\"rounded,filled\", fillcolor=\"0.000 %.3f 1.000\", xlabel=\"%.0f%%\"", share, share * 100.0);
+      attributes[s] = attribute;
+    }
+    return toDot<Sm>(attributes);
+  }
+
+private:
+  static void _read(uint8_t id, uint64_t& ticks, uint64_t& entries) {
+    using Readers = impl::DwellReaders<typename Table::Statemachines, typename Table::States,
+      typename impl::MakeIndexSequence<Table::NumberOfStates>::Result>;
+    Readers::read(id, ticks, entries);
+  }
+};
+}
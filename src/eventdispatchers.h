@@ -18,144 +18,143 @@
 #include "initialtransition.h"
 #include "finaltransition.h"
 #include "lokilight.h"
+#include "statemachinetraits.h"
+
+#if defined(__GNUC__)
+#define TSM_LIKELY(condition) __builtin_expect(!!(condition), 1)
+#else
+#define TSM_LIKELY(condition) (condition)
+#endif
 
 namespace tsmlib {
 
-template<class Transitions, class Event, int Index>
-struct EventDispatcher {
+namespace impl {
+
+template<class T>
+struct IsLikelyTransition {
+  enum { value = false };
+};
+template<class T>
+struct IsLikelyTransition< LikelyTransition<T> > {
+  enum { value = true };
+};
+
+#if defined(TSM_RECORD_TRANSITIONS)
+// How often the transitions were taken, see writeTransitionProfile.
+template<class Transitions>
+struct TransitionHits {
+  static uint32_t hits[LokiLight::Length<Transitions>::value];
+};
+template<class Transitions> uint32_t TransitionHits<Transitions>::hits[LokiLight::Length<Transitions>::value] = {};
+#endif
+
+// The indices 0..Index of the transitions of a level, IndexSequence holds them as uint8_t.
+template<int Index>
+struct TransitionIndices {
+  static_assert(Index < 255, "A level has at most 255 transitions, move some of them into a nested state machine");
+  typedef typename MakeIndexSequence<(uint8_t)(Index + 1)>::Result Result;
+};
+}
+
+/**
+  The dispatchers search the transitions from the last to the first one within one call: the
+  transitions are visited by one expression expanded from an index sequence instead of a recursive
+  call per transition. The stack of a dispatch therefore depends on the nesting depth only, not on the
+  number of transitions (see MachineTraits::DispatchStackEstimate). The indices are uint8_t, so a level has at
+  most 255 transitions.
+*/
+template<class Transitions, class Event, int Index, class Indices = typename impl::TransitionIndices<Index>::Result>
+struct EventDispatcher;
+template<class Transitions, class Event, int Index, uint8_t... I>
+struct EventDispatcher<Transitions, Event, Index, impl::IndexSequence<I...> > {
 
   using StatePolicy = typename LokiLight::TypeAt<Transitions, 0>::Result::StatePolicy;
 
   static DispatchResult<StatePolicy> execute(StatePolicy* activeState, const Event* ev) {
-    // Finds last element in the list that meets the conditions.
-    using CurrentTransition = typename LokiLight::TypeAt<Transitions, Index>::Result;
+    DispatchResult<StatePolicy> result(false, nullptr);
+    bool found = false;
+    // The initializer-clauses of a braced-init-list are evaluated in the order they appear, pack expansions
+    // included (C++11 [dcl.init.list]/4), so Index - I visits the last transition first. DispatchStackTest
+    // checks the order. GCC before 4.9.1 did not keep it for pack expansions (GCC bug 51253).
+    const bool visited[] = { found || (found = _visit<Index - (int)I>(activeState, ev, result))... };
+    (void)visited;
+    return result;
+  }
+
+private:
+  // Dispatches to the transition N if it meets the conditions, true then.
+  template<int N>
+  static bool _visit(StatePolicy* activeState, const Event* ev, DispatchResult<StatePolicy>& result) {
+    using CurrentTransition = typename LokiLight::TypeAt<Transitions, N>::Result;
     using FromType = typename CurrentTransition::FromType::ObjectType;
     using EventType = typename CurrentTransition::EventType;
 
     const bool hasSameFromState = activeState->template typeOf<FromType>();
 
     const bool conditionMet = is_same<EventType, Event>().value && hasSameFromState;
-    if (conditionMet) {
+    if (impl::IsLikelyTransition<CurrentTransition>::value ? TSM_LIKELY(conditionMet) : conditionMet) {
+#if defined(TSM_RECORD_TRANSITIONS)
+      impl::TransitionHits<Transitions>::hits[N]++;
+#endif
       const EventType* currentTransitionEvent = reinterpret_cast<const EventType*>(ev);
-      auto result = CurrentTransition().dispatch(activeState, *currentTransitionEvent);
-      return result;
+      result = CurrentTransition().dispatch(activeState, *currentTransitionEvent);
+      return true;
     }
-    // Recursion
-    return EventDispatcher< Transitions, Event, Index - 1 >::execute(activeState, ev);
-  }
-
-  static void entry(StatePolicy* entryState) {
-    // Finds last element in the list that meets the conditions.
-    using CurrentTransition = typename LokiLight::TypeAt<Transitions, Index>::Result;
-    using ToType = typename CurrentTransition::ToType::ObjectType;
-
-    // TODO: Mustn't be a choice transition
-    //static_assert(is_same<ToType, EmptyState<typename CreationPolicy::ObjectType>>().value);
-
-    bool hasSameFromState = entryState->template typeOf<ToType>();
-
-    bool conditionMet = is_same<typename CurrentTransition::EventType, Event>().value && hasSameFromState;
-    if (conditionMet) {
-      ToType* state = static_cast<ToType*>(entryState);
-      state->template _entry<Event>();
-      LokiLight::NullType nu;
-      state->_doit(nu);
-      return;
-    }
-    // Recursion
-    EventDispatcher<Transitions, Event, Index - 1 >::entry(entryState);
+    return false;
   }
 };
-// Specialization
-template<class Transitions, class Event>
-struct EventDispatcher<Transitions, Event, 0> {
 
-  using StatePolicy = typename LokiLight::TypeAt<Transitions, 0>::Result::StatePolicy;
+template<class Transitions, class Initialtransition, class Event, int Index, class Indices = typename impl::TransitionIndices<Index>::Result>
+struct Initializer;
+template<class Transitions, class Initialtransition, class Event, int Index, uint8_t... I>
+struct Initializer<Transitions, Initialtransition, Event, Index, impl::IndexSequence<I...> > {
 
-  static DispatchResult<StatePolicy> execute(StatePolicy* activeState, const Event* ev) {
-    // End of recursion.
-    using FirstTransition = typename LokiLight::TypeAt<Transitions, 0>::Result;
-    using FromType = typename FirstTransition::FromType::ObjectType;
-    using EventType = typename FirstTransition::EventType;
-
-    const bool hasSameFromState = activeState->template typeOf<FromType>();
+  using StatePolicy = typename Initialtransition::StatePolicy;
 
-    const bool conditionMet = is_same<typename FirstTransition::EventType, Event>().value && hasSameFromState;
-    if (conditionMet) {
-      const EventType* currentTransitionEvent = reinterpret_cast<const EventType*>(ev);
-      const auto result = FirstTransition().dispatch(activeState, *currentTransitionEvent);
+  static DispatchResult<StatePolicy> init() {
+    DispatchResult<StatePolicy> result(false, nullptr);
+    const bool visited[] = { result.consumed || _visit<Index - (int)I>(result)... };
+    (void)visited;
+    if (result.consumed) {
       return result;
     }
-    return DispatchResult<StatePolicy>(false, nullptr);
-  }
-
-  static void entry(StatePolicy* entryState) {
-    // End of recursion.
-    using FirstTransition = typename LokiLight::TypeAt<Transitions, 0>::Result;
-    using ToType = typename FirstTransition::ToType::ObjectType;
-
-    const bool hasSameFromState = entryState->template typeOf<ToType>();
-
-    const bool conditionMet = is_same<typename FirstTransition::EventType, Event>().value && hasSameFromState;
-    if (conditionMet) {
-      ToType* state = static_cast<ToType*>(entryState);
-      state->template _entry<Event>();
-      LokiLight::NullType nu;
-      state->_doit(nu);
-    }
-    return;
+    return Initialtransition().dispatch();
   }
-};
 
-template<class Transitions, class Initialtransition, class Event, int Index>
-struct Initializer {
-
-  using StatePolicy = typename Initialtransition::StatePolicy;
-
-  static DispatchResult<StatePolicy> init() {
-    using CurrentTransition = typename LokiLight::TypeAt<Transitions, Index>::Result;
+private:
+  // Dispatches to the entering transition N until one consumes.
+  template<int N>
+  static bool _visit(DispatchResult<StatePolicy>& result) {
+    using CurrentTransition = typename LokiLight::TypeAt<Transitions, N>::Result;
     using EventType = typename CurrentTransition::EventType;
 
     if (CurrentTransition::E && is_same<EventType, Event>().value) {
       EventType ev;
-      auto result = CurrentTransition().dispatch(nullptr, ev);
-      if (result.consumed) {
-        return result;
-      }
+      result = CurrentTransition().dispatch(nullptr, ev);
     }
-    // Recursion
-    return Initializer<Transitions, Initialtransition, Event, Index - 1 >::init();
+    return result.consumed;
   }
 };
-// Specialization
-template<class Transitions, class Initialtransition, class Event>
-struct Initializer<Transitions, Initialtransition, Event, 0> {
-
-  using StatePolicy = typename Initialtransition::StatePolicy;
-
-  static DispatchResult<StatePolicy> init() {
-    // End of recursion.
-    using FirstTransition = typename LokiLight::TypeAt<Transitions, 0>::Result;
-    using EventType = typename FirstTransition::EventType;
 
-    if (FirstTransition::E && is_same<EventType, Event>().value) {
-      EventType ev;
-      const auto result = FirstTransition().dispatch(nullptr, ev);
-      if (result.consumed) {
-        return result;
-      }
-    }
-    return Initialtransition().dispatch();
-  }
-};
-
-template<class Transitions, int Index>
-struct Finalizer {
+template<class Transitions, int Index, class Indices = typename impl::TransitionIndices<Index>::Result>
+struct Finalizer;
+template<class Transitions, int Index, uint8_t... I>
+struct Finalizer<Transitions, Index, impl::IndexSequence<I...> > {
 
   using StatePolicy = typename LokiLight::TypeAt<Transitions, 0>::Result::StatePolicy;
 
   static DispatchResult<StatePolicy> end(StatePolicy* activeState) {
-    using CurrentTransition = typename LokiLight::TypeAt<Transitions, Index>::Result;
+    DispatchResult<StatePolicy> result(false, activeState);
+    const bool visited[] = { result.consumed || _visit<Index - (int)I>(activeState, result)... };
+    (void)visited;
+    return result;
+  }
+
+private:
+  // Dispatches to the exit transition N until one consumes.
+  template<int N>
+  static bool _visit(StatePolicy* activeState, DispatchResult<StatePolicy>& result) {
+    using CurrentTransition = typename LokiLight::TypeAt<Transitions, N>::Result;
     using FromType = typename CurrentTransition::FromType::ObjectType;
 
     const bool hasSameFromState = activeState->template typeOf<FromType>();
@@ -164,39 +163,12 @@ struct Finalizer {
       using ET = typename CurrentTransition::EventType;
       // TODO: Add event to _exit()?
       ET ev{};
-      const auto result = CurrentTransition().dispatch(activeState, ev);
-      if (result.consumed) {
-        return result;
-      }
-    }
-    // Recursion
-    return Finalizer< Transitions, Index - 1 >::end(activeState);
-  }
-};
-// Specialization
-template<class Transitions>
-struct Finalizer<Transitions, 0> {
-
-  using StatePolicy = typename LokiLight::TypeAt<Transitions, 0>::Result::StatePolicy;
-
-  static DispatchResult<StatePolicy> end(StatePolicy* activeState) {
-    // End of recursion.
-    using FirstTransition = typename LokiLight::TypeAt<Transitions, 0>::Result;
-    using FromType = typename FirstTransition::FromType::ObjectType;
-
-    bool hasSameFromState = activeState->template typeOf<FromType>();
-
-    const bool conditionMet = FirstTransition::X && hasSameFromState;
-    if (conditionMet) {
-      using ET = typename FirstTransition::EventType;
-      // TODO: Add event to _exit()?
-      ET ev{};
-      const auto result = FirstTransition().dispatch(activeState, ev);
-      if (result.consumed) {
-        return result;
+      const auto transitionResult = CurrentTransition().dispatch(activeState, ev);
+      if (transitionResult.consumed) {
+        result = transitionResult;
       }
     }
-    return DispatchResult<StatePolicy>(false, activeState);
+    return result.consumed;
   }
 };
 }
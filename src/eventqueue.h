@@ -0,0 +1,282 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <string.h>
+#include "tsm.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace tsmlib {
+
+// Lanes of the EventQueue, a higher lane is dispatched first.
+enum EventLane : uint8_t { ExternalLane = 0, InternalLane = 1, UrgentLane = 2 };
+
+/**
+  Lane of an event type: the enum Priority of the event struct, ExternalLane if the event has none.
+    struct Reset { enum { Priority = UrgentLane }; };
+*/
+template<class Event>
+struct EventPriority {
+private:
+  typedef char (&Yes)[1];
+  typedef char (&No)[2];
+  template<class U> static Yes check(LokiLight::Int2Type<U::Priority>*);
+  template<class U> static No check(...);
+
+  template<class U, bool Has>
+  struct Get {
+    enum { value = ExternalLane };
+  };
+  template<class U>
+  struct Get<U, true> {
+    enum { value = U::Priority };
+  };
+
+public:
+  enum { value = Get<Event, sizeof(check<Event>(0)) == sizeof(Yes)>::value };
+};
+
+// How the EventQueue handles an event whose type is already pending.
+enum EventCoalescing : uint8_t { NotCoalesced = 0, LatestWins = 1, CountMerge = 2 };
+
+/**
+  Coalescing of an event type: the enum Coalesce of the event struct, NotCoalesced if the event has none.
+  The queue keeps at most one pending event of a coalesced type; LatestWins overwrites it, CountMerge adds
+  the count member of the new event to it.
+    struct Position { enum { Coalesce = LatestWins }; int32_t x; };
+    struct Timeout { enum { Coalesce = CountMerge }; uint16_t count; };
+*/
+template<class Event>
+struct Coalescing {
+private:
+  typedef char (&Yes)[1];
+  typedef char (&No)[2];
+  template<class U> static Yes check(LokiLight::Int2Type<U::Coalesce>*);
+  template<class U> static No check(...);
+
+  template<class U, bool Has>
+  struct Get {
+    enum { value = NotCoalesced };
+  };
+  template<class U>
+  struct Get<U, true> {
+    enum { value = U::Coalesce };
+  };
+
+public:
+  enum { value = Get<Event, sizeof(check<Event>(0)) == sizeof(Yes)>::value };
+};
+
+namespace impl {
+
+template<class Events>
+struct MaxEventSize;
+template<>
+struct MaxEventSize<LokiLight::NullType> {
+  enum { value = 1 };
+};
+template<class Head, class Tail>
+struct MaxEventSize< LokiLight::Typelist<Head, Tail> > {
+  enum { value = sizeof(Head) > (size_t)MaxEventSize<Tail>::value ? sizeof(Head) : (size_t)MaxEventSize<Tail>::value };
+};
+
+// Index of the highest set bit, bits must not be 0.
+inline uint8_t highestBit(unsigned bits) {
+#if defined(__GNUC__)
+  return (uint8_t)(sizeof(unsigned) * 8 - 1 - __builtin_clz(bits));
+#elif defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse(&index, bits);
+  return (uint8_t)index;
+#else
+  uint8_t index = 0;
+  while (bits >>= 1) index++;
+  return index;
+#endif
+}
+
+template<class Events, class Sm, class Indices>
+struct QueuedEventDispatcher;
+template<class Events, class Sm, uint8_t... I>
+struct QueuedEventDispatcher<Events, Sm, IndexSequence<I...> > {
+  typedef DispatchResult<typename Sm::StatePolicy> (*Handler)(Sm&, const uint8_t*);
+
+  template<class Event>
+  static DispatchResult<typename Sm::StatePolicy> dispatch(Sm& sm, const uint8_t* storage) {
+    Event ev{};
+    memcpy(static_cast<void*>(&ev), storage, sizeof(Event));
+    return sm.dispatch(ev);
+  }
+
+  static DispatchResult<typename Sm::StatePolicy> dispatch(Sm& sm, uint8_t eventId, const uint8_t* storage) {
+    static const Handler handlers[] = {
+      &dispatch<typename LokiLight::TypeAt<Events, I>::Result>...
+    };
+    return handlers[eventId](sm, storage);
+  }
+};
+}
+
+/**
+  Queue of events for a state machine with one FIFO lane per priority. The highest non-empty lane is found
+  with a bitmap of the non-empty lanes. Events must be listed in Events and are copied as bytes.
+  A coalesced event (see Coalescing) that is pushed while one of its type is pending is merged into the
+  pending one, which keeps its place in the lane.
+  Not thread-safe; an interrupt handler that pushes must be guarded by the caller.
+*/
+template<class Sm, class Events, uint8_t Lanes = 3, uint8_t Capacity = 8>
+class EventQueue {
+public:
+  static_assert(Lanes > 0 && Lanes <= 8, "The bitmap has 8 lanes");
+  static_assert(Capacity > 0, "A lane needs at least one slot");
+
+  EventQueue() {
+    for (uint8_t n = 0; n < NumberOfEvents; n++) {
+      pending_[n] = NoSlot;
+    }
+  }
+
+  // Returns false if the lane of the event is full.
+  template<class Event>
+  bool push(const Event& ev) {
+    enum { Id = LokiLight::IndexOf<Events, Event>::Result, Lane = EventPriority<Event>::value, Coalesced = Coalescing<Event>::value != (int)NotCoalesced };
+    static_assert(Id != -1, "Event is not in the events of the queue");
+    static_assert(Lane < Lanes, "Priority of the event is not a lane of the queue");
+#if !defined(ARDUINO)
+    static_assert(std::is_trivially_copyable<Event>::value, "Events are copied as bytes");
+#endif
+
+    LaneQueue& lane = lanes_[Lane];
+    if (Coalesced && pending_[Id] != NoSlot) {
+      _coalesce(lane.slots[pending_[Id]].storage, ev, LokiLight::Int2Type<Coalescing<Event>::value>());
+      coalesced_++;
+      return true;
+    }
+    if (lane.size == Capacity) return false;
+
+    const uint8_t index = (uint8_t)((lane.head + lane.size) % Capacity);
+    Slot& slot = lane.slots[index];
+    slot.eventId = Id;
+    memcpy(slot.storage, static_cast<const void*>(&ev), sizeof(Event));
+    if (Coalesced) pending_[Id] = index;
+    lane.size++;
+    nonEmpty_ |= (uint8_t)(1 << Lane);
+    return true;
+  }
+
+  /**
+    Dispatches the oldest event of the highest non-empty lane. Returns false if the queue is empty.
+    Each non-empty lower lane counts the dispatch as a skip.
+  */
+  bool dispatchOne(Sm& sm) {
+    if (nonEmpty_ == 0) return false;
+
+    const uint8_t laneIndex = impl::highestBit(nonEmpty_);
+    for (uint8_t n = 0; n < laneIndex; n++) {
+      if (nonEmpty_ & (1 << n)) {
+        lanes_[n].skipped++;
+        if (lanes_[n].skipped > lanes_[n].maxSkipped) lanes_[n].maxSkipped = lanes_[n].skipped;
+      }
+    }
+
+    LaneQueue& lane = lanes_[laneIndex];
+    // Copy out first: the dispatch may push into the same lane.
+    Slot slot = lane.slots[lane.head];
+    if (pending_[slot.eventId] == lane.head) pending_[slot.eventId] = NoSlot;
+    lane.head = (uint8_t)((lane.head + 1) % Capacity);
+    lane.size--;
+    lane.skipped = 0;
+    lane.dispatched++;
+    if (lane.size == 0) nonEmpty_ &= (uint8_t)~(1 << laneIndex);
+
+    using Dispatcher = impl::QueuedEventDispatcher<Events, Sm, typename impl::MakeIndexSequence<LokiLight::Length<Events>::value>::Result>;
+    Dispatcher::dispatch(sm, slot.eventId, slot.storage);
+    return true;
+  }
+
+  // Dispatches until the queue is empty, returns the number of dispatched events.
+  uint16_t dispatchAll(Sm& sm) {
+    uint16_t count = 0;
+    while (dispatchOne(sm)) count++;
+    return count;
+  }
+
+  bool empty() const {
+    return nonEmpty_ == 0;
+  }
+
+  uint8_t size(uint8_t lane) const {
+    return lanes_[lane].size;
+  }
+
+  // Dispatched events of the lane.
+  uint32_t dispatched(uint8_t lane) const {
+    return lanes_[lane].dispatched;
+  }
+
+  // Dispatches of higher lanes since the oldest event of the lane waits, and the maximum of it (starvation).
+  uint16_t skipped(uint8_t lane) const {
+    return lanes_[lane].skipped;
+  }
+  uint16_t maxSkipped(uint8_t lane) const {
+    return lanes_[lane].maxSkipped;
+  }
+
+  // Pushed events that were merged into a pending one, i.e. the saved dispatches.
+  uint32_t coalesced() const {
+    return coalesced_;
+  }
+
+private:
+  enum { NumberOfEvents = LokiLight::Length<Events>::value, NoSlot = 0xFF };
+
+  template<class Event>
+  static void _coalesce(uint8_t* storage, const Event& ev, const LokiLight::Int2Type<LatestWins>&) {
+    memcpy(storage, static_cast<const void*>(&ev), sizeof(Event));
+  }
+  template<class Event>
+  static void _coalesce(uint8_t* storage, const Event& ev, const LokiLight::Int2Type<CountMerge>&) {
+    Event pending;
+    memcpy(static_cast<void*>(&pending), storage, sizeof(Event));
+    pending.count += ev.count;
+    memcpy(storage, static_cast<const void*>(&pending), sizeof(Event));
+  }
+  template<class Event>
+  static void _coalesce(uint8_t*, const Event&, const LokiLight::Int2Type<NotCoalesced>&) {
+  }
+
+  struct Slot {
+    uint8_t eventId;
+    uint8_t storage[impl::MaxEventSize<Events>::value];
+  };
+
+  struct LaneQueue {
+    Slot slots[Capacity];
+    uint8_t head = 0;
+    uint8_t size = 0;
+    uint16_t skipped = 0;
+    uint16_t maxSkipped = 0;
+    uint32_t dispatched = 0;
+  };
+
+  LaneQueue lanes_[Lanes];
+  // Slot index of the pending event per coalesced event type, in the lane of the type.
+  uint8_t pending_[NumberOfEvents];
+  uint8_t nonEmpty_ = 0;
+  uint32_t coalesced_ = 0;
+};
+}
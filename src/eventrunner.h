@@ -0,0 +1,248 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: a thread that dispatches queued events into a group of state machines.
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+#include "eventqueue.h"
+
+namespace tsmlib {
+
+namespace impl {
+
+inline void spinPause() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_pause();
+#endif
+}
+
+/**
+  Word the consumer parks on while it is 1. Linux uses a futex, other systems a condition variable.
+*/
+class ParkingWord {
+public:
+  // Parks while the word is 1; may return spuriously.
+  void wait() {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word_), FUTEX_WAIT_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() { return word_.load(std::memory_order_acquire) == 0; });
+#endif
+  }
+
+  void wake() {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word_), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+    std::lock_guard<std::mutex> lock(mutex_);
+    condition_.notify_one();
+#endif
+  }
+
+  std::atomic<uint32_t>& word() {
+    return word_;
+  }
+
+private:
+  std::atomic<uint32_t> word_{ 0 };
+#if !defined(__linux__)
+  std::mutex mutex_;
+  std::condition_variable condition_;
+#endif
+};
+}
+
+/**
+  Dispatches events that are posted from any thread into state machines of type Sm, in the order they were posted.
+  When the queue is empty, the runner spins for up to the spin limit and then parks. The spin limit adapts between
+  1 us and maxSpin: it doubles when an event arrived while spinning, and halves when the runner had to park.
+  Producers only make the wake system call when the runner is parked.
+  Events must be listed in Events and are copied as bytes; the state machines must outlive the runner.
+*/
+template<class Sm, class Events, size_t Capacity = 1024>
+class EventRunner {
+public:
+  static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  explicit EventRunner(std::chrono::microseconds maxSpin = std::chrono::microseconds(50))
+    : maxSpin_(maxSpin), spin_(maxSpin), spinLimit_(spin_.count()) {
+    for (size_t n = 0; n < Capacity; n++) {
+      cells_[n].sequence.store(n, std::memory_order_relaxed);
+    }
+    thread_ = std::thread([this]() { _run(); });
+  }
+
+  ~EventRunner() {
+    stop_.store(true, std::memory_order_seq_cst);
+    _wake();
+    thread_.join();
+  }
+
+  // Copies the event; yields while the queue is full.
+  template<class Event>
+  void post(Sm& sm, const Event& ev) {
+    enum { Id = LokiLight::IndexOf<Events, Event>::Result };
+    static_assert(Id != -1, "Event is not in the events of the runner");
+    static_assert(std::is_trivially_copyable<Event>::value, "Events are copied as bytes");
+
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[pos & (Capacity - 1)];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        std::this_thread::yield();
+        pos = tail_.load(std::memory_order_relaxed);
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->sm = &sm;
+    cell->eventId = Id;
+    memcpy(cell->storage, static_cast<const void*>(&ev), sizeof(Event));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    _wake();
+  }
+
+  // Waits until the events posted before are dispatched.
+  void flush() {
+    const size_t posted = tail_.load(std::memory_order_acquire);
+    while (dispatched_.load(std::memory_order_acquire) < posted) {
+      std::this_thread::yield();
+    }
+  }
+
+  uint64_t parks() const {
+    return parks_.load(std::memory_order_relaxed);
+  }
+
+  // Wake system calls made by producers.
+  uint64_t wakes() const {
+    return wakes_.load(std::memory_order_relaxed);
+  }
+
+  std::chrono::nanoseconds spinLimit() const {
+    return std::chrono::nanoseconds(spinLimit_.load(std::memory_order_relaxed));
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    Sm* sm;
+    uint8_t eventId;
+    uint8_t storage[impl::MaxEventSize<Events>::value];
+  };
+
+  void _wake() {
+    // Pairs with the fence in _park: either the runner sees the cell or the producer sees the parked runner.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parking_.word().load(std::memory_order_relaxed) == 1 && parking_.word().exchange(0, std::memory_order_release) == 1) {
+      wakes_.fetch_add(1, std::memory_order_relaxed);
+      parking_.wake();
+    }
+  }
+
+  bool _dispatchOne() {
+    Cell* cell = &cells_[head_ & (Capacity - 1)];
+    if (cell->sequence.load(std::memory_order_acquire) != head_ + 1) return false;
+
+    using Dispatcher = impl::QueuedEventDispatcher<Events, Sm, typename impl::MakeIndexSequence<LokiLight::Length<Events>::value>::Result>;
+    Dispatcher::dispatch(*cell->sm, cell->eventId, cell->storage);
+    cell->sequence.store(head_ + Capacity, std::memory_order_release);
+    head_++;
+    dispatched_.store(head_, std::memory_order_release);
+    return true;
+  }
+
+  bool _ready() const {
+    return cells_[head_ & (Capacity - 1)].sequence.load(std::memory_order_acquire) == head_ + 1;
+  }
+
+  bool _spin() {
+    const auto until = std::chrono::steady_clock::now() + spin_;
+    for (;;) {
+      for (uint8_t n = 0; n < 64; n++) {
+        if (_ready()) return true;
+        impl::spinPause();
+      }
+      if (std::chrono::steady_clock::now() >= until) return false;
+    }
+  }
+
+  void _park() {
+    parking_.word().store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!_ready() && !stop_.load(std::memory_order_relaxed)) {
+      parks_.fetch_add(1, std::memory_order_relaxed);
+      while (parking_.word().load(std::memory_order_acquire) == 1) {
+        parking_.wait();
+      }
+    }
+    parking_.word().store(0, std::memory_order_relaxed);
+  }
+
+  void _run() {
+    const std::chrono::nanoseconds minSpin = std::chrono::microseconds(1);
+    while (!stop_.load(std::memory_order_acquire)) {
+      if (_dispatchOne()) continue;
+
+      const bool arrived = _spin();
+      if (arrived) {
+        spin_ = spin_ * 2 < maxSpin_ ? spin_ * 2 : std::chrono::nanoseconds(maxSpin_);
+      } else {
+        spin_ = spin_ / 2 > minSpin ? spin_ / 2 : minSpin;
+      }
+      spinLimit_.store(spin_.count(), std::memory_order_relaxed);
+      if (!arrived) _park();
+    }
+    while (_dispatchOne()) {}
+  }
+
+  Cell cells_[Capacity];
+  alignas(64) std::atomic<size_t> tail_{ 0 };
+  alignas(64) size_t head_ = 0;
+  std::atomic<size_t> dispatched_{ 0 };
+  const std::chrono::nanoseconds maxSpin_;
+  std::chrono::nanoseconds spin_;
+  std::atomic<int64_t> spinLimit_;
+  alignas(64) impl::ParkingWord parking_;
+  std::atomic<uint64_t> parks_{ 0 };
+  std::atomic<uint64_t> wakes_{ 0 };
+  std::atomic<bool> stop_{ false };
+  std::thread thread_;
+};
+}
@@ -0,0 +1,421 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: exhaustive exploration of the configurations a state machine can reach.
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "tsm.h"
+
+namespace tsmlib {
+
+namespace impl {
+
+// Snapshot of a configuration, overflowed if it does not fit into Size bytes.
+template<size_t Size>
+struct ExplorerWriter {
+  size_t write(const uint8_t* bytes, size_t length) {
+    if (size + length > Size) {
+      overflowed = true;
+      return 0;
+    }
+    memcpy(data + size, bytes, length);
+    size += length;
+    return length;
+  }
+
+  uint8_t data[Size];
+  size_t size = 0;
+  bool overflowed = false;
+};
+
+inline uint64_t _snapshotHash(const uint8_t* data, size_t size) {
+  // FNV-1a, 0 marks an empty slot.
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t n = 0; n < size; n++) {
+    hash = (hash ^ data[n]) * 0x100000001b3ull;
+  }
+  return hash != 0 ? hash : 1;
+}
+
+/**
+  Open addressing set of snapshots. A slot is claimed with a compare and swap of its hash; the
+  snapshot is written before the slot is marked as ready. Slots are never removed.
+*/
+template<size_t SnapshotSize>
+class SnapshotSet {
+public:
+  enum : uint32_t { Full = 0xffffffff };
+
+  explicit SnapshotSet(size_t capacity) : mask_(_tableSize(capacity) - 1), slots_(new Slot[mask_ + 1]) {}
+
+  // Index of the snapshot's slot; inserted is true if it was not in the set. Full if there is no free slot.
+  uint32_t insert(const uint8_t* data, size_t size, bool& inserted) {
+    inserted = false;
+    const uint64_t hash = _snapshotHash(data, size);
+    for (size_t probe = 0; probe <= mask_; probe++) {
+      const size_t index = (hash + probe) & mask_;
+      Slot& slot = slots_[index];
+      uint64_t expected = 0;
+      if (slot.hash.compare_exchange_strong(expected, hash, std::memory_order_acq_rel)) {
+        memcpy(slot.data, data, size);
+        slot.size = (uint16_t)size;
+        slot.ready.store(true, std::memory_order_release);
+        inserted = true;
+        return (uint32_t)index;
+      }
+      if (expected != hash) continue;
+      while (!slot.ready.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      if (slot.size == size && memcmp(slot.data, data, size) == 0) return (uint32_t)index;
+    }
+    return Full;
+  }
+
+  const uint8_t* data(uint32_t index) const {
+    return slots_[index].data;
+  }
+
+  size_t size(uint32_t index) const {
+    return slots_[index].size;
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> hash{ 0 };
+    std::atomic<bool> ready{ false };
+    uint16_t size = 0;
+    uint8_t data[SnapshotSize];
+  };
+
+  static size_t _tableSize(size_t capacity) {
+    // At most half full.
+    size_t size = 16;
+    while (size < 2 * capacity) size *= 2;
+    return size;
+  }
+
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+// Marks the active states of each level in a bit mask over States; leaf is the index of the innermost one.
+template<class Sm, class States, class Level = typename StatesOf<Sm>::Result>
+struct ActiveStates {
+  using StatePolicy = typename Sm::StatePolicy;
+
+  static uint64_t of(const Sm& sm, uint8_t& leaf) {
+    StatePolicy* activeState = sm._activeState();
+    return activeState != nullptr ? of(activeState, leaf) : 0;
+  }
+
+  static uint64_t of(StatePolicy* activeState, uint8_t& leaf) {
+    using S = typename Level::Head;
+    if (activeState->template typeOf<S>()) {
+      leaf = (uint8_t)LokiLight::IndexOf<States, S>::Result;
+      return ((uint64_t)1 << leaf) | below(static_cast<S*>(activeState), leaf, LokiLight::Int2Type<IsSubstatesHolder<S>::value>());
+    }
+    return ActiveStates<Sm, States, typename Level::Tail>::of(activeState, leaf);
+  }
+
+private:
+  template<class S>
+  static uint64_t below(S*, uint8_t&, const LokiLight::Int2Type<false>&) {
+    return 0;
+  }
+  template<class S>
+  static uint64_t below(S* holder, uint8_t& leaf, const LokiLight::Int2Type<true>&) {
+    return ActiveStates<typename S::SubstatemachineType, States>::of(holder->_substatemachine(), leaf);
+  }
+};
+template<class Sm, class States>
+struct ActiveStates<Sm, States, LokiLight::NullType> {
+  static uint64_t of(typename Sm::StatePolicy*, uint8_t&) {
+    return 0;
+  }
+};
+
+/**
+  Singleton states are shared by all state machine objects, factory and instance states are not. Workers
+  can only explore in parallel if the singletons have no fields that the workers could write at the same
+  time: no fields besides the state policy, no persistent fields and no nested state machines.
+*/
+template<class States>
+struct SharesConfiguration;
+template<>
+struct SharesConfiguration<LokiLight::NullType> {
+  enum { value = false };
+};
+template<class S, class Tail>
+struct SharesConfiguration< LokiLight::Typelist<S, Tail> > {
+  enum {
+    value = (is_same<typename S::CreatorType, SingletonCreator<S> >::value
+      && (sizeof(S) > sizeof(typename S::Policy) || IsPersistent<S>::value || IsSubstatesHolder<S>::value))
+      || SharesConfiguration<Tail>::value
+  };
+};
+
+template<class Sm, class Events, class Indices>
+struct ExplorerDispatcher;
+template<class Sm, class Events, uint8_t... I>
+struct ExplorerDispatcher<Sm, Events, IndexSequence<I...> > {
+  typedef bool (*Handler)(Sm&);
+
+  template<class Event>
+  static bool dispatch(Sm& sm) {
+    return sm.template dispatch<Event>().consumed;
+  }
+
+  static bool dispatch(Sm& sm, uint8_t eventId) {
+    static const Handler handlers[] = {
+      &dispatch<typename LokiLight::TypeAt<Events, I>::Result>...
+    };
+    return handlers[eventId](sm);
+  }
+};
+}
+
+/**
+  Finds all configurations that Sm reaches from begin by dispatching the Events (by default all
+  event types of its transitions) in any order. A configuration is the snapshot of Sm (see save),
+  so the fields of persistent states are part of it, and the other fields must not change what
+  the state machine does. The configurations are explored breadth first by several threads,
+  unless singleton states have fields, then by one.
+
+  The result tells which states are never active, in which the state machine gets stuck (no event
+  is consumed any more), and which events a state consumes.
+*/
+template<class Sm, class Events = typename LokiLight::NoDuplicates<typename impl::EventsOfStatemachines<typename impl::StatemachinesOf<Sm>::Result>::Result>::Result, size_t SnapshotSize = 32>
+class Explorer {
+public:
+  using States = typename impl::AllStatesOf<Sm>::Result;
+
+  enum {
+    NumberOfStates = LokiLight::Length<States>::value,
+    NumberOfEvents = LokiLight::Length<Events>::value,
+    Parallel = !impl::SharesConfiguration<States>::value
+  };
+
+  static_assert(NumberOfStates <= 64 && NumberOfEvents <= 64, "The states and events are bit masks");
+
+  // Stops when maxConfigurations are found, see complete().
+  explicit Explorer(size_t maxConfigurations = 1 << 16) : maxConfigurations_(maxConfigurations) {}
+
+  // Returns complete().
+  bool explore(unsigned threads = std::thread::hardware_concurrency()) {
+    threads = Parallel && threads > 0 ? threads : 1;
+    configurations_ = 0;
+    edges_ = 0;
+    terminated_ = 0;
+    complete_ = true;
+    result_ = Result();
+    impl::SnapshotSet<SnapshotSize> visited(maxConfigurations_);
+
+    Sm sm;
+    sm.begin();
+    impl::ExplorerWriter<SnapshotSize> writer;
+    sm.save(writer);
+    sm._release();
+    if (writer.overflowed) return complete_ = false;
+
+    bool inserted;
+    std::vector<uint32_t> frontier(1, visited.insert(writer.data, writer.size, inserted));
+    std::atomic<size_t> reached{ 1 };
+
+    while (!frontier.empty() && complete_) {
+      std::atomic<size_t> next{ 0 };
+      std::vector<Worker> workers(threads);
+      for (Worker& worker : workers) {
+        worker.configurations = &reached;
+        worker.maxConfigurations = maxConfigurations_;
+      }
+      auto work = [&](Worker& worker) { worker.run(visited, frontier, next); };
+      std::vector<std::thread> helpers;
+      for (unsigned n = 1; n < threads; n++) helpers.emplace_back(work, std::ref(workers[n]));
+      work(workers[0]);
+      for (std::thread& helper : helpers) helper.join();
+
+      frontier.clear();
+      for (Worker& worker : workers) {
+        frontier.insert(frontier.end(), worker.found.begin(), worker.found.end());
+        result_.merge(worker.result);
+        edges_ += worker.edges;
+        terminated_ += worker.terminated;
+        complete_ = complete_ && worker.complete;
+      }
+    }
+    configurations_ = reached < maxConfigurations_ ? reached.load() : maxConfigurations_;
+    return complete_;
+  }
+
+  // False if the exploration stopped at maxConfigurations, a snapshot was larger than SnapshotSize
+  // or could not be restored.
+  bool complete() const {
+    return complete_;
+  }
+
+  // Distinct configurations found, including the ones without active state.
+  size_t configurations() const {
+    return configurations_;
+  }
+
+  // Consumed dispatches from the found configurations.
+  uint64_t edges() const {
+    return edges_;
+  }
+
+  // Configurations without active state, i.e. after a final transition.
+  uint64_t terminated() const {
+    return terminated_;
+  }
+
+  template<class S>
+  bool reachable() const {
+    return (result_.reachable & _bit<S>()) != 0;
+  }
+
+  // S is the innermost active state of a configuration that consumes no event.
+  template<class S>
+  bool deadEnd() const {
+    return (result_.deadEnds & _bit<S>()) != 0;
+  }
+
+  // Bit mask over Events of the events consumed while S is active.
+  template<class S>
+  uint64_t consumedEvents() const {
+    return result_.consumed[_index<S>()];
+  }
+
+  size_t unreachableStates() const {
+    return (size_t)(NumberOfStates - _bits(result_.reachable));
+  }
+
+  size_t deadEndStates() const {
+    return (size_t)_bits(result_.deadEnds);
+  }
+
+private:
+  struct Result {
+    uint64_t reachable = 0;
+    uint64_t deadEnds = 0;
+    uint64_t consumed[NumberOfStates] = {};
+
+    void merge(const Result& other) {
+      reachable |= other.reachable;
+      deadEnds |= other.deadEnds;
+      for (size_t n = 0; n < NumberOfStates; n++) consumed[n] |= other.consumed[n];
+    }
+  };
+
+  struct Worker {
+    void run(impl::SnapshotSet<SnapshotSize>& visited, const std::vector<uint32_t>& frontier, std::atomic<size_t>& next) {
+      for (size_t n = next.fetch_add(1, std::memory_order_relaxed); n < frontier.size(); n = next.fetch_add(1, std::memory_order_relaxed)) {
+        _visit(visited, frontier[n]);
+      }
+    }
+
+    void _visit(impl::SnapshotSet<SnapshotSize>& visited, uint32_t configuration) {
+      using Dispatcher = impl::ExplorerDispatcher<Sm, Events, typename impl::MakeIndexSequence<NumberOfEvents>::Result>;
+
+      uint64_t active = 0;
+      uint8_t leaf = 0;
+      uint64_t consumedEvents = 0;
+      for (uint8_t eventId = 0; eventId < NumberOfEvents; eventId++) {
+        Sm sm;
+        BufferReader reader(visited.data(configuration), visited.size(configuration));
+        if (!sm.restore(reader)) {
+          complete = false;
+          sm._release();
+          return;
+        }
+        if (eventId == 0) {
+          active = impl::ActiveStates<Sm, States>::of(sm, leaf);
+          result.reachable |= active;
+          if (active == 0) {
+            terminated++;
+            return;
+          }
+        }
+
+        if (Dispatcher::dispatch(sm, eventId)) {
+          consumedEvents |= (uint64_t)1 << eventId;
+          edges++;
+          impl::ExplorerWriter<SnapshotSize> writer;
+          sm.save(writer);
+          if (writer.overflowed) {
+            complete = false;
+          } else {
+            bool inserted;
+            const uint32_t slot = visited.insert(writer.data, writer.size, inserted);
+            if (slot == impl::SnapshotSet<SnapshotSize>::Full) complete = false;
+            // Configurations beyond maxConfigurations are not explored.
+            if (inserted && configurations->fetch_add(1, std::memory_order_relaxed) >= maxConfigurations) {
+              complete = false;
+            } else if (inserted) {
+              found.push_back(slot);
+            }
+          }
+        }
+        sm._release();
+      }
+
+      if (consumedEvents == 0) result.deadEnds |= (uint64_t)1 << leaf;
+      for (size_t n = 0; n < NumberOfStates; n++) {
+        if (active & ((uint64_t)1 << n)) result.consumed[n] |= consumedEvents;
+      }
+    }
+
+    std::vector<uint32_t> found;
+    std::atomic<size_t>* configurations = nullptr;
+    size_t maxConfigurations = 0;
+    Result result;
+    uint64_t edges = 0;
+    uint64_t terminated = 0;
+    bool complete = true;
+  };
+
+  template<class S>
+  static size_t _index() {
+    static_assert(LokiLight::IndexOf<States, S>::Result != -1, "S is not a state of the state machine");
+    return (size_t)LokiLight::IndexOf<States, S>::Result;
+  }
+
+  template<class S>
+  static uint64_t _bit() {
+    return (uint64_t)1 << _index<S>();
+  }
+
+  static size_t _bits(uint64_t mask) {
+    size_t count = 0;
+    for (; mask != 0; mask &= mask - 1) count++;
+    return count;
+  }
+
+  const size_t maxConfigurations_;
+  size_t configurations_ = 0;
+  uint64_t edges_ = 0;
+  uint64_t terminated_ = 0;
+  bool complete_ = true;
+  Result result_;
+};
+}
@@ -0,0 +1,349 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "lokilight.h"
+#include "statemachine.h"
+#include "statemachinetraits.h"
+
+namespace tsmlib {
+
+namespace impl {
+
+/**
+  All configurations of the state machine Sm. A configuration is the path of active states from the top level
+  down to a leaf state, e.g. Typelist<A, Typelist<AA, Typelist<AAA, NullType>>>.
+  A path that ends with a holder state stands for a nested state machine without active state.
+*/
+template<class Sm, class Prefix = LokiLight::NullType, class States = typename StatesOf<Sm>::Result>
+struct Configurations;
+
+template<class Path, class S, bool Holder = IsSubstatesHolder<S>::value>
+struct ConfigurationsOfState {
+  typedef LokiLight::Typelist<Path, LokiLight::NullType> Result;
+};
+template<class Path, class S>
+struct ConfigurationsOfState<Path, S, true> {
+private:
+  using Substatemachine = typename S::SubstatemachineType;
+  typedef typename LokiLight::Select<
+    StatesOf<Substatemachine>::Terminates,
+    LokiLight::Typelist<Path, LokiLight::NullType>,
+    LokiLight::NullType>::Result Terminated;
+
+public:
+  typedef typename LokiLight::Append<typename Configurations<Substatemachine, Path>::Result, Terminated>::Result Result;
+};
+
+template<class Sm, class Prefix>
+struct Configurations<Sm, Prefix, LokiLight::NullType> {
+  typedef LokiLight::NullType Result;
+};
+template<class Sm, class Prefix, class S, class Tail>
+struct Configurations<Sm, Prefix, LokiLight::Typelist<S, Tail> > {
+  typedef typename LokiLight::Append<
+    typename ConfigurationsOfState<typename LokiLight::Append<Prefix, S>::Result, S>::Result,
+    typename Configurations<Sm, Prefix, Tail>::Result>::Result Result;
+};
+
+// Index of the configuration Path; the number of configurations stands for "no active state".
+template<class Configs, class Path>
+struct ConfigurationIndex {
+private:
+  enum { Found = LokiLight::IndexOf<Configs, Path>::Result, Size = LokiLight::Length<Configs>::value };
+
+public:
+  enum { value = Found == -1 ? Size : Found };
+};
+
+// Configuration after entering To on the level below Prefix.
+template<class Configs, class Prefix, class To, bool Empty = IsEmptyState<To>::value>
+struct TargetConfiguration {
+  enum { value = ConfigurationIndex<Configs, typename LokiLight::Append<Prefix, typename InitialPath<typename To::ObjectType>::Result>::Result>::value };
+};
+template<class Configs, class Prefix, class To>
+struct TargetConfiguration<Configs, Prefix, To, true> {
+  enum { value = ConfigurationIndex<Configs, Prefix>::value };
+};
+
+struct FlatResult {
+  FlatResult(bool consumed, uint8_t configuration) {
+    this->consumed = consumed;
+    this->configuration = configuration;
+  }
+
+  bool consumed;
+  uint8_t configuration;
+};
+
+// Finds the configuration at runtime. Only needed when the target is not known at compile time (choice transitions).
+template<class Configs, class Sm, class Prefix, class States = typename StatesOf<Sm>::Result>
+struct Locate {
+  using StatePolicy = typename Sm::StatePolicy;
+
+  static uint8_t find(Sm& sm) {
+    StatePolicy* activeState = sm._activeState();
+    if (activeState == nullptr) {
+      return ConfigurationIndex<Configs, Prefix>::value;
+    }
+    return find(sm, activeState);
+  }
+
+  static uint8_t find(Sm& sm, StatePolicy* activeState) {
+    using S = typename States::Head;
+    if (activeState->template typeOf<S>()) {
+      return below(static_cast<S*>(activeState), LokiLight::Int2Type<IsSubstatesHolder<S>::value>());
+    }
+    return Locate<Configs, Sm, Prefix, typename States::Tail>::find(sm, activeState);
+  }
+
+private:
+  template<class S>
+  static uint8_t below(S*, const LokiLight::Int2Type<false>&) {
+    return ConfigurationIndex<Configs, typename LokiLight::Append<Prefix, S>::Result>::value;
+  }
+  template<class S>
+  static uint8_t below(S* holder, const LokiLight::Int2Type<true>&) {
+    using Substatemachine = typename S::SubstatemachineType;
+    return Locate<Configs, Substatemachine, typename LokiLight::Append<Prefix, S>::Result>::find(holder->_substatemachine());
+  }
+};
+template<class Configs, class Sm, class Prefix>
+struct Locate<Configs, Sm, Prefix, LokiLight::NullType> {
+  static uint8_t find(Sm&, typename Sm::StatePolicy*) {
+    return LokiLight::Length<Configs>::value;
+  }
+};
+
+template<class Configs, class Sm, class Prefix, class Path, class Event>
+struct FlatStep;
+
+/**
+  Executes the transition T on the level of Sm. The generic version is used for choice transitions and
+  other transitions whose target is only known at runtime.
+*/
+template<class Configs, class Sm, class Prefix, class Path, class Event, class T>
+struct FlatTransition {
+  static FlatResult execute(Sm& sm, const Event& ev, uint8_t configuration) {
+    auto result = T().dispatch(sm._activeState(), ev);
+    if (!result.consumed) {
+      return FlatResult(false, configuration);
+    }
+    sm._changeActiveState(result.activeState);
+    return FlatResult(true, Locate<Configs, Sm, Prefix>::find(sm));
+  }
+};
+
+// No transition for the event in this configuration.
+template<class Configs, class Sm, class Prefix, class Path, class Event>
+struct FlatTransition<Configs, Sm, Prefix, Path, Event, LokiLight::NullType> {
+  static FlatResult execute(Sm&, const Event&, uint8_t configuration) {
+    return FlatResult(false, configuration);
+  }
+};
+
+template<class Configs, class Sm, class Prefix, class Path, class Event, class T, bool Delegating>
+struct FlatTransitionBase;
+
+// The transition is executed by the TransitionBase as on the nested state machine.
+template<class Configs, class Sm, class Prefix, class Path, class Event, class T>
+struct FlatTransitionBase<Configs, Sm, Prefix, Path, Event, T, false> {
+  using To = typename T::ToType;
+  using From = typename T::FromType;
+
+  static FlatResult execute(Sm& sm, const Event& ev, uint8_t configuration) {
+    auto activeState = sm._activeState();
+    auto result = T().dispatch(activeState, ev);
+    if (!result.consumed) {
+      return FlatResult(false, configuration);
+    }
+    sm._changeActiveState(result.activeState);
+
+    if (is_same<To, From>().value || result.activeState == activeState) {
+      return FlatResult(true, configuration);
+    }
+    return FlatResult(true, TargetConfiguration<Configs, Prefix, To>::value);
+  }
+};
+
+/**
+  The transition passes the event on to the nested state machine of the holder state (Declaration, ExitDeclaration).
+  The nested state machine is dispatched directly instead of through SubstatesHolderState::_doit.
+*/
+template<class Configs, class Sm, class Prefix, class Path, class Event, class T>
+struct FlatTransitionBase<Configs, Sm, Prefix, Path, Event, T, true> {
+  using To = typename T::ToType;
+  using From = typename T::FromType;
+  using Substatemachine = typename From::SubstatemachineType;
+  using SubPrefix = typename LokiLight::Append<Prefix, typename Path::Head>::Result;
+  using ReenteredPath = typename InitialPath<typename From::ObjectType>::Result;
+  // A reentered holder state begins its nested state machine with the initial state.
+  using SubPath = typename LokiLight::Select<T::R, typename ReenteredPath::Tail, typename Path::Tail>::Result;
+
+  static FlatResult execute(Sm& sm, const Event& ev, uint8_t configuration) {
+    From* fromState = static_cast<From*>(sm._activeState());
+    typename T::ActionType().perform(*fromState, ev);
+
+    if (!typename T::GuardType().eval(*fromState, ev)) {
+      return FlatResult(false, configuration);
+    }
+
+    if (T::R) {
+      fromState->template _exit<Event>(ev);
+      fromState->template _entry<Event>(ev);
+      configuration = ConfigurationIndex<Configs, typename LokiLight::Append<Prefix, ReenteredPath>::Result>::value;
+    }
+
+    const FlatResult result = FlatStep<Configs, Substatemachine, SubPrefix, SubPath, Event>::execute(fromState->_substatemachine(), ev, configuration);
+    if (!T::D || result.consumed) {
+      return result;
+    }
+
+    // Exit declaration, the nested state machine did not consume the event.
+    sm._changeActiveState(ChangeState<From, To, Event, true, false>::execute(fromState, ev).activeState);
+    return FlatResult(true, TargetConfiguration<Configs, Prefix, To>::value);
+  }
+};
+
+template<class Configs, class Sm, class Prefix, class Path, class Event,
+         class E, class To, class From, class Guard, class Action, bool En, bool X, bool R, bool D>
+struct FlatTransition<Configs, Sm, Prefix, Path, Event, TransitionBase<E, To, From, Guard, Action, En, X, R, D> >
+  : FlatTransitionBase<
+      Configs, Sm, Prefix, Path, Event,
+      TransitionBase<E, To, From, Guard, Action, En, X, R, D>,
+      IsSubstatesHolder<From>::value && (is_same<To, From>::value || D)> {
+};
+
+template<class Configs, class Sm, class Prefix, class Path, class Event, class T>
+struct FlatTransition<Configs, Sm, Prefix, Path, Event, LikelyTransition<T> > : FlatTransition<Configs, Sm, Prefix, Path, Event, T> {};
+
+template<class Configs, class Sm, class Prefix, class Path, class Event>
+struct FlatStep {
+  using T = typename ResolveTransition<typename Sm::TransitionsType, Event, typename Path::Head>::Result;
+
+  static FlatResult execute(Sm& sm, const Event& ev, uint8_t configuration) {
+    return FlatTransition<Configs, Sm, Prefix, Path, Event, T>::execute(sm, ev, configuration);
+  }
+};
+// Nested state machine without active state.
+template<class Configs, class Sm, class Prefix, class Event>
+struct FlatStep<Configs, Sm, Prefix, LokiLight::NullType, Event> {
+  static FlatResult execute(Sm&, const Event&, uint8_t configuration) {
+    return FlatResult(false, configuration);
+  }
+};
+
+// One handler per configuration, the active configuration is the index into the table.
+template<class Configs, class Sm, class Event, class Indices>
+struct FlatDispatcher;
+template<class Configs, class Sm, class Event, uint8_t... I>
+struct FlatDispatcher<Configs, Sm, Event, IndexSequence<I...> > {
+  typedef FlatResult (*Handler)(Sm&, const Event&, uint8_t);
+
+  static FlatResult execute(Sm& sm, const Event& ev, uint8_t configuration) {
+    static const Handler handlers[] = {
+      &FlatStep<Configs, Sm, LokiLight::NullType, typename LokiLight::TypeAt<Configs, I>::Result, Event>::execute...
+    };
+    return handlers[configuration](sm, ev, configuration);
+  }
+};
+}
+
+/**
+  Dispatches events of a hierarchical state machine with a single table lookup.
+  The hierarchy is flattened at compile time into the list of all configurations (paths of active states),
+  and for each event a table holds the handler for every configuration. The handler executes the transition
+  on the level it was declared, without searching the transition lists of the levels above.
+  The states, transitions and the nested Statemachine objects are the same as for the Statemachine, and the
+  Observer of each level is told about the changes of its level as with the Statemachine.
+*/
+template<class Transitions, class Initialtransition, class Observer = NoObserver>
+class FlatStatemachine {
+public:
+  using StatemachineType = Statemachine<Transitions, Initialtransition, Observer>;
+  using StatePolicy = typename StatemachineType::StatePolicy;
+  using Configurations = typename impl::Configurations<StatemachineType>::Result;
+
+  enum { NumberOfConfigurations = LokiLight::Length<Configurations>::value };
+
+  // The configuration is an uint8_t index, NumberOfConfigurations stands for "no active state".
+  static_assert(NumberOfConfigurations <= 254, "FlatStatemachine supports at most 254 configurations");
+
+  DispatchResult<StatePolicy> begin() {
+    using InitialState = typename Initialtransition::ToType::ObjectType;
+    const auto result = statemachine_.begin();
+    configuration_ = impl::ConfigurationIndex<Configurations, typename impl::InitialPath<InitialState>::Result>::value;
+    return result;
+  }
+
+  DispatchResult<StatePolicy> end() {
+    const auto result = statemachine_.end();
+    if (result.consumed) {
+      configuration_ = NumberOfConfigurations;
+    }
+    return result;
+  }
+
+  template<class Event>
+  DispatchResult<StatePolicy> dispatch() {
+    return dispatch(Event{});
+  }
+
+  template<class Event>
+  DispatchResult<StatePolicy> dispatch(const Event& ev) {
+
+#if defined(TSM_DISPATCH_PROBE)
+    DispatchProbe<StatemachineType> probe(statemachine_);
+#endif
+    if (configuration_ == NumberOfConfigurations) return DispatchResult<StatePolicy>::null;
+
+    using Dispatcher = impl::FlatDispatcher<Configurations, StatemachineType, Event, typename impl::MakeIndexSequence<NumberOfConfigurations>::Result>;
+    const impl::FlatResult result = Dispatcher::execute(statemachine_, ev, configuration_);
+    configuration_ = result.configuration;
+
+    return DispatchResult<StatePolicy>(result.consumed, statemachine_._activeState());
+  }
+
+  template<class Event>
+  bool canDispatch(const Event& ev) const {
+    return statemachine_.canDispatch(ev);
+  }
+
+  template<class Writer>
+  bool save(Writer& writer) const {
+    return statemachine_.save(writer);
+  }
+
+  template<class Reader>
+  bool restore(Reader& reader) {
+    const bool restored = statemachine_.restore(reader);
+    configuration_ = impl::Locate<Configurations, StatemachineType, LokiLight::NullType>::find(statemachine_);
+    return restored;
+  }
+
+  Observer& observer() {
+    return statemachine_.observer();
+  }
+
+  // Index into Configurations, NumberOfConfigurations if there is no active state.
+  uint8_t configuration() const {
+    return configuration_;
+  }
+
+private:
+  StatemachineType statemachine_;
+  uint8_t configuration_ = NumberOfConfigurations;
+};
+}
@@ -0,0 +1,225 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "tsm.h"
+
+namespace tsmlib {
+
+namespace impl {
+
+// Offset of the object of T in the state objects of its InstanceStatemachine.
+template<class T>
+struct InstanceOffset {
+  static size_t value;
+};
+template<class T> size_t InstanceOffset<T>::value = 0;
+
+// The state objects of the InstanceStatemachine that is dispatched on this thread.
+inline char*& currentInstanceSlots() {
+#if defined(ARDUINO)
+  static char* slots = nullptr;
+#else
+  static thread_local char* slots = nullptr;
+#endif
+  return slots;
+}
+}
+
+/**
+  Like SingletonCreator, but the object lives in the InstanceStatemachine that is dispatched, so each
+  instance has its own state objects. When leaving, the object is not destroyed. Make sure you reset the state's state.
+  Only use in InstanceStatemachines; the state objects can only be found during begin, end, dispatch and typeOf.
+  A state type with an InstanceCreator can only be used in one type of InstanceStatemachine.
+*/
+template<class T>
+struct InstanceCreator {
+  using CreatorType = InstanceCreator<T>;
+  using ObjectType = T;
+
+  static T* create() {
+    return reinterpret_cast<T*>(impl::currentInstanceSlots() + impl::InstanceOffset<T>::value);
+  }
+  static void destroy(T*) {}
+};
+
+namespace impl {
+
+// Moves the active state of sm from the state objects at from to the copied ones at to.
+template<class Sm>
+void rebaseActiveState(Sm& sm, const char* from, char* to, size_t size) {
+  const uintptr_t active = reinterpret_cast<uintptr_t>(sm._activeState());
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(from);
+  if (active >= begin && active < begin + size) {
+    sm._setActiveState(reinterpret_cast<typename Sm::StatePolicy*>(to + (active - begin)));
+  }
+}
+
+template<class S, bool Holder = IsSubstatesHolder<S>::value>
+struct RebaseNested {
+  static void rebase(S&, const char*, char*, size_t) {}
+};
+template<class S>
+struct RebaseNested<S, true> {
+  static void rebase(S& state, const char* from, char* to, size_t size) {
+    rebaseActiveState(state._substatemachine(), from, to, size);
+  }
+};
+
+// One object for each state in States that is created by an InstanceCreator.
+template<class States>
+struct InstanceSlots;
+template<>
+struct InstanceSlots<LokiLight::NullType> {
+  bool _registerOffsets(const char*) {
+    return true;
+  }
+
+  void _rebase(const char*, char*, size_t) {}
+};
+template<class S, class Tail, bool Instance = is_same<typename S::CreatorType, InstanceCreator<S> >::value>
+struct InstanceSlotsOf : InstanceSlots<Tail> {};
+template<class S, class Tail>
+struct InstanceSlotsOf<S, Tail, true> : InstanceSlots<Tail> {
+  bool _registerOffsets(const char* slots) {
+    InstanceOffset<S>::value = (size_t)(reinterpret_cast<const char*>(&state) - slots);
+    return InstanceSlots<Tail>::_registerOffsets(slots);
+  }
+
+  void _rebase(const char* from, char* to, size_t size) {
+    RebaseNested<S>::rebase(state, from, to, size);
+    InstanceSlots<Tail>::_rebase(from, to, size);
+  }
+
+  S state;
+};
+template<class S, class Tail>
+struct InstanceSlots< LokiLight::Typelist<S, Tail> > : InstanceSlotsOf<S, Tail> {};
+
+template<class Sm, class States>
+struct InstanceBlock {
+  Sm statemachine;
+  InstanceSlots<States> slots;
+};
+}
+
+/**
+  A Statemachine and the objects of its states that use an InstanceCreator, in one block that is aligned
+  (and therefore padded) to Alignment, by default a cache line. Instances in an array do not share cache lines,
+  and each instance has its own state data next to its active state. tools/falsesharing compares the
+  dispatch time of padded and packed instances that are dispatched from one thread each.
+  A copy has the active states of the original in its own state objects.
+*/
+template<class Transitions, class Initialtransition, size_t Alignment = 64>
+class alignas(Alignment) InstanceStatemachine {
+public:
+  using StatemachineType = Statemachine<Transitions, Initialtransition>;
+  using StatePolicy = typename StatemachineType::StatePolicy;
+  using States = typename impl::AllStatesOf<StatemachineType>::Result;
+
+  enum {
+    InstanceAlignment = Alignment,
+    InstanceSize = (sizeof(impl::InstanceBlock<StatemachineType, States>) + Alignment - 1) / Alignment * Alignment
+  };
+
+  InstanceStatemachine() {
+    // The offsets are the same for all instances.
+    static const bool registered = block_.slots._registerOffsets(_slots());
+    (void)registered;
+  }
+
+  InstanceStatemachine(const InstanceStatemachine& other) : block_(other.block_) {
+    _rebase(other);
+  }
+
+  InstanceStatemachine& operator=(const InstanceStatemachine& other) {
+    block_ = other.block_;
+    _rebase(other);
+    return *this;
+  }
+
+  DispatchResult<StatePolicy> begin() {
+    Scope scope(this);
+    return block_.statemachine.begin();
+  }
+
+  DispatchResult<StatePolicy> end() {
+    Scope scope(this);
+    return block_.statemachine.end();
+  }
+
+  template<class Event>
+  DispatchResult<StatePolicy> dispatch() {
+    return dispatch(Event{});
+  }
+
+  template<class Event>
+  DispatchResult<StatePolicy> dispatch(const Event& ev) {
+    Scope scope(this);
+    return block_.statemachine.dispatch(ev);
+  }
+
+  void _release() {
+    Scope scope(this);
+    block_.statemachine._release();
+  }
+
+  StatePolicy* _activeState() {
+    return block_.statemachine._activeState();
+  }
+
+  // True if S is the active state. _activeState()->typeOf<S>() only works while the instance is dispatched.
+  template<class S>
+  bool typeOf() {
+    Scope scope(this);
+    return block_.statemachine._activeState() != nullptr && block_.statemachine._activeState()->template typeOf<S>();
+  }
+
+  // The object of state S in this instance.
+  template<class S>
+  S& state() {
+    return *reinterpret_cast<S*>(_slots() + impl::InstanceOffset<S>::value);
+  }
+
+private:
+  // Makes this instance the current one while it is dispatched, and restores the previous one.
+  class Scope {
+  public:
+    explicit Scope(InstanceStatemachine* sm) : previous_(impl::currentInstanceSlots()) {
+      impl::currentInstanceSlots() = sm->_slots();
+    }
+    ~Scope() {
+      impl::currentInstanceSlots() = previous_;
+    }
+
+  private:
+    char* previous_;
+  };
+
+  char* _slots() {
+    return reinterpret_cast<char*>(&block_.slots);
+  }
+
+  // The active states of all levels point into the state objects of other, the copy of the block.
+  void _rebase(const InstanceStatemachine& other) {
+    const char* from = reinterpret_cast<const char*>(&other.block_.slots);
+    const size_t size = sizeof(block_.slots);
+    impl::rebaseActiveState(block_.statemachine, from, _slots(), size);
+    block_.slots._rebase(from, _slots(), size);
+  }
+
+  impl::InstanceBlock<StatemachineType, States> block_;
+};
+}
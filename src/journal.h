@@ -0,0 +1,355 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: append-only journal of dispatched events and replay into state machines.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "tsm.h"
+
+namespace tsmlib {
+
+namespace impl {
+
+/**
+  Layout: JournalHeader, then records of JournalRecord followed by payloadSize bytes of the event.
+  The event id is the index of the event type in the Events typelist of the journal.
+*/
+struct JournalHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t events;
+};
+
+struct JournalRecord {
+  uint32_t machineId;
+  uint16_t eventId;
+  uint16_t payloadSize;
+};
+
+enum : uint32_t { JournalMagic = 0x74736d4a, JournalVersion = 1 };
+
+template<class Events, class Event>
+struct JournalEvent {
+  enum { Id = LokiLight::IndexOf<Events, Event>::Result };
+  // Events without members are recorded without payload.
+  enum { PayloadSize = std::is_empty<Event>::value ? 0 : sizeof(Event) };
+
+  static_assert(Id != -1, "Event is not in the events of the journal");
+  static_assert(std::is_trivially_copyable<Event>::value, "Events are recorded as bytes");
+};
+
+template<class Events, class Sm, class Indices>
+struct JournalDecoder;
+template<class Events, class Sm, uint8_t... I>
+struct JournalDecoder<Events, Sm, IndexSequence<I...> > {
+  typedef void (*Handler)(Sm&, const uint8_t*);
+
+  template<class Event>
+  static void decode(Sm& sm, const uint8_t* payload) {
+    Event ev{};
+    memcpy(static_cast<void*>(&ev), payload, JournalEvent<Events, Event>::PayloadSize);
+    sm.dispatch(ev);
+  }
+
+  static void dispatch(Sm& sm, uint16_t eventId, const uint8_t* payload) {
+    static const Handler handlers[] = {
+      &decode<typename LokiLight::TypeAt<Events, I>::Result>...
+    };
+    handlers[eventId](sm, payload);
+  }
+
+  // The payload size a record of the event must have, decode copies that many bytes.
+  static uint16_t payloadSize(uint16_t eventId) {
+    static const uint16_t sizes[] = {
+      (uint16_t)JournalEvent<Events, typename LokiLight::TypeAt<Events, I>::Result>::PayloadSize...
+    };
+    return sizes[eventId];
+  }
+};
+}
+
+/**
+  Records events into a write-behind buffer that is written in batches to the Writer
+  (see BufferWriter). Events must be trivially copyable and listed in Events. The header is
+  written unless the Writer has an empty() that is false, e.g. FileWriter on an existing journal.
+  The bytes the Writer did not take stay in the buffer for the next flush. Once an event
+  could not be recorded, failed() is true and the journal no longer replays the dispatches.
+*/
+template<class Events, class Writer, size_t BufferSize = 64 * 1024>
+class JournalWriter {
+public:
+  JournalWriter(Writer& writer) : writer_(writer) {
+    if (!_empty(writer, 0)) return;
+
+    impl::JournalHeader header;
+    header.magic = impl::JournalMagic;
+    header.version = impl::JournalVersion;
+    header.events = LokiLight::Length<Events>::value;
+    _add(&header, sizeof(header));
+  }
+
+  ~JournalWriter() {
+    flush();
+  }
+
+  template<class Event>
+  bool append(uint32_t machineId, const Event& ev) {
+    using JournalEvent = impl::JournalEvent<Events, Event>;
+    static_assert(sizeof(impl::JournalRecord) + JournalEvent::PayloadSize <= BufferSize, "Event does not fit into the buffer");
+
+    impl::JournalRecord record;
+    record.machineId = machineId;
+    record.eventId = JournalEvent::Id;
+    record.payloadSize = JournalEvent::PayloadSize;
+
+    if (used_ + sizeof(record) + JournalEvent::PayloadSize > BufferSize) {
+      flush();
+      if (used_ + sizeof(record) + JournalEvent::PayloadSize > BufferSize) {
+        failed_ = true;
+        return false;
+      }
+    }
+    _add(&record, sizeof(record));
+    _add(&ev, JournalEvent::PayloadSize);
+    return true;
+  }
+
+  // Records the event, then dispatches it. A failed record is kept in failed().
+  template<class Sm, class Event>
+  DispatchResult<typename Sm::StatePolicy> dispatch(Sm& sm, uint32_t machineId, const Event& ev) {
+    append(machineId, ev);
+    return sm.dispatch(ev);
+  }
+
+  bool flush() {
+    if (used_ == 0) return true;
+    size_t written = writer_.write(buffer_, used_);
+    if (written > used_) written = used_;
+    memmove(buffer_, buffer_ + written, used_ - written);
+    used_ -= written;
+    return used_ == 0;
+  }
+
+  // True once an event was not recorded.
+  bool failed() const {
+    return failed_;
+  }
+
+private:
+  template<class W>
+  static auto _empty(const W& writer, int) -> decltype(writer.empty()) {
+    return writer.empty();
+  }
+  template<class W>
+  static bool _empty(const W&, long) {
+    return true;
+  }
+
+  void _add(const void* data, size_t size) {
+    memcpy(buffer_ + used_, data, size);
+    used_ += size;
+  }
+
+  Writer& writer_;
+  uint8_t buffer_[BufferSize];
+  size_t used_ = 0;
+  bool failed_ = false;
+};
+
+/**
+  Replays a journal from memory, e.g. mapped by MappedJournal.
+  Machines maps a machine id to the state machine: Sm* operator()(uint32_t machineId),
+  nullptr skips the events of the machine. A truncated last record, or a record whose
+  payload size is not the one of its event, ends the replay.
+*/
+template<class Events>
+class JournalReader {
+public:
+  bool attach(const void* data, size_t size) {
+    if (data == nullptr || size < sizeof(impl::JournalHeader)) return false;
+
+    impl::JournalHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != impl::JournalMagic || header.version != impl::JournalVersion ||
+        header.events != LokiLight::Length<Events>::value) return false;
+
+    data_ = static_cast<const uint8_t*>(data);
+    size_ = size;
+    return true;
+  }
+
+  // Dispatches the events of the machines with machineId % parts == part, returns their number.
+  // Nothing is dispatched if parts is 0.
+  template<class Sm, class Machines>
+  size_t replay(Machines& machines, uint32_t part = 0, uint32_t parts = 1) const {
+    using Decoder = impl::JournalDecoder<Events, Sm, typename impl::MakeIndexSequence<LokiLight::Length<Events>::value>::Result>;
+
+    if (parts == 0) return 0;
+    size_t dispatched = 0;
+    size_t position = data_ != nullptr ? sizeof(impl::JournalHeader) : size_;
+    while (position + sizeof(impl::JournalRecord) <= size_) {
+      impl::JournalRecord record;
+      memcpy(&record, data_ + position, sizeof(record));
+      position += sizeof(record);
+      if (position + record.payloadSize > size_ || record.eventId >= LokiLight::Length<Events>::value ||
+          record.payloadSize != Decoder::payloadSize(record.eventId)) break;
+
+      if (record.machineId % parts == part) {
+        Sm* sm = machines(record.machineId);
+        if (sm != nullptr) {
+          Decoder::dispatch(*sm, record.eventId, data_ + position);
+          dispatched++;
+        }
+      }
+      position += record.payloadSize;
+    }
+    return dispatched;
+  }
+
+  // Each thread replays the machines of one part, the events of a machine keep their order.
+  // Nothing is dispatched if threads is 0.
+  template<class Sm, class Machines>
+  size_t replayParallel(Machines& machines, uint32_t threads) const {
+    if (threads == 0) return 0;
+    std::vector<size_t> dispatched(threads, 0);
+    std::vector<std::thread> workers;
+    for (uint32_t n = 0; n < threads; n++) {
+      workers.emplace_back([this, &machines, &dispatched, n, threads]() {
+        dispatched[n] = replay<Sm>(machines, n, threads);
+      });
+    }
+
+    size_t total = 0;
+    for (uint32_t n = 0; n < threads; n++) {
+      workers[n].join();
+      total += dispatched[n];
+    }
+    return total;
+  }
+
+private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+// Writer that appends to a file, an existing journal is continued.
+class FileWriter {
+public:
+  FileWriter() = default;
+  FileWriter(const FileWriter&) = delete;
+  FileWriter& operator=(const FileWriter&) = delete;
+
+  ~FileWriter() {
+    close();
+  }
+
+  bool open(const char* path) {
+    close();
+    fd_ = ::open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    struct stat info;
+    empty_ = fd_ >= 0 && fstat(fd_, &info) == 0 && info.st_size == 0;
+    return fd_ >= 0;
+  }
+
+  // True if the file had no bytes when it was opened, JournalWriter writes the header then.
+  bool empty() const {
+    return empty_;
+  }
+
+  void close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  size_t write(const uint8_t* bytes, size_t length) {
+    size_t written = 0;
+    while (fd_ >= 0 && written < length) {
+      const ssize_t n = ::write(fd_, bytes + written, length - written);
+      if (n <= 0) break;
+      written += (size_t)n;
+    }
+    return written;
+  }
+
+private:
+  int fd_ = -1;
+  bool empty_ = true;
+};
+
+// Maps a journal file read-only for replay. Not copyable, the mapping is unmapped once.
+template<class Events>
+class MappedJournal {
+public:
+  MappedJournal() = default;
+  MappedJournal(const MappedJournal&) = delete;
+  MappedJournal& operator=(const MappedJournal&) = delete;
+
+  ~MappedJournal() {
+    close();
+  }
+
+  bool open(const char* path) {
+    close();
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    const bool found = fstat(fd, &info) == 0 && info.st_size > 0;
+    void* region = found ? mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (region == MAP_FAILED) return false;
+
+    region_ = region;
+    size_ = (size_t)info.st_size;
+    madvise(region_, size_, MADV_SEQUENTIAL);
+    return reader_.attach(region_, size_);
+  }
+
+  void close() {
+    if (region_ != nullptr) {
+      munmap(region_, size_);
+      region_ = nullptr;
+      size_ = 0;
+    }
+    reader_ = JournalReader<Events>();
+  }
+
+  const JournalReader<Events>& reader() const {
+    return reader_;
+  }
+
+private:
+  JournalReader<Events> reader_;
+  void* region_ = nullptr;
+  size_t size_ = 0;
+};
+#endif
+}
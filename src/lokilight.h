@@ -86,4 +86,33 @@ struct Append<Typelist<Head, Tail>, T> {
   typedef Typelist<Head,
   typename Append<Tail, T>::Result> Result;
 };
+
+// From Loki
+template<class TList, class T> struct Erase;
+template<class T> struct Erase<NullType, T> {
+  typedef NullType Result;
+};
+template<class T, class Tail>
+struct Erase<Typelist<T, Tail>, T> {
+  typedef Tail Result;
+};
+template<class Head, class Tail, class T>
+struct Erase<Typelist<Head, Tail>, T> {
+  typedef Typelist<Head,
+  typename Erase<Tail, T>::Result> Result;
+};
+
+// From Loki
+template<class TList> struct NoDuplicates;
+template<> struct NoDuplicates<NullType> {
+  typedef NullType Result;
+};
+template<class Head, class Tail>
+struct NoDuplicates< Typelist<Head, Tail> > {
+private:
+  typedef typename NoDuplicates<Tail>::Result L1;
+  typedef typename Erase<L1, Head>::Result L2;
+public:
+  typedef Typelist<Head, L2> Result;
+};
 }
@@ -0,0 +1,130 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "tsm.h"
+
+namespace tsmlib {
+
+/**
+  Up to Capacity state machines of type Sm, stored densely in one cache-line-aligned array.
+  A machine is addressed by a handle (uint32_t or uint64_t) that holds the slot index in the lower half
+  and the generation of the slot in the upper half. Destroying a machine increments the generation, so old
+  handles no longer find a machine. Handle 0 is never valid.
+  The live machines are the array [data(), data() + size()); destroy moves the last machine into the gap,
+  so pointers into the array are only valid until the next destroy.
+*/
+template<class Sm, uint32_t Capacity, class Handle = uint32_t>
+class MachineRegistry {
+  enum : Handle { IndexBits = sizeof(Handle) * 4, IndexMask = ((Handle)1 << IndexBits) - 1, GenerationMask = IndexMask };
+
+public:
+  static_assert(is_same<Handle, uint32_t>::value || is_same<Handle, uint64_t>::value, "Handle is uint32_t or uint64_t");
+  static_assert(Capacity > 0 && (Capacity - 1) <= (Handle)(IndexMask - 1), "Capacity does not fit into the index of the handle");
+
+  enum : Handle { NullHandle = 0 };
+
+  MachineRegistry() {
+    for (uint32_t n = 0; n < Capacity; n++) {
+      slots_[n].generation = 1;
+      slots_[n].dense = n + 1;
+    }
+  }
+
+  // Returns NullHandle if the registry is full. The machine is not begun.
+  Handle create() {
+    if (size_ == Capacity) return NullHandle;
+
+    const uint32_t index = freeSlot_;
+    Slot& slot = slots_[index];
+    freeSlot_ = slot.dense;
+    slot.dense = size_;
+
+    machines_[size_] = Sm();
+    owners_[size_] = index;
+    size_++;
+    return ((Handle)slot.generation << IndexBits) | index;
+  }
+
+  // Ends the machine and destroys the states end() left active. Returns false if the handle is stale.
+  bool destroy(Handle handle) {
+    Sm* sm = get(handle);
+    if (sm == nullptr) return false;
+
+    sm->end();
+    sm->_release();
+    const uint32_t index = (uint32_t)(handle & IndexMask);
+    const uint32_t dense = slots_[index].dense;
+    const uint32_t last = --size_;
+    if (dense != last) {
+      // An InstanceStatemachine moves its active states into the copied state objects.
+      machines_[dense] = machines_[last];
+      machines_[last] = Sm();
+      owners_[dense] = owners_[last];
+      slots_[owners_[dense]].dense = dense;
+    }
+    Slot& slot = slots_[index];
+    if (++slot.generation == 0 || slot.generation > GenerationMask) slot.generation = 1;
+    slot.dense = freeSlot_;
+    freeSlot_ = index;
+    return true;
+  }
+
+  // Returns nullptr if the handle is stale.
+  Sm* get(Handle handle) {
+    const uint32_t index = (uint32_t)(handle & IndexMask);
+    if (index >= Capacity) return nullptr;
+
+    const Slot& slot = slots_[index];
+    if (handle == NullHandle || slot.generation != (handle >> IndexBits) || slot.dense >= size_ || owners_[slot.dense] != index) return nullptr;
+    return &machines_[slot.dense];
+  }
+
+  // Handle of the machine at data()[dense].
+  Handle handleAt(uint32_t dense) const {
+    const uint32_t index = owners_[dense];
+    return ((Handle)slots_[index].generation << IndexBits) | index;
+  }
+
+  // Dispatches the event to all live machines in array order.
+  template<class Event>
+  void broadcast(const Event& ev) {
+    for (uint32_t n = 0; n < size_; n++) {
+      machines_[n].dispatch(ev);
+    }
+  }
+
+  Sm* data() {
+    return machines_;
+  }
+
+  uint32_t size() const {
+    return size_;
+  }
+
+private:
+  // dense is the index into machines_ of a live slot, or the next free slot.
+  struct Slot {
+    uint32_t generation;
+    uint32_t dense;
+  };
+
+  alignas(64) Sm machines_[Capacity];
+  uint32_t owners_[Capacity];
+  Slot slots_[Capacity];
+  uint32_t freeSlot_ = 0;
+  uint32_t size_ = 0;
+};
+}
@@ -0,0 +1,303 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: state machines chained by queues, each running on its own thread.
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <tuple>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "eventqueue.h"
+
+namespace tsmlib {
+
+namespace impl {
+
+template<class T>
+struct StageEventTag {
+  static const char id;
+};
+template<class T> const char StageEventTag<T>::id = 0;
+
+// Input of a stage as seen by the stage before it.
+class StageInput {
+public:
+  virtual ~StageInput() {}
+  // Blocks while the queue is full. Returns false if the stage has no event with this tag.
+  virtual bool _push(const void* ev, const void* tag, size_t size) = 0;
+};
+
+// Where emit sends the events raised by the actions of the stage that runs on this thread.
+inline StageInput*& stageOutput() {
+  static thread_local StageInput* output = nullptr;
+  return output;
+}
+
+template<class Events, class Indices>
+struct StageEventIds;
+template<class Events, uint8_t... I>
+struct StageEventIds<Events, IndexSequence<I...> > {
+  // Index of the event type with tag in Events, NoEvent if there is none.
+  enum { NoEvent = 0xFF };
+  static uint8_t of(const void* tag) {
+    static const void* const tags[] = { &StageEventTag<typename LokiLight::TypeAt<Events, I>::Result>::id... };
+    for (uint8_t n = 0; n < sizeof...(I); n++) {
+      if (tags[n] == tag) return n;
+    }
+    return NoEvent;
+  }
+};
+}
+
+/**
+  Sends an event from an action to the next stage of the pipeline. Blocks while the queue of the next stage
+  is full (backpressure). Returns false outside of a pipeline, in the last stage, or if the next stage does
+  not take the event.
+*/
+template<class Event>
+bool emit(const Event& ev) {
+  static_assert(std::is_trivially_copyable<Event>::value, "Events are copied as bytes");
+  impl::StageInput* output = impl::stageOutput();
+  return output != nullptr && output->_push(&ev, &impl::StageEventTag<Event>::id, sizeof(Event));
+}
+
+/**
+  A state machine with a bounded single-producer queue for the events in Events, dispatched on the stage's own thread.
+  The producer is the thread of the stage before it, or the thread that posts into the first stage.
+*/
+template<class Sm, class Events, size_t Capacity = 1024>
+class PipelineStage : public impl::StageInput {
+public:
+  using StatemachineType = Sm;
+  static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  template<class Event>
+  void post(const Event& ev) {
+    enum { Id = LokiLight::IndexOf<Events, Event>::Result };
+    static_assert(Id != -1, "Event is not in the events of the stage");
+    static_assert(std::is_trivially_copyable<Event>::value, "Events are copied as bytes");
+    _enqueue(Id, &ev, sizeof(Event));
+  }
+
+  bool _push(const void* ev, const void* tag, size_t size) override {
+    const uint8_t id = Ids::of(tag);
+    if (id == Ids::NoEvent) return false;
+    _enqueue(id, ev, size);
+    return true;
+  }
+
+  // The state machine may only be used by the stage's thread while the pipeline runs.
+  Sm& statemachine() {
+    return statemachine_;
+  }
+
+  uint64_t processed() const {
+    return processed_.load(std::memory_order_acquire);
+  }
+
+  // Events in the queue.
+  size_t depth() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+  size_t maxDepth() const {
+    return maxDepth_.load(std::memory_order_relaxed);
+  }
+
+  // Number of times the producer found the queue full.
+  uint64_t stalls() const {
+    return stalls_.load(std::memory_order_relaxed);
+  }
+
+  void _start(impl::StageInput* output, int cpu) {
+    stop_.store(false, std::memory_order_relaxed);
+    thread_ = std::thread([this, output]() { _run(output); });
+#if defined(__linux__)
+    if (cpu >= 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      pthread_setaffinity_np(thread_.native_handle(), sizeof(set), &set);
+    }
+#else
+    (void)cpu;
+#endif
+  }
+
+  // Waits until the events posted before are dispatched.
+  void _flush() {
+    const size_t posted = tail_.load(std::memory_order_acquire);
+    while (processed() < posted) {
+      std::this_thread::yield();
+    }
+  }
+
+  void _stop() {
+    _flush();
+    stop_.store(true, std::memory_order_release);
+    thread_.join();
+  }
+
+private:
+  using Ids = impl::StageEventIds<Events, typename impl::MakeIndexSequence<LokiLight::Length<Events>::value>::Result>;
+
+  struct Cell {
+    uint8_t eventId;
+    uint8_t storage[impl::MaxEventSize<Events>::value];
+  };
+
+  void _enqueue(uint8_t id, const void* ev, size_t size) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+      stalls_.fetch_add(1, std::memory_order_relaxed);
+      while (tail - head_.load(std::memory_order_acquire) == Capacity) {
+        std::this_thread::yield();
+      }
+    }
+
+    Cell& cell = cells_[tail & (Capacity - 1)];
+    cell.eventId = id;
+    memcpy(cell.storage, ev, size);
+    tail_.store(tail + 1, std::memory_order_release);
+
+    const size_t depth = tail + 1 - head_.load(std::memory_order_relaxed);
+    if (depth > maxDepth_.load(std::memory_order_relaxed)) maxDepth_.store(depth, std::memory_order_relaxed);
+  }
+
+  void _run(impl::StageInput* output) {
+    impl::stageOutput() = output;
+    using Dispatcher = impl::QueuedEventDispatcher<Events, Sm, typename impl::MakeIndexSequence<LokiLight::Length<Events>::value>::Result>;
+    size_t head = head_.load(std::memory_order_relaxed);
+    unsigned idle = 0;
+    while (!stop_.load(std::memory_order_acquire)) {
+      if (head == tail_.load(std::memory_order_acquire)) {
+        if (++idle < 64) {
+          std::this_thread::yield();
+        } else {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        continue;
+      }
+      idle = 0;
+
+      // Copied out, so the producer can reuse the cell while the event is dispatched.
+      const Cell cell = cells_[head & (Capacity - 1)];
+      head_.store(++head, std::memory_order_release);
+      Dispatcher::dispatch(statemachine_, cell.eventId, cell.storage);
+      processed_.store(head, std::memory_order_release);
+    }
+    impl::stageOutput() = nullptr;
+  }
+
+  Cell cells_[Capacity];
+  alignas(64) std::atomic<size_t> tail_{ 0 };
+  alignas(64) std::atomic<size_t> head_{ 0 };
+  alignas(64) std::atomic<uint64_t> processed_{ 0 };
+  std::atomic<size_t> maxDepth_{ 0 };
+  std::atomic<uint64_t> stalls_{ 0 };
+  std::atomic<bool> stop_{ false };
+  std::thread thread_;
+  Sm statemachine_;
+};
+
+/**
+  Connects PipelineStages: the events emitted by the actions of a stage go to the next stage.
+  The state machines are begun before the threads start. post sends an event into the first stage and
+  must always be called from the same thread.
+*/
+template<class... Stages>
+class Pipeline {
+public:
+  enum { NumberOfStages = sizeof...(Stages) };
+  static_assert(NumberOfStages > 0, "A pipeline has at least one stage");
+  // The stage index N of the helpers below is a uint8_t, the parameter type of LokiLight::Int2Type.
+  static_assert(NumberOfStages <= 0xff, "Stage indices up to NumberOfStages are uint8_t");
+
+  // With pin, stage n runs on cpu n (Linux only).
+  explicit Pipeline(bool pin = false) {
+    _begin(LokiLight::Int2Type<0>());
+    _start(LokiLight::Int2Type<0>(), pin);
+  }
+
+  ~Pipeline() {
+    _stop(LokiLight::Int2Type<0>());
+  }
+
+  template<class Event>
+  void post(const Event& ev) {
+    std::get<0>(stages_).post(ev);
+  }
+
+  // Waits until all events posted before have passed through all stages.
+  void flush() {
+    _flush(LokiLight::Int2Type<0>());
+  }
+
+  template<uint8_t N>
+  typename std::tuple_element<N, std::tuple<Stages...> >::type& stage() {
+    return std::get<N>(stages_);
+  }
+
+private:
+  template<uint8_t N>
+  void _begin(LokiLight::Int2Type<N>) {
+    std::get<N>(stages_).statemachine().begin();
+    _begin(LokiLight::Int2Type<N + 1>());
+  }
+  void _begin(LokiLight::Int2Type<NumberOfStages>) {}
+
+  // Starts from the last stage, so each stage can emit into a running one.
+  template<uint8_t N>
+  void _start(LokiLight::Int2Type<N>, bool pin) {
+    _start(LokiLight::Int2Type<N + 1>(), pin);
+    std::get<N>(stages_)._start(_output(LokiLight::Int2Type<N + 1>()), pin ? N : -1);
+  }
+  void _start(LokiLight::Int2Type<NumberOfStages>, bool) {}
+
+  template<uint8_t N>
+  impl::StageInput* _output(LokiLight::Int2Type<N>) {
+    return &std::get<N>(stages_);
+  }
+  impl::StageInput* _output(LokiLight::Int2Type<NumberOfStages>) {
+    return nullptr;
+  }
+
+  template<uint8_t N>
+  void _flush(LokiLight::Int2Type<N>) {
+    std::get<N>(stages_)._flush();
+    _flush(LokiLight::Int2Type<N + 1>());
+  }
+  void _flush(LokiLight::Int2Type<NumberOfStages>) {}
+
+  // Stops from the first stage, so the events in flight are dispatched by the later stages.
+  template<uint8_t N>
+  void _stop(LokiLight::Int2Type<N>) {
+    std::get<N>(stages_)._stop();
+    _stop(LokiLight::Int2Type<N + 1>());
+  }
+  void _stop(LokiLight::Int2Type<NumberOfStages>) {}
+
+  std::tuple<Stages...> stages_;
+};
+}
@@ -0,0 +1,268 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: deterministic discrete-event simulation of state machines on a virtual clock.
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "eventqueue.h"
+
+namespace tsmlib {
+
+namespace impl {
+
+// SplitMix64, the same sequence on every platform for the same seed.
+class SimulationRandom {
+public:
+  explicit SimulationRandom(uint64_t seed) : state_(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform in [low, high], low if high is not above low.
+  uint64_t between(uint64_t low, uint64_t high) {
+    if (high <= low) return low;
+    const uint64_t range = high - low + 1;
+    return range == 0 ? next() : low + next() % range;
+  }
+
+private:
+  uint64_t state_;
+};
+
+struct SimulationEntry {
+  uint64_t time;
+  uint64_t sequence;  // Entries at the same time run in the order they were scheduled.
+  uint32_t source;
+  uint32_t instance;
+
+  bool operator<(const SimulationEntry& other) const {
+    // std::push_heap builds a max-heap, the earliest entry must be the largest.
+    return time != other.time ? time > other.time : sequence > other.sequence;
+  }
+};
+}
+
+/**
+  Drives instances of the state machine Sm by a virtual clock: events are dispatched at their
+  scheduled time without waiting, and the seeded random intervals make each run repeatable.
+  Events must be listed in Events.
+
+  The simulation counts for each configuration (see FlatStatemachine) of Sm the time the instances
+  spent in it, and the consumed events by the configurations before and after the dispatch.
+  Note that the instances share singleton states; use the FactoryCreator for per instance data.
+*/
+template<class Sm, class Events>
+class Simulation {
+public:
+  using Configurations = typename impl::Configurations<Sm>::Result;
+
+  enum { NumberOfConfigurations = LokiLight::Length<Configurations>::value, NumberOfEvents = LokiLight::Length<Events>::value };
+
+  Simulation(size_t instances, uint64_t seed)
+    : random_(seed), machines_(instances), configurations_(instances, NumberOfConfigurations), since_(instances, 0),
+      occupancy_(NumberOfConfigurations + 1, 0), transitions_((NumberOfConfigurations + 1) * (NumberOfConfigurations + 1), 0),
+      dispatched_(NumberOfEvents, 0), consumed_(NumberOfEvents, 0) {}
+
+  // Begins all instances at the current time.
+  void begin() {
+    for (size_t n = 0; n < machines_.size(); n++) {
+      machines_[n].begin();
+      _update(n);
+    }
+  }
+
+  // Dispatches ev to the instance at time.
+  // Returns false for a time before now(), which would turn the clock back, or an unknown instance.
+  template<class Event>
+  bool at(uint64_t time, size_t instance, const Event& ev = Event{}) {
+    if (time < now_ || instance >= machines_.size()) return false;
+
+    _schedule(time, _addSource(ev, Once, 0, 0), (uint32_t)instance);
+    return true;
+  }
+
+  // Dispatches ev to all instances every period, the first time at the current time + phase.
+  // Returns false for period 0, which would never let the clock advance.
+  template<class Event>
+  bool every(uint64_t period, uint64_t phase = 0, const Event& ev = Event{}) {
+    if (period == 0) return false;
+
+    _schedule(now_ + phase, _addSource(ev, Periodic, period, period), AllInstances);
+    return true;
+  }
+
+  // Dispatches ev to each instance after a random interval in [minInterval, maxInterval], again and again.
+  // Returns false if maxInterval is below minInterval or 0.
+  template<class Event>
+  bool randomly(uint64_t minInterval, uint64_t maxInterval, const Event& ev = Event{}) {
+    if (maxInterval < minInterval || maxInterval == 0) return false;
+
+    const uint32_t source = _addSource(ev, Random, minInterval, maxInterval);
+    for (size_t n = 0; n < machines_.size(); n++) {
+      _schedule(now_ + random_.between(minInterval, maxInterval), source, (uint32_t)n);
+    }
+    return true;
+  }
+
+  // Dispatches the events scheduled until time, in time order, and advances the clock to time.
+  // Returns the number of dispatched events.
+  uint64_t run(uint64_t time) {
+    uint64_t count = 0;
+    while (!queue_.empty() && queue_.front().time <= time) {
+      std::pop_heap(queue_.begin(), queue_.end());
+      const impl::SimulationEntry entry = queue_.back();
+      queue_.pop_back();
+      now_ = entry.time;
+
+      const Source& source = sources_[entry.source];
+      if (entry.instance == AllInstances) {
+        for (size_t n = 0; n < machines_.size(); n++) _dispatch(n, source);
+        count += machines_.size();
+      } else {
+        _dispatch(entry.instance, source);
+        count++;
+      }
+
+      if (source.kind == Periodic) {
+        _schedule(now_ + source.minInterval, entry.source, entry.instance);
+      } else if (source.kind == Random) {
+        _schedule(now_ + random_.between(source.minInterval, source.maxInterval), entry.source, entry.instance);
+      }
+    }
+    now_ = time > now_ ? time : now_;
+    return count;
+  }
+
+  uint64_t now() const {
+    return now_;
+  }
+
+  Sm& instance(size_t n) {
+    return machines_[n];
+  }
+
+  size_t instances() const {
+    return machines_.size();
+  }
+
+  // Index into Configurations, NumberOfConfigurations if the instance has no active state.
+  uint8_t configuration(size_t n) const {
+    return configurations_[n];
+  }
+
+  // Time all instances together spent in the configuration until now.
+  uint64_t occupancy(uint8_t configuration) const {
+    uint64_t total = occupancy_[configuration];
+    for (size_t n = 0; n < machines_.size(); n++) {
+      if (configurations_[n] == configuration) total += now_ - since_[n];
+    }
+    return total;
+  }
+
+  // Consumed events that were dispatched in configuration from and left the instance in configuration to.
+  uint64_t transitions(uint8_t from, uint8_t to) const {
+    return transitions_[from * (NumberOfConfigurations + 1) + to];
+  }
+
+  template<class Event>
+  uint64_t dispatched() const {
+    return dispatched_[_eventId<Event>()];
+  }
+
+  template<class Event>
+  uint64_t consumed() const {
+    return consumed_[_eventId<Event>()];
+  }
+
+private:
+  enum Kind : uint8_t { Once, Periodic, Random };
+  enum : uint32_t { AllInstances = 0xffffffff };
+
+  struct Source {
+    Kind kind;
+    uint8_t eventId;
+    uint64_t minInterval;
+    uint64_t maxInterval;
+    uint8_t storage[impl::MaxEventSize<Events>::value];
+  };
+
+  template<class Event>
+  static uint8_t _eventId() {
+    static_assert(LokiLight::IndexOf<Events, Event>::Result != -1, "Event is not in the events of the simulation");
+    return (uint8_t)LokiLight::IndexOf<Events, Event>::Result;
+  }
+
+  template<class Event>
+  uint32_t _addSource(const Event& ev, Kind kind, uint64_t minInterval, uint64_t maxInterval) {
+    Source source;
+    source.kind = kind;
+    source.eventId = _eventId<Event>();
+    source.minInterval = minInterval;
+    source.maxInterval = maxInterval;
+    memcpy(source.storage, static_cast<const void*>(&ev), sizeof(Event));
+    sources_.push_back(source);
+    return (uint32_t)(sources_.size() - 1);
+  }
+
+  void _schedule(uint64_t time, uint32_t source, uint32_t instance) {
+    queue_.push_back(impl::SimulationEntry{ time, sequence_++, source, instance });
+    std::push_heap(queue_.begin(), queue_.end());
+  }
+
+  void _dispatch(size_t n, const Source& source) {
+    using Dispatcher = impl::QueuedEventDispatcher<Events, Sm, typename impl::MakeIndexSequence<NumberOfEvents>::Result>;
+    const uint8_t from = configurations_[n];
+    const auto result = Dispatcher::dispatch(machines_[n], source.eventId, source.storage);
+    dispatched_[source.eventId]++;
+    if (result.consumed) {
+      consumed_[source.eventId]++;
+      _update(n);
+      transitions_[from * (NumberOfConfigurations + 1) + configurations_[n]]++;
+    }
+  }
+
+  // Only consumed events can change the configuration.
+  void _update(size_t n) {
+    const uint8_t configuration = impl::Locate<Configurations, Sm, LokiLight::NullType>::find(machines_[n]);
+    if (configuration == configurations_[n]) return;
+    occupancy_[configurations_[n]] += now_ - since_[n];
+    configurations_[n] = configuration;
+    since_[n] = now_;
+  }
+
+  impl::SimulationRandom random_;
+  uint64_t now_ = 0;
+  uint64_t sequence_ = 0;
+  std::vector<impl::SimulationEntry> queue_;
+  std::vector<Source> sources_;
+  std::vector<Sm> machines_;
+  std::vector<uint8_t> configurations_;
+  std::vector<uint64_t> since_;
+  std::vector<uint64_t> occupancy_;
+  std::vector<uint64_t> transitions_;
+  std::vector<uint64_t> dispatched_;
+  std::vector<uint64_t> consumed_;
+};
+}
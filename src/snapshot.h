@@ -0,0 +1,230 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "lokilight.h"
+#include "statemachinetraits.h"
+
+namespace tsmlib {
+
+/**
+  Specialize for states whose fields are saved with the configuration of the state machine.
+  The state then implements:
+    template<class Writer> void save(Writer& writer) const;  // or bool, false if the writer is full
+    template<class Reader> bool restore(Reader& reader);
+  A failed restore destroys the states it created, but fields a singleton state read before are kept.
+*/
+template<class S>
+struct IsPersistent {
+  enum { value = false };
+};
+
+/**
+  Writer and Reader for a memory buffer, e.g. a memory-mapped file.
+  Any other class with the same methods can be used, e.g. Print and Stream on the Arduino.
+*/
+struct BufferWriter {
+  BufferWriter(uint8_t* data, size_t size) {
+    this->data = data;
+    this->size = size;
+    this->position = 0;
+  }
+
+  size_t write(const uint8_t* bytes, size_t length) {
+    if (position + length > size) return 0;
+    for (size_t n = 0; n < length; n++) {
+      data[position + n] = bytes[n];
+    }
+    position += length;
+    return length;
+  }
+
+  uint8_t* data;
+  size_t size;
+  size_t position;
+};
+
+struct BufferReader {
+  BufferReader(const uint8_t* data, size_t size) {
+    this->data = data;
+    this->size = size;
+    this->position = 0;
+  }
+
+  size_t readBytes(uint8_t* bytes, size_t length) {
+    if (position + length > size) return 0;
+    for (size_t n = 0; n < length; n++) {
+      bytes[n] = data[position + n];
+    }
+    position += length;
+    return length;
+  }
+
+  const uint8_t* data;
+  size_t size;
+  size_t position;
+};
+
+namespace impl {
+
+/**
+  Layout: version, then for each level the index of the active state in StatesOf<Sm>, the fields of
+  persistent states and the level of the nested state machine. NoStateIndex marks a level without active state.
+*/
+enum { SnapshotVersion = 1 };
+
+template<class Sm, class States = typename StatesOf<Sm>::Result, uint8_t Index = 0>
+struct SnapshotLevel;
+
+template<class S, bool Persistent = IsPersistent<S>::value, bool Holder = IsSubstatesHolder<S>::value>
+struct SnapshotState {
+  template<class Writer>
+  static bool save(S*, Writer&) {
+    return true;
+  }
+
+  template<class Reader>
+  static bool restore(S*, Reader&) {
+    return true;
+  }
+};
+template<class S>
+struct SnapshotState<S, true, false> {
+  template<class Writer>
+  static bool save(S* state, Writer& writer) {
+    return _save(state, writer, LokiLight::Int2Type<is_same<decltype(state->save(writer)), bool>::value>());
+  }
+
+  template<class Reader>
+  static bool restore(S* state, Reader& reader) {
+    return state->restore(reader);
+  }
+
+private:
+  // A save that returns void cannot fail.
+  template<class Writer>
+  static bool _save(S* state, Writer& writer, const LokiLight::Int2Type<false>&) {
+    state->save(writer);
+    return true;
+  }
+  template<class Writer>
+  static bool _save(S* state, Writer& writer, const LokiLight::Int2Type<true>&) {
+    return state->save(writer);
+  }
+};
+template<class S, bool Persistent>
+struct SnapshotState<S, Persistent, true> {
+  using Substatemachine = typename S::SubstatemachineType;
+
+  template<class Writer>
+  static bool save(S* state, Writer& writer) {
+    return SnapshotState<S, Persistent, false>::save(state, writer)
+      && SnapshotLevel<Substatemachine>::save(state->_substatemachine(), writer);
+  }
+
+  // The nested level is the last part of the state, it is only set when it was read completely.
+  template<class Reader>
+  static bool restore(S* state, Reader& reader) {
+    if (!SnapshotState<S, Persistent, false>::restore(state, reader)) return false;
+    return SnapshotLevel<Substatemachine>::restore(state->_substatemachine(), reader);
+  }
+};
+
+template<class Sm, class S, class Tail, uint8_t Index>
+struct SnapshotLevel<Sm, LokiLight::Typelist<S, Tail>, Index> {
+  using StatePolicy = typename Sm::StatePolicy;
+
+  template<class Writer>
+  static bool save(const Sm& sm, Writer& writer) {
+    StatePolicy* activeState = sm._activeState();
+    if (activeState == nullptr) {
+      const uint8_t index = NoStateIndex;
+      return writer.write(&index, 1) == 1;
+    }
+    return save(activeState, writer);
+  }
+
+  template<class Writer>
+  static bool save(StatePolicy* activeState, Writer& writer) {
+    if (activeState->template typeOf<S>()) {
+      const uint8_t index = Index;
+      return writer.write(&index, 1) == 1 && SnapshotState<S>::save(static_cast<S*>(activeState), writer);
+    }
+    return SnapshotLevel<Sm, Tail, Index + 1>::save(activeState, writer);
+  }
+
+  template<class Reader>
+  static bool restore(Sm& sm, Reader& reader) {
+    uint8_t index;
+    if (reader.readBytes(&index, 1) != 1) return false;
+    if (index == NoStateIndex) {
+      sm._setActiveState(nullptr);
+      return true;
+    }
+    return restore(sm, reader, index);
+  }
+
+  // The state is created but not entered. It is the active state only when it and its nested levels were
+  // read completely, otherwise it is destroyed again.
+  template<class Reader>
+  static bool restore(Sm& sm, Reader& reader, uint8_t index) {
+    if (index == Index) {
+      using Factory = typename S::CreatorType;
+      S* state = Factory::create();
+      if (!SnapshotState<S>::restore(state, reader)) {
+        Factory::destroy(state);
+        return false;
+      }
+      sm._setActiveState(state);
+      return true;
+    }
+    return SnapshotLevel<Sm, Tail, Index + 1>::restore(sm, reader, index);
+  }
+};
+template<class Sm, uint8_t Index>
+struct SnapshotLevel<Sm, LokiLight::NullType, Index> {
+  template<class Writer>
+  static bool save(typename Sm::StatePolicy*, Writer& writer) {
+    // The active state is not a state of this state machine.
+    const uint8_t index = NoStateIndex;
+    return writer.write(&index, 1) == 1;
+  }
+
+  template<class Reader>
+  static bool restore(Sm&, Reader&, uint8_t) {
+    return false;
+  }
+};
+
+template<class Sm>
+struct Snapshot {
+  template<class Writer>
+  static bool save(const Sm& sm, Writer& writer) {
+    const uint8_t version = SnapshotVersion;
+    return writer.write(&version, 1) == 1 && SnapshotLevel<Sm>::save(sm, writer);
+  }
+
+  template<class Reader>
+  static bool restore(Sm& sm, Reader& reader) {
+    // Only a state machine without active state can be restored, active states would not be exited.
+    if (sm._activeState() != nullptr) return false;
+
+    uint8_t version;
+    if (reader.readBytes(&version, 1) != 1 || version != SnapshotVersion) return false;
+    return SnapshotLevel<Sm>::restore(sm, reader);
+  }
+};
+}
+}
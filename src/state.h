@@ -157,6 +157,7 @@ template<class Derived, class StatePolicy, class Statemachine, bool HasEntry = f
 class SubstatesHolderState : public StatePolicy {
 public:
   using Policy = StatePolicy;
+  using SubstatemachineType = Statemachine;
   enum { BasicDoit = false };
 
   template<class Event>
@@ -177,6 +178,14 @@ public:
     return result.consumed;
   }
 
+  Statemachine& _substatemachine() {
+    return subStatemachine_;
+  }
+
+  const Statemachine& _substatemachine() const {
+    return subStatemachine_;
+  }
+
 private:
   template<class Event>
   void __entry(const Event&, const LokiLight::Int2Type<false>&) {
@@ -17,18 +17,71 @@
 #include "lokilight.h"
 #include "transition.h"
 #include "eventdispatchers.h"
+#include "snapshot.h"
+#include "dispatchquery.h"
+
+#if defined(TSM_DISPATCH_PROBE)
+// Header of a test harness that defines DispatchProbe<Sm>, constructed for each dispatch (see tools/hosttests).
+#include TSM_DISPATCH_PROBE
+#endif
 
 namespace tsmlib {
 
-template<class Transitions, class Initialtransition>
-class Statemachine {
+namespace impl {
+
+template<class S, bool Holder = IsSubstatesHolder<S>::value>
+struct ReleaseNested {
+  static void release(S&) {}
+};
+template<class S>
+struct ReleaseNested<S, true> {
+  static void release(S& state) {
+    state._substatemachine()._release();
+  }
+};
+
+// Destroys the active state of the level, after the active states of its nested levels.
+template<class Sm, class States = typename StatesOf<Sm>::Result>
+struct ReleaseLevel;
+template<class Sm>
+struct ReleaseLevel<Sm, LokiLight::NullType> {
+  static void release(typename Sm::StatePolicy*) {}
+};
+template<class Sm, class S, class Tail>
+struct ReleaseLevel<Sm, LokiLight::Typelist<S, Tail> > {
+  static void release(typename Sm::StatePolicy* activeState) {
+    if (!activeState->template typeOf<S>()) {
+      ReleaseLevel<Sm, Tail>::release(activeState);
+      return;
+    }
+    S* state = static_cast<S*>(activeState);
+    ReleaseNested<S>::release(*state);
+    S::CreatorType::destroy(state);
+  }
+};
+}
+
+/**
+  Observers are told the index of the active state (in the states of the state machine's level,
+  impl::NoStateIndex for none) after it changed, and NoStateIndex when the holder state of a
+  nested state machine is left.
+*/
+struct NoObserver {
+  void publish(uint8_t) {}
+};
+
+template<class Transitions, class Initialtransition, class Observer = NoObserver>
+class Statemachine : private Observer {
 public:
   using StatePolicy = typename Initialtransition::StatePolicy;
+  using TransitionsType = Transitions;
+  using InitialtransitionType = Initialtransition;
 
   DispatchResult<StatePolicy> begin() {
     const auto result = Initialtransition().dispatch();
     if (result.consumed) {
       activeState_ = result.activeState;
+      _publish();
     }
     return result;
   }
@@ -43,6 +96,7 @@ public:
     const auto result = Initializer< Transitions, Initialtransition, Event, size - 1 >::init();
     if (result.consumed) {
       activeState_ = result.activeState;
+      _publish();
     }
     return result;
   }
@@ -58,6 +112,7 @@ public:
     auto result = Finalizer< Transitions, size - 1 >::end(activeState_);
     if (result.consumed) {
       activeState_ = 0;
+      _publish();
     }
     return result;
   }
@@ -68,6 +123,10 @@ public:
     const auto result = Finalizer< Transitions, size - 1 >::end(activeState_);
     if (result.consumed) {
       activeState_ = 0;
+      _publish();
+    } else {
+      // The holder state is left without exit transition, the level is inactive anyway.
+      _publishLeft(LokiLight::Int2Type<is_same<Observer, NoObserver>::value>());
     }
     return result;
   }
@@ -80,6 +139,9 @@ public:
   template<class Event>
   DispatchResult<StatePolicy> dispatch(const Event& ev) {
 
+#if defined(TSM_DISPATCH_PROBE)
+    DispatchProbe<Statemachine> probe(*this);
+#endif
     if (activeState_ == nullptr) return DispatchResult<StatePolicy>::null;
 
     const int size = LokiLight::Length<Transitions>::value;
@@ -91,10 +153,96 @@ public:
     }
 
     activeState_ = result.activeState;
+    _publish();
     return DispatchResult<StatePolicy>(true, activeState_);
   }
 
+  /**
+      True if dispatch would consume the event. No action, entry, exit or doit is called, and only
+      pure guards are evaluated (see IsPureGuard). No state is created: From states of Event that the
+      FactoryCreator creates are rejected at compile time with VirtualTypeIdComparator.
+    */
+  template<class Event>
+  bool canDispatch(const Event& ev) const {
+    return impl::DispatchQuery<Transitions, Event>::query(activeState_, ev);
+  }
+
+  template<class Event>
+  bool canDispatch() const {
+    return canDispatch(Event{});
+  }
+
+  // False if no transition handles Event, then dispatch never consumes it.
+  template<class Event>
+  static constexpr bool handles() {
+    return impl::HandlesEvent<Transitions, Event>::value;
+  }
+
+  /**
+      Writes the active state of each level and the fields of persistent states (see IsPersistent).
+      False if the writer did not take all of it.
+    */
+  template<class Writer>
+  bool save(Writer& writer) const {
+    return impl::Snapshot<Statemachine>::save(*this, writer);
+  }
+
+  /**
+      Restores a saved configuration without calling entry. Requires a state machine without active state.
+      If the data is invalid or truncated, false is returned and the state machine has no active state.
+    */
+  template<class Reader>
+  bool restore(Reader& reader) {
+    const bool restored = impl::Snapshot<Statemachine>::restore(*this, reader);
+    if (restored) {
+      _publish();
+    }
+    return restored;
+  }
+
+  Observer& observer() {
+    return *this;
+  }
+
+  // Destroys the active states of all levels without exit, e.g. those that end() left without exit or final transition.
+  void _release() {
+    if (activeState_ == nullptr) return;
+
+    impl::ReleaseLevel<Statemachine>::release(activeState_);
+    activeState_ = 0;
+    _publish();
+  }
+
+  // TODO: private: friend class FlatStatemachine<...; instead of using "_"
+  StatePolicy* _activeState() const {
+    return activeState_;
+  }
+
+  void _setActiveState(StatePolicy* state) {
+    activeState_ = state;
+  }
+
+  // Like _setActiveState, and the observer is told (FlatStatemachine executes the transitions of the levels itself).
+  void _changeActiveState(StatePolicy* state) {
+    activeState_ = state;
+    _publish();
+  }
+
 private:
+  void _publish() {
+    _publish(LokiLight::Int2Type<is_same<Observer, NoObserver>::value>());
+  }
+  void _publish(const LokiLight::Int2Type<true>&) {}
+  void _publish(const LokiLight::Int2Type<false>&) {
+    using States = typename impl::StatesOf<Statemachine>::Result;
+    const uint8_t index = activeState_ != nullptr ? impl::StateIndex<States>::of(activeState_) : (uint8_t)impl::NoStateIndex;
+    Observer::publish(index);
+  }
+  void _publishLeft(const LokiLight::Int2Type<true>&) {}
+  void _publishLeft(const LokiLight::Int2Type<false>&) {
+    Observer::publish((uint8_t)impl::NoStateIndex);
+  }
+
   StatePolicy* activeState_ = 0;
 };
 }
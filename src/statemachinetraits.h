@@ -0,0 +1,451 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "lokilight.h"
+#include "state.h"
+#include "transition.h"
+#include "choicetransition.h"
+#include "finaltransition.h"
+
+/**
+  Estimated bytes of stack one level of nesting takes in a dispatch, begin or end, without the stack
+  of the entry, exit, doit, guard and action methods. Only the x86-64 GCC -O0 default is measured,
+  the MSVC and AVR defaults are guesses. The stack depends on the compiler, its flags and the target:
+  define it before tsm.h is included with the figure measured for your toolchain (see DispatchStackTest).
+*/
+#if !defined(TSM_LEVEL_STACK_ESTIMATE)
+#if defined(__AVR__)
+// Guessed, not measured.
+#define TSM_LEVEL_STACK_ESTIMATE 64
+#elif defined(_MSC_VER)
+// Guessed for debug builds, not measured.
+#define TSM_LEVEL_STACK_ESTIMATE 2048
+#else
+// Measured on x86-64 with GCC at -O0.
+#define TSM_LEVEL_STACK_ESTIMATE 1024
+#endif
+#endif
+
+namespace tsmlib {
+
+namespace impl {
+
+typedef char (&TraitsYes)[1];
+typedef char (&TraitsNo)[2];
+
+// An id per type, only used to compare types at run time.
+template<class T>
+struct TypeTag {
+  static const char id;
+};
+template<class T> const char TypeTag<T>::id = 0;
+
+// States derived from SubstatesHolderState have a nested state machine.
+template<class S>
+struct IsSubstatesHolder {
+private:
+  template<class U> static TraitsYes check(typename U::SubstatemachineType*);
+  template<class U> static TraitsNo check(...);
+
+public:
+  enum { value = sizeof(check<S>(0)) == sizeof(TraitsYes) };
+};
+
+// EmptyState and AnyState are never the active state of a state machine.
+template<class S>
+struct IsPseudoState {
+  enum { value = false };
+};
+template<class T>
+struct IsPseudoState< EmptyState<T> > {
+  enum { value = true };
+};
+template<class T>
+struct IsPseudoState< AnyState<T> > {
+  enum { value = true };
+};
+
+template<class S>
+struct IsEmptyState {
+  enum { value = false };
+};
+template<class T>
+struct IsEmptyState< EmptyState<T> > {
+  enum { value = true };
+};
+
+// Same rule as State::typeOf: AnyState matches every state, but only for singletons compared by memory address.
+template<class From, class S>
+struct MatchesState {
+  enum { value = is_same<From, S>::value };
+};
+template<class S>
+struct MatchesState<AnyState< State<MemoryAddressComparator, true> >, S> {
+  enum { value = true };
+};
+
+template<class TList, class S>
+struct AppendState {
+  typedef typename LokiLight::Select<
+    IsPseudoState<S>::value,
+    TList,
+    typename LokiLight::Append<TList, S>::Result>::Result Result;
+};
+
+/**
+  The states a transition leaves or enters on the level of its state machine.
+  The targets of exiting transitions are on a higher level and not part of the result.
+*/
+template<class Transition>
+struct TransitionStates {
+  typedef typename AppendState<LokiLight::NullType, typename Transition::FromType::ObjectType>::Result Result;
+  enum { Terminates = false };
+};
+
+template<class Event, class To, class From, class Guard, class Action, bool E, bool X, bool R, bool D>
+struct TransitionStates< TransitionBase<Event, To, From, Guard, Action, E, X, R, D> > {
+private:
+  typedef typename AppendState<LokiLight::NullType, typename From::ObjectType>::Result L1;
+
+public:
+  typedef typename LokiLight::Select<X, L1, typename AppendState<L1, typename To::ObjectType>::Result>::Result Result;
+  enum { Terminates = !X && IsEmptyState<To>::value };
+};
+
+template<class Event, class To_true, class To_false, class From, class Guard, class Action, bool X>
+struct TransitionStates< ChoiceTransitionBase<Event, To_true, To_false, From, Guard, Action, X> > {
+private:
+  typedef typename AppendState<LokiLight::NullType, typename From::ObjectType>::Result L1;
+  typedef typename AppendState<L1, typename To_true::ObjectType>::Result L2;
+  typedef typename AppendState<L2, typename To_false::ObjectType>::Result L3;
+
+public:
+  typedef typename LokiLight::Select<X, L1, L3>::Result Result;
+  enum { Terminates = !X && (IsEmptyState<To_true>::value || IsEmptyState<To_false>::value) };
+};
+
+template<class Event, class To1, class To2, class To_false, class From, class Guard1, class Guard2, class Action, bool X>
+struct TransitionStates< Choice2TransitionBase<Event, To1, To2, To_false, From, Guard1, Guard2, Action, X> > {
+private:
+  typedef typename AppendState<LokiLight::NullType, typename From::ObjectType>::Result L1;
+  typedef typename AppendState<L1, typename To1::ObjectType>::Result L2;
+  typedef typename AppendState<L2, typename To2::ObjectType>::Result L3;
+  typedef typename AppendState<L3, typename To_false::ObjectType>::Result L4;
+
+public:
+  typedef typename LokiLight::Select<X, L1, L4>::Result Result;
+  enum { Terminates = !X && (IsEmptyState<To1>::value || IsEmptyState<To2>::value || IsEmptyState<To_false>::value) };
+};
+
+template<class Event, class From, class Guard, class Action>
+struct TransitionStates< FinalTransitionExplicit<Event, From, Guard, Action> > {
+  typedef typename AppendState<LokiLight::NullType, typename From::ObjectType>::Result Result;
+  enum { Terminates = true };
+};
+
+template<class Event, class To1, class To2, class From, class Guard1>
+struct TransitionStates< Exit2Declaration<Event, To1, To2, From, Guard1> > {
+private:
+  typedef typename AppendState<LokiLight::NullType, typename From::ObjectType>::Result L1;
+  typedef typename AppendState<L1, typename To1::ObjectType>::Result L2;
+
+public:
+  typedef typename AppendState<L2, typename To2::ObjectType>::Result Result;
+  enum { Terminates = IsEmptyState<To1>::value || IsEmptyState<To2>::value };
+};
+
+template<class T>
+struct TransitionStates< LikelyTransition<T> > : TransitionStates<T> {};
+
+template<class Transitions>
+struct CollectStates;
+template<>
+struct CollectStates<LokiLight::NullType> {
+  typedef LokiLight::NullType Result;
+  enum { Terminates = false };
+};
+template<class Head, class Tail>
+struct CollectStates< LokiLight::Typelist<Head, Tail> > {
+  typedef typename LokiLight::Append<
+    typename TransitionStates<Head>::Result,
+    typename CollectStates<Tail>::Result>::Result Result;
+  enum { Terminates = TransitionStates<Head>::Terminates || CollectStates<Tail>::Terminates };
+};
+
+/**
+  The states of one level of a state machine, without the states of nested state machines.
+  The target of the initial transition comes first.
+*/
+template<class Sm>
+struct StatesOf {
+private:
+  typedef typename Sm::InitialtransitionType::ToType::ObjectType Initial;
+  typedef typename LokiLight::Append<
+    typename AppendState<LokiLight::NullType, Initial>::Result,
+    typename CollectStates<typename Sm::TransitionsType>::Result>::Result AllStates;
+
+public:
+  typedef typename LokiLight::NoDuplicates<AllStates>::Result Result;
+  // A transition to the EmptyState leaves the state machine without active state.
+  enum { Terminates = CollectStates<typename Sm::TransitionsType>::Terminates };
+};
+
+// The states entered when S is entered: S followed by the initial states of the nested state machines.
+template<class S, bool Holder = IsSubstatesHolder<S>::value>
+struct InitialPath {
+  typedef LokiLight::Typelist<S, LokiLight::NullType> Result;
+};
+template<class S>
+struct InitialPath<S, true> {
+private:
+  typedef typename S::SubstatemachineType::InitialtransitionType::ToType::ObjectType Initial;
+
+public:
+  typedef LokiLight::Typelist<S, typename InitialPath<Initial>::Result> Result;
+};
+
+/**
+  Finds the transition the EventDispatcher executes for Event when S is the active state, at compile time.
+  The EventDispatcher searches from the back of the list, the result is therefore the last match or NullType.
+*/
+template<class Transitions, class Event, class S>
+struct ResolveTransition;
+template<class Event, class S>
+struct ResolveTransition<LokiLight::NullType, Event, S> {
+  typedef LokiLight::NullType Result;
+};
+template<class Head, class Tail, class Event, class S>
+struct ResolveTransition<LokiLight::Typelist<Head, Tail>, Event, S> {
+private:
+  typedef typename ResolveTransition<Tail, Event, S>::Result Later;
+  enum { HeadMatches = is_same<typename Head::EventType, Event>::value && MatchesState<typename Head::FromType::ObjectType, S>::value };
+
+public:
+  typedef typename LokiLight::Select<
+    !is_same<Later, LokiLight::NullType>::value,
+    Later,
+    typename LokiLight::Select<HeadMatches, Head, LokiLight::NullType>::Result>::Result Result;
+};
+
+// All states of Sm and of its nested state machines.
+template<class Sm>
+struct AllStatesOf;
+
+template<class States>
+struct AllStatesOfList;
+template<>
+struct AllStatesOfList<LokiLight::NullType> {
+  typedef LokiLight::NullType Result;
+};
+template<class S, class Tail, bool Holder = IsSubstatesHolder<S>::value>
+struct AllStatesOfState {
+  typedef LokiLight::Typelist<S, LokiLight::NullType> Result;
+};
+template<class S, class Tail>
+struct AllStatesOfState<S, Tail, true> {
+  typedef LokiLight::Typelist<S, typename AllStatesOf<typename S::SubstatemachineType>::Result> Result;
+};
+template<class S, class Tail>
+struct AllStatesOfList< LokiLight::Typelist<S, Tail> > {
+  typedef typename LokiLight::Append<
+    typename AllStatesOfState<S, Tail>::Result,
+    typename AllStatesOfList<Tail>::Result>::Result Result;
+};
+
+template<class Sm>
+struct AllStatesOf {
+  typedef typename LokiLight::NoDuplicates<typename AllStatesOfList<typename StatesOf<Sm>::Result>::Result>::Result Result;
+};
+
+enum { NoStateIndex = 0xFF };
+
+// Index of the active state in States, found at runtime with typeOf. NoStateIndex if it is not in States.
+template<class States, uint8_t Index = 0>
+struct StateIndex;
+template<uint8_t Index>
+struct StateIndex<LokiLight::NullType, Index> {
+  template<class StatePolicy>
+  static uint8_t of(StatePolicy*) {
+    return NoStateIndex;
+  }
+};
+template<class S, class Tail, uint8_t Index>
+struct StateIndex<LokiLight::Typelist<S, Tail>, Index> {
+  template<class StatePolicy>
+  static uint8_t of(StatePolicy* activeState) {
+    if (activeState->template typeOf<S>()) return Index;
+    return StateIndex<Tail, Index + 1>::of(activeState);
+  }
+};
+
+template<uint8_t... I>
+struct IndexSequence {};
+
+template<uint8_t N, uint8_t... I>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, I...> {};
+template<uint8_t... I>
+struct MakeIndexSequence<0, I...> {
+  typedef IndexSequence<I...> Result;
+};
+
+// Sm followed by the nested state machines of all levels.
+template<class States>
+struct NestedStatemachines;
+template<>
+struct NestedStatemachines<LokiLight::NullType> {
+  typedef LokiLight::NullType Result;
+};
+template<class S, class Tail, bool Holder = IsSubstatesHolder<S>::value>
+struct NestedStatemachinesOf {
+  typedef typename NestedStatemachines<Tail>::Result Result;
+};
+template<class S, class Tail>
+struct NestedStatemachinesOf<S, Tail, true> {
+  typedef LokiLight::Typelist<typename S::SubstatemachineType, typename NestedStatemachines<Tail>::Result> Result;
+};
+template<class S, class Tail>
+struct NestedStatemachines< LokiLight::Typelist<S, Tail> > : NestedStatemachinesOf<S, Tail> {};
+template<class Sm>
+struct StatemachinesOf {
+  typedef typename LokiLight::NoDuplicates<
+    LokiLight::Typelist<Sm, typename NestedStatemachines<typename AllStatesOf<Sm>::Result>::Result> >::Result Result;
+};
+
+template<class Statemachines>
+struct CountTransitions;
+template<>
+struct CountTransitions<LokiLight::NullType> {
+  enum { value = 0 };
+};
+template<class Sm, class Tail>
+struct CountTransitions< LokiLight::Typelist<Sm, Tail> > {
+  enum { value = LokiLight::Length<typename Sm::TransitionsType>::value + CountTransitions<Tail>::value };
+};
+
+template<class Transitions>
+struct EventsOfTransitions;
+template<>
+struct EventsOfTransitions<LokiLight::NullType> {
+  typedef LokiLight::NullType Result;
+};
+template<class Head, class Tail>
+struct EventsOfTransitions< LokiLight::Typelist<Head, Tail> > {
+  typedef LokiLight::Typelist<typename Head::EventType, typename EventsOfTransitions<Tail>::Result> Result;
+};
+
+template<class Statemachines>
+struct EventsOfStatemachines;
+template<>
+struct EventsOfStatemachines<LokiLight::NullType> {
+  typedef LokiLight::NullType Result;
+};
+template<class Sm, class Tail>
+struct EventsOfStatemachines< LokiLight::Typelist<Sm, Tail> > {
+  typedef typename LokiLight::Append<
+    typename EventsOfTransitions<typename Sm::TransitionsType>::Result,
+    typename EventsOfStatemachines<Tail>::Result>::Result Result;
+};
+
+// 1 for a state machine without nested state machines.
+template<class Sm>
+struct NestingDepth;
+template<class States>
+struct MaxNestingDepth;
+template<>
+struct MaxNestingDepth<LokiLight::NullType> {
+  enum { value = 0 };
+};
+template<class S, bool Holder = IsSubstatesHolder<S>::value>
+struct StateNestingDepth {
+  enum { value = 0 };
+};
+template<class S>
+struct StateNestingDepth<S, true> {
+  enum { value = NestingDepth<typename S::SubstatemachineType>::value };
+};
+template<class S, class Tail>
+struct MaxNestingDepth< LokiLight::Typelist<S, Tail> > {
+  enum {
+    value = (int)StateNestingDepth<S>::value > (int)MaxNestingDepth<Tail>::value
+      ? (int)StateNestingDepth<S>::value : (int)MaxNestingDepth<Tail>::value
+  };
+};
+template<class Sm>
+struct NestingDepth {
+  enum { value = 1 + MaxNestingDepth<typename StatesOf<Sm>::Result>::value };
+};
+
+// Size of the static objects of the states created by a SingletonCreator.
+template<class States>
+struct SingletonStatesSize;
+template<>
+struct SingletonStatesSize<LokiLight::NullType> {
+  enum { value = 0 };
+};
+template<class S, class Tail>
+struct SingletonStatesSize< LokiLight::Typelist<S, Tail> > {
+  enum {
+    value = (is_same<typename S::CreatorType, SingletonCreator<S> >::value ? sizeof(S) : 0)
+      + SingletonStatesSize<Tail>::value
+  };
+};
+}
+
+/**
+  Compile time figures of a state machine type, including its nested state machines.
+  - NumberOfStates: distinct states of all levels, without EmptyState and AnyState.
+  - NumberOfTransitions: entries of the transition lists of all levels (declarations included), without initial transitions.
+  - NumberOfEvents: distinct event types of the transitions.
+  - NestingDepth: 1 without nested state machines.
+  - SingletonRam: static RAM of the states created by a SingletonCreator. Nested state machines are part of their holder.
+  - InstanceRam: RAM of one instance of Sm.
+  - Ram: both together. States created by a FactoryCreator are allocated while active and not counted.
+  - DispatchStackEstimate: bytes of stack of a dispatch, begin or end: TSM_LEVEL_STACK_ESTIMATE for each level
+    and one byte for each transition. The stack of the entry, exit, doit, guard and action methods comes on
+    top. Only a bound with TSM_LEVEL_STACK_ESTIMATE measured for the toolchain.
+*/
+template<class Sm>
+struct MachineTraits {
+private:
+  typedef typename impl::AllStatesOf<Sm>::Result States;
+  typedef typename impl::StatemachinesOf<Sm>::Result Statemachines;
+  typedef typename LokiLight::NoDuplicates<typename impl::EventsOfStatemachines<Statemachines>::Result>::Result Events;
+
+public:
+  enum : size_t {
+    NumberOfStates = LokiLight::Length<States>::value,
+    NumberOfTransitions = impl::CountTransitions<Statemachines>::value,
+    NumberOfEvents = LokiLight::Length<Events>::value,
+    NestingDepth = impl::NestingDepth<Sm>::value,
+    SingletonRam = impl::SingletonStatesSize<States>::value,
+    InstanceRam = sizeof(Sm),
+    Ram = SingletonRam + InstanceRam,
+    DispatchStackEstimate = NestingDepth * TSM_LEVEL_STACK_ESTIMATE + NumberOfTransitions
+  };
+};
+
+/**
+  For static_assert(FitsRamBudget<Sm, 64>::value, "..."): true if MachineTraits<Sm>::Ram is at most Bytes.
+  Exceeded is the number of bytes above the budget.
+*/
+template<class Sm, size_t Bytes>
+struct FitsRamBudget {
+  enum : size_t {
+    value = (size_t)MachineTraits<Sm>::Ram <= Bytes,
+    Exceeded = (size_t)MachineTraits<Sm>::Ram > Bytes ? (size_t)MachineTraits<Sm>::Ram - Bytes : 0
+  };
+};
+}
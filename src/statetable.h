@@ -0,0 +1,235 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: publishes the active states of many state machines into a table that other processes can read.
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "tsm.h"
+
+namespace tsmlib {
+
+/**
+  One slot per state machine. The sequence is odd while the slot is written and
+  is incremented by two for each published state (seqlock).
+*/
+struct StateSlot {
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint8_t> state;
+  uint8_t reserved[3];
+};
+static_assert(sizeof(StateSlot) == 8, "StateSlot is part of the shared layout");
+
+struct StateTableHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slots;
+  uint32_t reserved;
+};
+
+/**
+  Layout of the table in a memory region: the header followed by the slots.
+  The region is provided by the caller, e.g. mapped by SharedStateTable.
+*/
+class StateTable {
+public:
+  enum : uint32_t { Magic = 0x74736d53, Version = 1 };
+
+  static size_t bytesFor(uint32_t slots) {
+    return sizeof(StateTableHeader) + slots * sizeof(StateSlot);
+  }
+
+  // Writes the header and marks all slots as without active state.
+  bool format(void* region, size_t size, uint32_t slots) {
+    if (region == nullptr || size < bytesFor(slots)) return false;
+
+    StateTableHeader* header = static_cast<StateTableHeader*>(region);
+    header->magic = Magic;
+    header->version = Version;
+    header->slots = slots;
+    header->reserved = 0;
+
+    header_ = header;
+    for (uint32_t n = 0; n < slots; n++) {
+      StateSlot& s = slot(n);
+      s.sequence.store(0, std::memory_order_relaxed);
+      s.state.store(impl::NoStateIndex, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+  }
+
+  // Uses a region formatted by another StateTable.
+  bool attach(void* region, size_t size) {
+    if (region == nullptr || size < sizeof(StateTableHeader)) return false;
+
+    StateTableHeader* header = static_cast<StateTableHeader*>(region);
+    if (header->magic != Magic || header->version != Version || size < bytesFor(header->slots)) return false;
+
+    header_ = header;
+    return true;
+  }
+
+  uint32_t size() const {
+    return header_ != nullptr ? header_->slots : 0;
+  }
+
+  StateSlot& slot(uint32_t n) const {
+    return reinterpret_cast<StateSlot*>(header_ + 1)[n];
+  }
+
+private:
+  StateTableHeader* header_ = nullptr;
+};
+
+/**
+  Observer for Statemachine that publishes into one slot. Each slot must have a single writer.
+*/
+class StateTableObserver {
+public:
+  void attach(StateSlot* slot) {
+    slot_ = slot;
+  }
+
+  void publish(uint8_t state) {
+    if (slot_ == nullptr) return;
+
+    const uint32_t sequence = slot_->sequence.load(std::memory_order_relaxed);
+    slot_->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot_->state.store(state, std::memory_order_relaxed);
+    slot_->sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+private:
+  StateSlot* slot_ = nullptr;
+};
+
+// Reads a consistent pair of state and sequence. Returns false while the slot is written.
+inline bool readSlot(const StateSlot& slot, uint8_t& state, uint32_t& sequence) {
+  const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+  if (before & 1) return false;
+
+  state = slot.state.load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  sequence = slot.sequence.load(std::memory_order_relaxed);
+  return sequence == before;
+}
+
+/**
+  Number of state machines per state index; impl::NoStateIndex counts the slots without active state.
+  The slots are read sequentially, a slot being written is read again up to Retries times. A slot that stays
+  odd, e.g. because its writer died while publishing, is counted in inFlux instead of a state.
+*/
+struct StateHistogram {
+  enum { Retries = 1000 };
+
+  uint32_t counts[256];
+  uint32_t inFlux;
+
+  void scan(const StateTable& table) {
+    for (int n = 0; n < 256; n++) {
+      counts[n] = 0;
+    }
+    inFlux = 0;
+
+    const uint32_t size = table.size();
+    for (uint32_t n = 0; n < size; n++) {
+      uint8_t state;
+      uint32_t sequence;
+      int retries = Retries;
+      while (!readSlot(table.slot(n), state, sequence) && --retries > 0) {}
+      if (retries > 0) counts[state]++;
+      else inFlux++;
+    }
+  }
+};
+
+#if defined(__unix__) || defined(__APPLE__)
+/**
+  StateTable in a shared file mapping. The owner creates and formats the file, observers open it read-only.
+  Not copyable, the mapping is unmapped once.
+*/
+class SharedStateTable {
+public:
+  SharedStateTable() = default;
+  SharedStateTable(const SharedStateTable&) = delete;
+  SharedStateTable& operator=(const SharedStateTable&) = delete;
+
+  ~SharedStateTable() {
+    close();
+  }
+
+  bool create(const char* path, uint32_t slots) {
+    close();
+    const size_t size = StateTable::bytesFor(slots);
+    const int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    const bool sized = ftruncate(fd, (off_t)size) == 0;
+    void* region = sized ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (region == MAP_FAILED) return false;
+
+    region_ = region;
+    size_ = size;
+    return table_.format(region_, size_, slots);
+  }
+
+  bool open(const char* path) {
+    close();
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    const bool found = fstat(fd, &info) == 0;
+    void* region = found ? mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (region == MAP_FAILED) return false;
+
+    region_ = region;
+    size_ = (size_t)info.st_size;
+    return table_.attach(region_, size_);
+  }
+
+  void close() {
+    if (region_ != nullptr) {
+      munmap(region_, size_);
+      region_ = nullptr;
+      size_ = 0;
+    }
+    table_ = StateTable();
+  }
+
+  StateTable& table() {
+    return table_;
+  }
+
+private:
+  StateTable table_;
+  void* region_ = nullptr;
+  size_t size_ = 0;
+};
+#endif
+}
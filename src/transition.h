@@ -73,6 +73,32 @@ struct NoGuard {
 
 namespace impl {
 
+/**
+  Changes the active state from From to To: exits and destroys From unless Exits is false, creates and enters To
+  and calls the basic doit of To. DestroyFirst destroys From before To is created. Destroys with Exits false
+  destroys From that the caller has exited already.
+*/
+template<class From, class To, class Event, bool Exits, bool DestroyFirst, bool Destroys = Exits>
+struct ChangeState {
+  using StatePolicy = typename To::Policy;
+
+  static DispatchResult<StatePolicy> execute(StatePolicy* from, const Event& ev) {
+    if (Exits) {
+      static_cast<From*>(from)->template _exit<Event>(ev);
+      if (DestroyFirst) From::CreatorType::destroy(static_cast<From*>(from));
+    }
+
+    To* toState = To::CreatorType::create();
+    toState->template _entry<Event>(ev);
+    if (To::BasicDoit) {
+      toState->template _doit<Event>(ev);
+    }
+
+    if (Destroys && !(Exits && DestroyFirst)) From::CreatorType::destroy(static_cast<From*>(from));
+    return DispatchResult<StatePolicy>(true, toState);
+  }
+};
+
 template<
   class Event,
   typename To,
@@ -92,6 +118,8 @@ struct TransitionBase {
   using EventType = Event;
   using ToType = To;
   using FromType = From;
+  using GuardType = Guard;
+  using ActionType = Action;
   using StatePolicy = typename From::Policy;
 
   TransitionBase() {
@@ -99,8 +127,6 @@ struct TransitionBase {
   }
 
   DispatchResult<StatePolicy> dispatch(StatePolicy* activeState, const Event& ev) {
-    using FromFactory = typename From::CreatorType;
-
     // Ignore the transition if the active state is null.
     if (activeState == nullptr) {
       return DispatchResult<StatePolicy>(false, activeState);
@@ -108,14 +134,7 @@ struct TransitionBase {
 
     // Entering substate transition
     if (E) {
-      using ToFactory = typename To::CreatorType;
-      To* toState = ToFactory::create();
-      toState->template _entry<EventType>(ev);
-      if (To::BasicDoit) {
-        toState->_doit(ev);
-      }
-
-      return DispatchResult<StatePolicy>(true, toState);
+      return ChangeState<From, To, EventType, false, false>::execute(activeState, ev);
     }
 
     FromType* fromState = static_cast<FromType*>(activeState);
@@ -142,16 +161,7 @@ struct TransitionBase {
           return DispatchResult<StatePolicy>(true, activeState);
         }
 
-        static_cast<From*>(activeState)->template _exit<EventType>(ev);
-
-        using ToFactory = typename To::CreatorType;
-        To* toState = ToFactory::create();
-        toState->template _entry<EventType>(ev);
-        if (To::BasicDoit) {
-          toState->template _doit<EventType>(ev);
-        }
-        FromFactory::destroy(static_cast<From*>(activeState));
-        return DispatchResult<StatePolicy>(true, toState);
+        return ChangeState<From, To, EventType, true, false>::execute(activeState, ev);
       }
       return DispatchResult<StatePolicy>(consumed, activeState);
     }
@@ -160,21 +170,17 @@ struct TransitionBase {
       return DispatchResult<StatePolicy>(false, activeState);
     }
 
-    static_cast<From*>(activeState)->template _exit<EventType>(ev);
-
-    using ToFactory = typename To::CreatorType;
-    To* toState = ToFactory::create();
-    toState->template _entry<EventType>(ev);
-
-    if (To::BasicDoit) {
-      toState->_doit(ev);
-    }
-    FromFactory::destroy(static_cast<From*>(activeState));
-    return DispatchResult<StatePolicy>(true, toState);
+    return ChangeState<From, To, EventType, true, false>::execute(activeState, ev);
   }
 };
 }
 
+namespace impl {
+// A transition that is usually taken when its event is dispatched (see ProfiledTransitions).
+template<class T>
+struct LikelyTransition : T {};
+}
+
 template<class Event, typename Me, typename Guard, typename Action, bool Reenter>
 using SelfTransition = impl::TransitionBase<Event, Me, Me, Guard, Action, false, false, Reenter>;
 
@@ -0,0 +1,272 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "tsm.h"
+
+/*
+  Profile guided ordering of the transitions.
+
+  The EventDispatcher tests the transitions from the last to the first one. With many transitions
+  for the same event, the frequent ones should therefore be at the end of the list.
+
+  1. Build with TSM_RECORD_TRANSITIONS, which counts how often each transition is taken, and run a
+     typical workload. Then call writeTransitionProfile<Transitions>("profile.h", "MyProfile").
+  2. Build without TSM_RECORD_TRANSITIONS, include the generated header and use
+     ProfiledTransitions<Transitions, MyProfile>::Result as the transitions of the Statemachine.
+
+  The order only changes between transitions of different events, or of different From states that
+  are not AnyState, so the dispatch result stays the same. end() takes the last exiting transition of
+  the active state whatever its event, and _begin the last entering transition of the event, so their
+  order is kept as well. The most frequent transition of an event
+  is marked as likely if it takes more than half of the event's hits. A profile that moves two of
+  these transitions past each other, e.g. one written for other transitions, does not compile.
+*/
+
+namespace tsmlib {
+
+// Declare the tag of a profile with struct MyProfile; the generated header specializes TransitionProfile for it.
+template<class Tag>
+struct TransitionProfile {
+  enum { Recorded = false, NumberOfTransitions = 0 };
+  typedef impl::IndexSequence<> Order;
+  typedef impl::IndexSequence<> Likely;
+};
+
+namespace impl {
+
+template<uint8_t Index, class Indices>
+struct ContainsIndex;
+template<uint8_t Index>
+struct ContainsIndex<Index, IndexSequence<> > {
+  enum { value = false };
+};
+template<uint8_t Index, uint8_t Head, uint8_t... Tail>
+struct ContainsIndex<Index, IndexSequence<Head, Tail...> > {
+  enum { value = Index == Head || ContainsIndex<Index, IndexSequence<Tail...> >::value };
+};
+
+template<class Transitions, class Likely, class Order>
+struct ReorderTransitions;
+template<class Transitions, class Likely>
+struct ReorderTransitions<Transitions, Likely, IndexSequence<> > {
+  typedef LokiLight::NullType Result;
+};
+template<class Transitions, class Likely, uint8_t I, uint8_t... Tail>
+struct ReorderTransitions<Transitions, Likely, IndexSequence<I, Tail...> > {
+  typedef LokiLight::Typelist<
+    typename LokiLight::Select<
+      ContainsIndex<I, Likely>::value,
+      LikelyTransition<typename LokiLight::TypeAt<Transitions, I>::Result>,
+      typename LokiLight::TypeAt<Transitions, I>::Result>::Result,
+    typename ReorderTransitions<Transitions, Likely, IndexSequence<Tail...> >::Result> Result;
+};
+
+// Exiting transitions, final transitions and exit declarations.
+template<class T>
+struct ExitsLevel {
+  enum { value = T::X };
+};
+template<class Event, class To, class From, class Guard, class Action, bool E, bool X, bool R, bool D>
+struct ExitsLevel< TransitionBase<Event, To, From, Guard, Action, E, X, R, D> > {
+  enum { value = X || D };
+};
+
+// Transitions that the dispatcher, the Finalizer (end) or the Initializer (_begin) must keep in their order.
+template<class A, class B>
+struct ConflictingTransitions {
+  using FromA = typename A::FromType::ObjectType;
+  using FromB = typename B::FromType::ObjectType;
+  enum {
+    sameFrom = is_same<FromA, FromB>::value || IsPseudoState<FromA>::value || IsPseudoState<FromB>::value,
+    sameEvent = is_same<typename A::EventType, typename B::EventType>::value
+  };
+  enum {
+    value = (ExitsLevel<A>::value && ExitsLevel<B>::value && sameFrom) || (A::E && B::E && sameEvent)
+      || (sameEvent && sameFrom)
+  };
+};
+
+// True if no transition in Order comes before one that it conflicts with and that it follows in Transitions.
+template<class Transitions, uint8_t I, class Later>
+struct KeepsOrderBefore;
+template<class Transitions, uint8_t I>
+struct KeepsOrderBefore<Transitions, I, IndexSequence<> > {
+  enum { value = true };
+};
+template<class Transitions, uint8_t I, uint8_t J, uint8_t... Tail>
+struct KeepsOrderBefore<Transitions, I, IndexSequence<J, Tail...> > {
+  enum {
+    value = !(J < I && ConflictingTransitions<
+        typename LokiLight::TypeAt<Transitions, I>::Result,
+        typename LokiLight::TypeAt<Transitions, J>::Result>::value)
+      && KeepsOrderBefore<Transitions, I, IndexSequence<Tail...> >::value
+  };
+};
+
+template<class Transitions, class Order>
+struct KeepsConflictingOrder;
+template<class Transitions>
+struct KeepsConflictingOrder<Transitions, IndexSequence<> > {
+  enum { value = true };
+};
+template<class Transitions, uint8_t I, uint8_t... Tail>
+struct KeepsConflictingOrder<Transitions, IndexSequence<I, Tail...> > {
+  enum {
+    value = KeepsOrderBefore<Transitions, I, IndexSequence<Tail...> >::value
+      && KeepsConflictingOrder<Transitions, IndexSequence<Tail...> >::value
+  };
+};
+
+template<class Transitions, class Profile, bool Recorded = Profile::Recorded>
+struct ApplyProfile {
+  typedef Transitions Result;
+};
+template<class Transitions, class Profile>
+struct ApplyProfile<Transitions, Profile, true> {
+  static_assert((int)Profile::NumberOfTransitions == (int)LokiLight::Length<Transitions>::value,
+    "The transitions changed since the profile was written, record it again.");
+  static_assert(KeepsConflictingOrder<Transitions, typename Profile::Order>::value,
+    "The profile changes which transition is taken, the transitions changed since it was written: record it again.");
+
+  typedef typename ReorderTransitions<Transitions, typename Profile::Likely, typename Profile::Order>::Result Result;
+};
+}
+
+/**
+  The transitions in the order of the profile Tag. Without a recorded profile, and while
+  recording (TSM_RECORD_TRANSITIONS), the transitions are not changed.
+*/
+template<class Transitions, class Tag>
+struct ProfiledTransitions {
+#if defined(TSM_RECORD_TRANSITIONS)
+  typedef Transitions Result;
+#else
+  typedef typename impl::ApplyProfile<Transitions, TransitionProfile<Tag> >::Result Result;
+#endif
+};
+}
+
+#if defined(TSM_RECORD_TRANSITIONS) && !defined(ARDUINO)
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace tsmlib {
+
+namespace impl {
+
+struct TransitionKey {
+  const void* event;
+  const void* from;
+  bool anyState;
+  bool enters;
+  bool exits;
+};
+
+template<class Transitions, class Indices>
+struct TransitionKeys;
+template<class Transitions, uint8_t... I>
+struct TransitionKeys<Transitions, IndexSequence<I...> > {
+  static std::vector<TransitionKey> get() {
+    // A From state is never the EmptyState, a pseudo state is the AnyState.
+    return {
+      TransitionKey{
+        &TypeTag<typename LokiLight::TypeAt<Transitions, I>::Result::EventType>::id,
+        &TypeTag<typename LokiLight::TypeAt<Transitions, I>::Result::FromType::ObjectType>::id,
+        IsPseudoState<typename LokiLight::TypeAt<Transitions, I>::Result::FromType::ObjectType>::value,
+        LokiLight::TypeAt<Transitions, I>::Result::E,
+        ExitsLevel<typename LokiLight::TypeAt<Transitions, I>::Result>::value }...
+    };
+  }
+};
+
+// Same as ConflictingTransitions.
+inline bool _conflict(const TransitionKey& a, const TransitionKey& b) {
+  const bool sameFrom = a.from == b.from || a.anyState || b.anyState;
+  if (a.exits && b.exits && sameFrom) return true;
+  if (a.enters && b.enters && a.event == b.event) return true;
+  return a.event == b.event && sameFrom;
+}
+}
+
+/**
+  Writes the transition hits recorded so far as a header with the TransitionProfile profileName.
+  The name may be qualified, e.g. "app::MyProfile": the header declares the tag in its namespace.
+  Returns false if the file cannot be written.
+*/
+template<class Transitions>
+bool writeTransitionProfile(const char* path, const char* profileName) {
+  enum { N = LokiLight::Length<Transitions>::value };
+  const uint32_t* hits = impl::TransitionHits<Transitions>::hits;
+  const std::vector<impl::TransitionKey> keys = impl::TransitionKeys<Transitions, typename impl::MakeIndexSequence<N>::Result>::get();
+
+  // Moves frequent transitions to the end, where the dispatcher starts.
+  std::vector<int> order;
+  for (int i = 0; i < N; i++) order.push_back(i);
+  for (bool swapped = true; swapped;) {
+    swapped = false;
+    for (int i = 0; i + 1 < N; i++) {
+      const int a = order[i];
+      const int b = order[i + 1];
+      if (hits[a] > hits[b] && !impl::_conflict(keys[a], keys[b])) {
+        order[i] = b;
+        order[i + 1] = a;
+        swapped = true;
+      }
+    }
+  }
+
+  std::vector<int> likely;
+  for (int i = 0; i < N; i++) {
+    uint64_t eventHits = 0;
+    bool top = hits[i] > 0;
+    for (int j = 0; j < N; j++) {
+      if (keys[j].event != keys[i].event) continue;
+      eventHits += hits[j];
+      top = top && (hits[j] < hits[i] || (hits[j] == hits[i] && j >= i));
+    }
+    if (top && 2 * (uint64_t)hits[i] > eventHits) likely.push_back(i);
+  }
+
+  FILE* file = fopen(path, "w");
+  if (file == nullptr) return false;
+  fprintf(file, "#pragma once\n// Generated by writeTransitionProfile.\n");
+  for (int i = 0; i < N; i++) fprintf(file, "// %3d: %lu hits\n", i, (unsigned long)hits[i]);
+  // The tag is declared in the namespaces of the qualified name.
+  std::vector<std::string> scopes;
+  std::string name = profileName;
+  for (size_t colons = name.find("::"); colons != std::string::npos; colons = name.find("::")) {
+    if (colons > 0) scopes.push_back(name.substr(0, colons));
+    name = name.substr(colons + 2);
+  }
+  fprintf(file, "\n");
+  for (const std::string& scope : scopes) fprintf(file, "namespace %s {\n", scope.c_str());
+  fprintf(file, "struct %s;\n", name.c_str());
+  for (size_t i = 0; i < scopes.size(); i++) fprintf(file, "}\n");
+  fprintf(file, "\nnamespace tsmlib {\ntemplate<>\nstruct TransitionProfile< ");
+  for (const std::string& scope : scopes) fprintf(file, "::%s", scope.c_str());
+  fprintf(file, "::%s> {\n", name.c_str());
+  fprintf(file, "  enum { Recorded = true, NumberOfTransitions = %d };\n  typedef impl::IndexSequence<", (int)N);
+  for (int i = 0; i < N; i++) fprintf(file, "%s%d", i == 0 ? "" : ", ", order[i]);
+  fprintf(file, "> Order;\n  typedef impl::IndexSequence<");
+  for (size_t i = 0; i < likely.size(); i++) fprintf(file, "%s%d", i == 0 ? "" : ", ", likely[i]);
+  fprintf(file, "> Likely;\n};\n}\n");
+  return fclose(file) == 0;
+}
+}
+
+#endif
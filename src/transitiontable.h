@@ -0,0 +1,437 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "tsm.h"
+
+namespace tsmlib {
+
+enum TransitionKind : uint8_t { NormalKind = 0, SelfKind = 1, ChoiceKind = 2, ExitKind = 3, FinalKind = 4, InitialKind = 5 };
+
+/**
+  One edge of the transition graph. Choice transitions have one entry per target, the last one
+  (the else branch) without guard. Exiting transitions go to a state of the level above.
+*/
+struct TransitionEntry {
+  enum : uint8_t { NoState = 0xff, NoEvent = 0xff };
+
+  uint8_t from;     // Index into the States of the TransitionTable, NoState for initial transitions.
+  uint8_t to;       // NoState for final transitions.
+  uint8_t event;    // Index into the Events of the TransitionTable, NoEvent for initial and final transitions.
+  uint8_t kind;     // TransitionKind
+  uint8_t machine;  // Index into the Statemachines of the TransitionTable.
+  bool guard;
+  bool action;
+};
+
+namespace impl {
+
+template<uint8_t From, uint8_t To, uint8_t Event, uint8_t Kind, uint8_t Machine, bool Guard, bool Action>
+struct TableEntry {
+  static constexpr TransitionEntry entry() {
+    return TransitionEntry{ From, To, Event, Kind, Machine, Guard, Action };
+  }
+};
+
+template<class States, class S, int Index = LokiLight::IndexOf<States, typename S::ObjectType>::Result>
+struct TableStateId {
+  enum : uint8_t { value = (uint8_t)Index };
+};
+template<class States, class S>
+struct TableStateId<States, S, -1> {
+  enum : uint8_t { value = TransitionEntry::NoState };
+};
+
+template<class Events, class Event, int Index = LokiLight::IndexOf<Events, Event>::Result>
+struct TableEventId {
+  enum : uint8_t { value = (uint8_t)Index };
+};
+template<class Events, class Event>
+struct TableEventId<Events, Event, -1> {
+  enum : uint8_t { value = TransitionEntry::NoEvent };
+};
+
+template<class T>
+struct IsUsed {
+  enum { value = true };
+};
+template<>
+struct IsUsed<NoGuard> {
+  enum { value = false };
+};
+template<>
+struct IsUsed<NoAction> {
+  enum { value = false };
+};
+
+// The entries of transition T of state machine number Machine.
+template<class T, class States, class Events, uint8_t Machine>
+struct TableEntriesOf;
+
+template<class Event, class To, class From, class Guard, class Action, bool E, bool X, bool R, bool D, class States, class Events, uint8_t Machine>
+struct TableEntriesOf<TransitionBase<Event, To, From, Guard, Action, E, X, R, D>, States, Events, Machine> {
+  enum : uint8_t {
+    Kind = X || D ? ExitKind
+      : IsEmptyState<To>::value ? FinalKind
+      : is_same<To, From>::value ? SelfKind
+      : NormalKind
+  };
+  typedef LokiLight::Typelist<
+    TableEntry<TableStateId<States, From>::value, TableStateId<States, To>::value, TableEventId<Events, Event>::value,
+      Kind, Machine, IsUsed<Guard>::value, IsUsed<Action>::value>,
+    LokiLight::NullType> Result;
+};
+
+template<class Event, class To_true, class To_false, class From, class Guard, class Action, bool X, class States, class Events, uint8_t Machine>
+struct TableEntriesOf<ChoiceTransitionBase<Event, To_true, To_false, From, Guard, Action, X>, States, Events, Machine> {
+  enum : uint8_t { From_ = TableStateId<States, From>::value, Event_ = TableEventId<Events, Event>::value };
+  typedef LokiLight::Typelist<
+    TableEntry<From_, TableStateId<States, To_true>::value, Event_, ChoiceKind, Machine, true, IsUsed<Action>::value>,
+    LokiLight::Typelist<
+    TableEntry<From_, TableStateId<States, To_false>::value, Event_, ChoiceKind, Machine, false, IsUsed<Action>::value>,
+    LokiLight::NullType> > Result;
+};
+
+template<class Event, class To1, class To2, class To_false, class From, class Guard1, class Guard2, class Action, bool X, class States, class Events, uint8_t Machine>
+struct TableEntriesOf<Choice2TransitionBase<Event, To1, To2, To_false, From, Guard1, Guard2, Action, X>, States, Events, Machine> {
+  enum : uint8_t { From_ = TableStateId<States, From>::value, Event_ = TableEventId<Events, Event>::value };
+  typedef LokiLight::Typelist<
+    TableEntry<From_, TableStateId<States, To1>::value, Event_, ChoiceKind, Machine, true, IsUsed<Action>::value>,
+    LokiLight::Typelist<
+    TableEntry<From_, TableStateId<States, To2>::value, Event_, ChoiceKind, Machine, true, IsUsed<Action>::value>,
+    LokiLight::Typelist<
+    TableEntry<From_, TableStateId<States, To_false>::value, Event_, ChoiceKind, Machine, false, IsUsed<Action>::value>,
+    LokiLight::NullType> > > Result;
+};
+
+template<class Event, class To1, class To2, class From, class Guard1, class States, class Events, uint8_t Machine>
+struct TableEntriesOf<Exit2Declaration<Event, To1, To2, From, Guard1>, States, Events, Machine> {
+  enum : uint8_t { From_ = TableStateId<States, From>::value, Event_ = TableEventId<Events, Event>::value };
+  typedef LokiLight::Typelist<
+    TableEntry<From_, TableStateId<States, To1>::value, Event_, ExitKind, Machine, true, false>,
+    LokiLight::Typelist<
+    TableEntry<From_, TableStateId<States, To2>::value, Event_, ExitKind, Machine, false, false>,
+    LokiLight::NullType> > Result;
+};
+
+template<class Me, class States, class Events, uint8_t Machine>
+struct TableEntriesOf<FinalTransition<Me>, States, Events, Machine> {
+  typedef LokiLight::Typelist<
+    TableEntry<TableStateId<States, Me>::value, TransitionEntry::NoState, TransitionEntry::NoEvent, FinalKind, Machine, false, false>,
+    LokiLight::NullType> Result;
+};
+
+template<class Event, class From, class Guard, class Action, class States, class Events, uint8_t Machine>
+struct TableEntriesOf<FinalTransitionExplicit<Event, From, Guard, Action>, States, Events, Machine>
+  : TableEntriesOf<TransitionBase<Event, EmptyState<typename From::Policy>, From, Guard, Action, false, false, false>, States, Events, Machine> {};
+
+template<class T, class States, class Events, uint8_t Machine>
+struct TableEntriesOf<LikelyTransition<T>, States, Events, Machine> : TableEntriesOf<T, States, Events, Machine> {};
+
+template<class To, class Action, class States, class Events, uint8_t Machine>
+struct TableEntriesOf<InitialTransition<To, Action>, States, Events, Machine> {
+  typedef LokiLight::Typelist<
+    TableEntry<TransitionEntry::NoState, TableStateId<States, To>::value, TransitionEntry::NoEvent, InitialKind, Machine, false, IsUsed<Action>::value>,
+    LokiLight::NullType> Result;
+};
+
+template<class Transitions, class States, class Events, uint8_t Machine>
+struct TableEntriesOfList;
+template<class States, class Events, uint8_t Machine>
+struct TableEntriesOfList<LokiLight::NullType, States, Events, Machine> {
+  typedef LokiLight::NullType Result;
+};
+template<class Head, class Tail, class States, class Events, uint8_t Machine>
+struct TableEntriesOfList<LokiLight::Typelist<Head, Tail>, States, Events, Machine> {
+  typedef typename LokiLight::Append<
+    typename TableEntriesOf<Head, States, Events, Machine>::Result,
+    typename TableEntriesOfList<Tail, States, Events, Machine>::Result>::Result Result;
+};
+
+// The initial transition of each state machine, followed by its transitions.
+template<class Statemachines, class States, class Events, uint8_t Machine = 0>
+struct TableEntries;
+template<class States, class Events, uint8_t Machine>
+struct TableEntries<LokiLight::NullType, States, Events, Machine> {
+  typedef LokiLight::NullType Result;
+};
+template<class Sm, class Tail, class States, class Events, uint8_t Machine>
+struct TableEntries<LokiLight::Typelist<Sm, Tail>, States, Events, Machine> {
+private:
+  typedef typename LokiLight::Append<
+    typename TableEntriesOf<typename Sm::InitialtransitionType, States, Events, Machine>::Result,
+    typename TableEntriesOfList<typename Sm::TransitionsType, States, Events, Machine>::Result>::Result Own;
+
+public:
+  typedef typename LokiLight::Append<Own, typename TableEntries<Tail, States, Events, Machine + 1>::Result>::Result Result;
+};
+
+// The state machine whose level has the state, and the nested state machine of a holder state.
+template<class Statemachines, class S, uint8_t Machine = 0>
+struct LevelOfState;
+template<class S, uint8_t Machine>
+struct LevelOfState<LokiLight::NullType, S, Machine> {
+  enum : uint8_t { value = 0xff };
+};
+template<class Sm, class Tail, class S, uint8_t Machine>
+struct LevelOfState<LokiLight::Typelist<Sm, Tail>, S, Machine> {
+  enum : uint8_t {
+    value = LokiLight::IndexOf<typename StatesOf<Sm>::Result, S>::Result != -1 ? Machine : (uint8_t)LevelOfState<Tail, S, Machine + 1>::value
+  };
+};
+
+template<class Statemachines, class S, bool Holder = IsSubstatesHolder<S>::value>
+struct NestedLevelOf {
+  enum : uint8_t { value = 0xff };
+};
+template<class Statemachines, class S>
+struct NestedLevelOf<Statemachines, S, true> {
+  enum : uint8_t { value = (uint8_t)LokiLight::IndexOf<Statemachines, typename S::SubstatemachineType>::Result };
+};
+
+template<class Statemachines, class States, class Entries, class EntryIndices, class StateIndices>
+struct TransitionTableData;
+template<class Statemachines, class States, class Entries, uint8_t... I, uint8_t... S>
+struct TransitionTableData<Statemachines, States, Entries, IndexSequence<I...>, IndexSequence<S...> > {
+  static constexpr TransitionEntry entries[sizeof...(I)] = {
+    LokiLight::TypeAt<Entries, I>::Result::entry()...
+  };
+  // Per state, the index of the state machine that has the state.
+  static constexpr uint8_t levels[sizeof...(S) + 1] = {
+    LevelOfState<Statemachines, typename LokiLight::TypeAt<States, S>::Result>::value..., 0xff
+  };
+  // Per state, the index of its nested state machine, 0xff if it is not a holder.
+  static constexpr uint8_t nested[sizeof...(S) + 1] = {
+    NestedLevelOf<Statemachines, typename LokiLight::TypeAt<States, S>::Result>::value..., 0xff
+  };
+};
+template<class Statemachines, class States, class Entries, uint8_t... I, uint8_t... S>
+constexpr TransitionEntry TransitionTableData<Statemachines, States, Entries, IndexSequence<I...>, IndexSequence<S...> >::entries[sizeof...(I)];
+template<class Statemachines, class States, class Entries, uint8_t... I, uint8_t... S>
+constexpr uint8_t TransitionTableData<Statemachines, States, Entries, IndexSequence<I...>, IndexSequence<S...> >::levels[sizeof...(S) + 1];
+template<class Statemachines, class States, class Entries, uint8_t... I, uint8_t... S>
+constexpr uint8_t TransitionTableData<Statemachines, States, Entries, IndexSequence<I...>, IndexSequence<S...> >::nested[sizeof...(S) + 1];
+
+template<class Sm>
+struct TransitionTableTypes {
+  typedef typename StatemachinesOf<Sm>::Result Statemachines;
+  typedef typename AllStatesOf<Sm>::Result States;
+  typedef typename LokiLight::Erase<
+    typename LokiLight::NoDuplicates<typename EventsOfStatemachines<Statemachines>::Result>::Result,
+    LokiLight::NullType>::Result Events;
+  typedef typename TableEntries<Statemachines, States, Events>::Result Entries;
+};
+}
+
+/**
+  The transition graph of Sm and its nested state machines as constexpr arrays, e.g. for tools
+  that draw or check the graph:
+  - entries: the TransitionEntry of each edge; per state machine (Statemachines, Sm first) the
+    initial transition followed by its transitions.
+  - levels: per state (States), the index of the state machine whose level has the state.
+  - nested: per state, the index of its nested state machine, 0xff if it has none.
+*/
+template<class Sm>
+struct TransitionTable : impl::TransitionTableData<
+  typename impl::TransitionTableTypes<Sm>::Statemachines,
+  typename impl::TransitionTableTypes<Sm>::States,
+  typename impl::TransitionTableTypes<Sm>::Entries,
+  typename impl::MakeIndexSequence<LokiLight::Length<typename impl::TransitionTableTypes<Sm>::Entries>::value>::Result,
+  typename impl::MakeIndexSequence<LokiLight::Length<typename impl::TransitionTableTypes<Sm>::States>::value>::Result> {
+
+  using Statemachines = typename impl::TransitionTableTypes<Sm>::Statemachines;
+  using States = typename impl::TransitionTableTypes<Sm>::States;
+  using Events = typename impl::TransitionTableTypes<Sm>::Events;
+
+  enum : size_t {
+    NumberOfEntries = LokiLight::Length<typename impl::TransitionTableTypes<Sm>::Entries>::value,
+    NumberOfStates = LokiLight::Length<States>::value,
+    NumberOfEvents = LokiLight::Length<Events>::value,
+    NumberOfStatemachines = LokiLight::Length<Statemachines>::value
+  };
+
+  static_assert(NumberOfEntries < 256 && NumberOfStates < 255 && NumberOfEvents < 255, "Ids are 8 bit");
+};
+}
+
+#if !defined(ARDUINO)
+
+#include <string>
+#include <typeinfo>
+#include <vector>
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#include <stdlib.h>
+#endif
+
+namespace tsmlib {
+
+/**
+  Name of a state or event in the name tables: the static member name if T has one, otherwise
+  the name of the type without its namespaces. Specialize for other names.
+*/
+template<class T>
+struct TypeName {
+private:
+  typedef char (&Yes)[1];
+  typedef char (&No)[2];
+  template<class U> static Yes check(decltype(&U::name));
+  template<class U> static No check(...);
+
+  static const char* _get(const LokiLight::Int2Type<true>&) {
+    return T::name;
+  }
+  static const char* _get(const LokiLight::Int2Type<false>&) {
+    static const std::string name = _demangle(typeid(T).name());
+    return name.c_str();
+  }
+
+  static std::string _demangle(const char* name) {
+    std::string result(name);
+#if defined(__GNUC__)
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (status == 0 && demangled != nullptr) {
+      result = demangled;
+      free(demangled);
+    }
+#endif
+    // MSVC prefixes with struct or class.
+    const size_t space = result.find(' ');
+    if (space != std::string::npos && result.find('<') == std::string::npos) result = result.substr(space + 1);
+    // Scopes of templates are kept, the arguments could have scopes too.
+    const size_t scope = result.rfind("::");
+    if (scope != std::string::npos && result.find('<') == std::string::npos) result = result.substr(scope + 2);
+    return result;
+  }
+
+public:
+  static const char* get() {
+    return _get(LokiLight::Int2Type<sizeof(check<T>(nullptr)) == sizeof(Yes)>());
+  }
+};
+
+namespace impl {
+
+template<class Types, class Indices>
+struct NameTable;
+template<class Types, uint8_t... I>
+struct NameTable<Types, IndexSequence<I...> > {
+  static const char* of(uint8_t index) {
+    static const char* const names[] = { TypeName<typename LokiLight::TypeAt<Types, I>::Result>::get()..., nullptr };
+    return index < sizeof...(I) ? names[index] : nullptr;
+  }
+};
+
+inline void _dotQuoted(std::string& dot, const char* text) {
+  dot += '"';
+  for (const char* c = text; *c != 0; c++) {
+    if (*c == '"' || *c == '\\') dot += '\\';
+    dot += *c;
+  }
+  dot += '"';
+}
+}
+
+// Name of the state with index id in TransitionTable<Sm>::States, nullptr if there is none.
+template<class Sm>
+const char* stateName(uint8_t id) {
+  using States = typename TransitionTable<Sm>::States;
+  return impl::NameTable<States, typename impl::MakeIndexSequence<LokiLight::Length<States>::value>::Result>::of(id);
+}
+
+// Name of the event with index id in TransitionTable<Sm>::Events, nullptr if there is none.
+template<class Sm>
+const char* eventName(uint8_t id) {
+  using Events = typename TransitionTable<Sm>::Events;
+  return impl::NameTable<Events, typename impl::MakeIndexSequence<LokiLight::Length<Events>::value>::Result>::of(id);
+}
+
+/**
+  The transition graph in the DOT language of Graphviz. Nested state machines are clusters named
+  after their holder state; a dashed edge leads from the holder to the initial transition.
+  Transitions from AnyState start at a node labelled "any" of their state machine.
+  stateAttributes are added to the node of the state with the same id, e.g. a fill color.
+*/
+template<class Sm>
+std::string toDot(const std::vector<std::string>& stateAttributes = std::vector<std::string>()) {
+  using Table = TransitionTable<Sm>;
+  std::string dot = "digraph statemachine {\n  node [shape=box, style=rounded];\n";
+
+  for (size_t machine = 0; machine < Table::NumberOfStatemachines; machine++) {
+    const std::string indent = machine == 0 ? "  " : "    ";
+    uint8_t holder = TransitionEntry::NoState;
+    for (uint8_t s = 0; s < Table::NumberOfStates; s++) {
+      if (Table::nested[s] == machine) holder = s;
+    }
+    if (machine > 0) {
+      dot += "  subgraph cluster_m" + std::to_string(machine) + " {\n    label=";
+      impl::_dotQuoted(dot, holder != TransitionEntry::NoState ? stateName<Sm>(holder) : "");
+      dot += ";\n";
+    }
+    dot += indent + "i" + std::to_string(machine) + " [shape=point];\n";
+    for (uint8_t s = 0; s < Table::NumberOfStates; s++) {
+      if (Table::levels[s] != machine) continue;
+      dot += indent + "s" + std::to_string(s) + " [label=";
+      impl::_dotQuoted(dot, stateName<Sm>(s));
+      if (Table::nested[s] != 0xff) dot += ", peripheries=2";
+      if (s < stateAttributes.size() && !stateAttributes[s].empty()) dot += ", " + stateAttributes[s];
+      dot += "];\n";
+    }
+    for (size_t n = 0; n < Table::NumberOfEntries; n++) {
+      if (Table::entries[n].machine == machine && Table::entries[n].kind == FinalKind) {
+        dot += indent + "f" + std::to_string(machine) + " [shape=doublecircle, label=\"\", width=0.2];\n";
+        break;
+      }
+    }
+    for (size_t n = 0; n < Table::NumberOfEntries; n++) {
+      const TransitionEntry& entry = Table::entries[n];
+      if (entry.machine == machine && entry.kind != InitialKind && entry.from == TransitionEntry::NoState) {
+        dot += indent + "a" + std::to_string(machine) + " [label=\"any\", style=dashed];\n";
+        break;
+      }
+    }
+    if (machine > 0) dot += "  }\n";
+  }
+
+  for (uint8_t s = 0; s < Table::NumberOfStates; s++) {
+    if (Table::nested[s] != 0xff) {
+      dot += "  s" + std::to_string(s) + " -> i" + std::to_string(Table::nested[s]) + " [style=dashed, arrowhead=none];\n";
+    }
+  }
+
+  for (size_t n = 0; n < Table::NumberOfEntries; n++) {
+    const TransitionEntry& entry = Table::entries[n];
+    const std::string from = entry.kind == InitialKind ? "i" + std::to_string(entry.machine)
+      : entry.from == TransitionEntry::NoState ? "a" + std::to_string(entry.machine)
+      : "s" + std::to_string(entry.from);
+    const std::string to = entry.to == TransitionEntry::NoState ? "f" + std::to_string(entry.machine) : "s" + std::to_string(entry.to);
+    std::string label = entry.event != TransitionEntry::NoEvent ? eventName<Sm>(entry.event) : "";
+    if (entry.kind == ChoiceKind) label += entry.guard ? " [guard]" : " [else]";
+    else if (entry.guard) label += " [guard]";
+    if (entry.action) label += " / action";
+
+    dot += "  " + from + " -> " + to + " [label=";
+    impl::_dotQuoted(dot, label.c_str());
+    if (entry.kind == ExitKind) dot += ", style=bold";
+    if (entry.kind == ChoiceKind) dot += ", arrowhead=diamond";
+    dot += "];\n";
+  }
+  dot += "}\n";
+  return dot;
+}
+}
+
+#endif
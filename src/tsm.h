@@ -62,6 +62,7 @@ using namespace std;
 #include "choicetransition.h"
 #include "initialtransition.h"
 #include "finaltransition.h"
+#include "flatstatemachine.h"
 
 namespace tsmlib
 {
@@ -0,0 +1,39 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Stub of the Arduino API for codesize.sh. Only declarations, so the calls stay in the object file
+// of a sketch but the Arduino core is not part of its size.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HIGH 0x1
+#define LOW 0x0
+#define OUTPUT 0x1
+#define LED_BUILTIN 13
+#define F(s) (s)
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+void delay(unsigned long ms);
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud);
+  size_t println(const char* s);
+};
+extern HardwareSerial Serial;
@@ -0,0 +1,121 @@
+#!/bin/sh
+#
+#  Copyright 2022-2023 Stefan Grimm
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Compiles the example sketches with size optimisation against the stub Arduino.h, and compares
+# text/data/bss of each sketch with baseline.txt. The sizes are the ones of the object file of
+# the sketch: the Arduino core and the C runtime are not included.
+#
+# Targets: host (c++ or $CXX), avr (avr-g++, ATmega328P as on the Uno) and arm (arm-none-eabi-g++,
+# Cortex-M0+). Cross targets are skipped when their compiler is not found. The sizes are per sketch
+# and per target machine, i.e. the CPU the sketch is compiled for, not per state machine of a sketch.
+#
+# Usage: tools/codesize/codesize.sh [--update]
+#   --update  writes the sizes of the found targets to baseline.txt
+# CODESIZE_FLAGS adds compiler flags, e.g. CODESIZE_FLAGS=-DTSM_LEVEL_STACK_ESTIMATE=256.
+# Exits with 1 if a size grew by more than CODESIZE_TOLERANCE bytes (default 0). Sizes are only
+# compared when the compiler version is the one of the baseline.
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(cd "$here/../.." && pwd)
+baseline="$here/baseline.txt"
+tolerance=${CODESIZE_TOLERANCE:-0}
+examples="LedOnOff LedOnOff_GoF LedOnOff_switch Washingmachine"
+flags="-Os -std=gnu++11 -DARDUINO=10607 -fno-exceptions -fno-rtti -fno-threadsafe-statics -ffunction-sections -fdata-sections -fno-asynchronous-unwind-tables ${CODESIZE_FLAGS:-}"
+
+update=0
+if [ "$1" = "--update" ]; then
+  update=1
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+results="$work/results.txt"
+: > "$results"
+
+# measure <target> <compiler> <size> <target flags>
+measure() {
+  target=$1
+  cxx=$2
+  sizetool=$3
+  shift 3
+  if ! command -v "$cxx" > /dev/null 2>&1; then
+    echo "# $target: $cxx not found, skipped"
+    return
+  fi
+  echo "# $target: $($cxx --version | head -n 1)" >> "$results"
+  for example in $examples; do
+    obj="$work/$target-$example.o"
+    "$cxx" $flags "$@" -I"$here" -I"$root/src" -include Arduino.h -x c++ -c "$root/examples/$example/$example.ino" -o "$obj"
+    "$sizetool" "$obj" | awk -v t="$target" -v e="$example" 'NR == 2 { print t, e, $1, $2, $3 }' >> "$results"
+  done
+}
+
+measure host "${CXX:-c++}" size
+measure avr avr-g++ avr-size -mmcu=atmega328p
+measure arm arm-none-eabi-g++ arm-none-eabi-size -mcpu=cortex-m0plus -mthumb
+
+if [ $update -eq 1 ]; then
+  # Keeps the rows of the targets that were not measured.
+  measured=$(awk '/^#/ { sub(":", "", $2); print $2 }' "$results")
+  touch "$baseline"
+  {
+    echo "# target example text data bss"
+    for target in host avr arm; do
+      if echo "$measured" | grep -qx "$target"; then
+        grep "^# $target:" "$results"
+        grep "^$target " "$results"
+      else
+        grep "^# $target:" "$baseline" || true
+        grep "^$target " "$baseline" || true
+      fi
+    done
+  } > "$work/baseline.txt"
+  mv "$work/baseline.txt" "$baseline"
+  cat "$baseline"
+  exit 0
+fi
+
+if [ ! -f "$baseline" ]; then
+  cat "$results"
+  echo "No baseline, run with --update to write one."
+  exit 0
+fi
+
+awk -v tolerance="$tolerance" '
+  FNR == NR {
+    if ($1 == "#") { sub(":", "", $2); compiler[$2] = $0; sub("^# [^ ]+ ", "", compiler[$2]) }
+    else { base[$1 " " $2] = $3 " " $4 " " $5 }
+    next
+  }
+  $1 == "#" {
+    sub(":", "", $2); target = $2; version = $0; sub("^# [^ ]+ ", "", version)
+    comparable[target] = compiler[target] == version
+    if (!comparable[target]) print "# " target ": compiler differs from the baseline (" compiler[target] "), not compared"
+    next
+  }
+  {
+    key = $1 " " $2
+    if (!(key in base)) { printf "%-5s %-16s text %6d  data %5d  bss %5d  (not in baseline)\n", $1, $2, $3, $4, $5; next }
+    split(base[key], b, " ")
+    printf "%-5s %-16s text %6d %+5d  data %5d %+4d  bss %5d %+4d\n", $1, $2, $3, $3 - b[1], $4, $4 - b[2], $5, $5 - b[3]
+    if (comparable[$1] && ($3 - b[1] > tolerance || $4 - b[2] > tolerance || $5 - b[3] > tolerance)) grown = 1
+  }
+  END {
+    if (grown) { print "Code size grew above the baseline."; exit 1 }
+  }
+' "$baseline" "$results"
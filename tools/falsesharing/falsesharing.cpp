@@ -0,0 +1,91 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: each thread toggles its own InstanceStatemachine of one array, once with the instances
+// padded to a cache line and once packed, and prints the time per dispatch of both layouts.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "../../src/instancestatemachine.h"
+
+using namespace tsmlib;
+
+namespace {
+
+using StatePolicy = State<MemoryAddressComparator, true>;
+
+struct Toggle {};
+
+struct Counting {
+  template<class StateType, class Event>
+  void perform(StateType& state, const Event&) { state.count++; }
+};
+
+// Off - Toggle -> On - Toggle -> Off. A state type belongs to one type of InstanceStatemachine,
+// so each layout has its own states.
+template<size_t Alignment>
+struct Layout {
+  struct Off : BasicState<Off, StatePolicy>, InstanceCreator<Off> {
+    uint32_t count = 0;
+  };
+  struct On : BasicState<On, StatePolicy>, InstanceCreator<On> {
+    uint32_t count = 0;
+  };
+  using Sm = InstanceStatemachine<
+    Typelist<Transition<Toggle, On, Off, NoGuard, Counting>,
+    Typelist<Transition<Toggle, Off, On, NoGuard, Counting>,
+    NullType>>,
+    InitialTransition<Off, NoAction>, Alignment>;
+};
+
+// Nanoseconds per dispatch, with one thread per instance.
+template<size_t Alignment>
+double measure(unsigned threads, uint32_t dispatches) {
+  using Sm = typename Layout<Alignment>::Sm;
+  std::vector<Sm> sms(threads);
+  for (Sm& sm : sms) sm.begin();
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned n = 0; n < threads; n++) {
+    workers.emplace_back([&sms, n, dispatches]() {
+      for (uint32_t i = 0; i < dispatches; i++) sms[n].template dispatch<Toggle>();
+    });
+  }
+  for (std::thread& worker : workers) worker.join();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  for (Sm& sm : sms) sm.end();
+  return std::chrono::duration<double, std::nano>(elapsed).count() / dispatches;
+}
+}
+
+int main(int argc, char** argv) {
+  const unsigned cores = std::thread::hardware_concurrency();
+  const unsigned threads = argc > 1 ? (unsigned)atoi(argv[1]) : (cores > 1 ? cores : 2);
+  const uint32_t dispatches = argc > 2 ? (uint32_t)atol(argv[2]) : 10000000;
+
+  using Padded = Layout<64>::Sm;
+  using Packed = Layout<alignof(void*)>::Sm;
+  printf("%u threads, %u cores, %u dispatches per thread\n", threads, cores, dispatches);
+  printf("padded: %3u bytes per instance, %6.2f ns per dispatch\n", (unsigned)sizeof(Padded), measure<64>(threads, dispatches));
+  printf("packed: %3u bytes per instance, %6.2f ns per dispatch\n", (unsigned)sizeof(Packed), measure<alignof(void*)>(threads, dispatches));
+  if (cores < 2) printf("Only one core: the threads do not run at the same time, so the layouts do not differ.\n");
+  return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+#  Copyright 2022-2023 Stefan Grimm
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Builds falsesharing.cpp with optimisation and runs it: one thread per InstanceStatemachine of an
+# array dispatches to its own instance, once with the instances aligned to a cache line and once
+# packed, so that neighbouring instances share a line. The numbers are only meaningful with at
+# least as many cores as threads.
+#
+# Usage: tools/falsesharing/falsesharing.sh [threads [dispatches]]
+#   threads     default: the number of cores, at least 2
+#   dispatches  per thread, default 10000000
+# CXX selects the compiler (default c++), FALSESHARING_FLAGS adds flags.
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+cxx=${CXX:-c++}
+flags="-std=c++17 -O2 -pthread ${FALSESHARING_FLAGS:-}"
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+$cxx $flags "$here/falsesharing.cpp" -o "$work/falsesharing"
+"$work/falsesharing" "$@"
@@ -0,0 +1,98 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: the part of the Microsoft C++ unit test framework used by NotquiteBDD.h, so that the
+// unit tests build with GCC and Clang. Failed asserts throw, main.cpp runs the registered tests.
+
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+using namespace std;
+
+#define MS_CPP_UNITTESTFRAMEWORK
+
+namespace Microsoft {
+  namespace VisualStudio {
+    namespace CppUnitTestFramework {
+
+      struct TestMethod {
+        std::string name;
+        std::function<void()> run;
+      };
+
+      inline std::vector<TestMethod>& testMethods() {
+        static std::vector<TestMethod> methods;
+        return methods;
+      }
+
+      struct AssertFailed : std::runtime_error {
+        explicit AssertFailed(const std::string& what) : std::runtime_error(what) {}
+      };
+
+      template<class T>
+      struct TestClass {
+        using TestClassType = T;
+        void initialize_() {}
+      };
+
+      struct Assert {
+        template<class T, class U>
+        static void AreEqual(const T& expected, const U& actual, const wchar_t* = nullptr) {
+          if (!(expected == actual)) throw AssertFailed("AreEqual");
+        }
+        template<class T, class U>
+        static void AreNotEqual(const T& notExpected, const U& actual, const wchar_t* = nullptr) {
+          if (notExpected == actual) throw AssertFailed("AreNotEqual");
+        }
+        static void IsTrue(bool condition, const wchar_t* = nullptr) {
+          if (!condition) throw AssertFailed("IsTrue");
+        }
+        static void IsFalse(bool condition, const wchar_t* = nullptr) {
+          if (condition) throw AssertFailed("IsFalse");
+        }
+        template<class T>
+        static void IsNull(const T* actual, const wchar_t* = nullptr) {
+          if (actual != nullptr) throw AssertFailed("IsNull");
+        }
+        template<class T>
+        static void IsNotNull(const T* actual, const wchar_t* = nullptr) {
+          if (actual == nullptr) throw AssertFailed("IsNotNull");
+        }
+      };
+    }
+  }
+}
+
+#define TEST_CLASS(name) class name : public ::Microsoft::VisualStudio::CppUnitTestFramework::TestClass<name>
+
+#define TEST_METHOD_INITIALIZE(name) public: void initialize_() { name(); } void name()
+
+#define TEST_METHOD(method) \
+  public: \
+  struct method##Registration { \
+    method##Registration() { \
+      ::Microsoft::VisualStudio::CppUnitTestFramework::testMethods().push_back({ \
+        std::string(typeid(TestClassType).name()) + " " #method, \
+        [] { TestClassType test; test.initialize_(); test.method(); } }); \
+    } \
+  }; \
+  static inline method##Registration method##Registered{}; \
+  void method()
@@ -0,0 +1,206 @@
+#pragma once
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: invariants of each dispatch, checked by the host test harness. Included by
+// statemachine.h with -DTSM_DISPATCH_PROBE='"dispatchprobe.h"'; GCC or Clang on Linux.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#if !defined(HOSTTESTS_STACK_LIMIT)
+#define HOSTTESTS_STACK_LIMIT 16384
+#endif
+
+namespace tsmlib {
+  template<class T> struct SingletonCreator;
+  template<class T> struct InstanceCreator;
+}
+namespace UnitTests {
+  namespace Helpers {
+    template<class T> struct SingletonCreatorFake;
+  }
+}
+
+namespace hosttests {
+
+// Counters of the running thread. The allocation counters are updated by the operators in main.cpp.
+struct Counters {
+  uint64_t news = 0;
+  uint64_t deletes = 0;
+  int untracked = 0;
+
+  // Of the dispatch in progress: depth of nested dispatches, and the limit of the outermost state machine.
+  int depth = 0;
+  int maxDepth = 0;
+  int depthLimit = 0;
+  uint64_t newsBefore = 0;
+  uint64_t deletesBefore = 0;
+  int heapStatesBefore = 0;
+  volatile char* stackBase = nullptr;
+
+  // Of the test.
+  uint64_t dispatches = 0;
+  size_t maxStack = 0;
+  int maxNesting = 0;
+  std::string violation;
+};
+
+inline Counters& counters() {
+  static thread_local Counters instance;
+  return instance;
+}
+
+// Allocations in scope are not counted, e.g. the records of the test doubles.
+struct Untracked {
+  Untracked() { counters().untracked++; }
+  ~Untracked() { counters().untracked--; }
+};
+
+// Creators that do not allocate; any other creator, e.g. a recording one of a test, may.
+template<class Creator>
+struct IsHeapCreator {
+  enum { value = true };
+};
+template<class T>
+struct IsHeapCreator< tsmlib::SingletonCreator<T> > {
+  enum { value = false };
+};
+template<class T>
+struct IsHeapCreator< tsmlib::InstanceCreator<T> > {
+  enum { value = false };
+};
+template<class T>
+struct IsHeapCreator< UnitTests::Helpers::SingletonCreatorFake<T> > {
+  enum { value = false };
+};
+
+template<class States>
+struct HasHeapStates;
+template<>
+struct HasHeapStates<LokiLight::NullType> {
+  enum { value = false };
+};
+template<class S, class Tail>
+struct HasHeapStates< LokiLight::Typelist<S, Tail> > {
+  enum { value = IsHeapCreator<typename S::CreatorType>::value || HasHeapStates<Tail>::value };
+};
+
+// Number of active states of all levels that were created on the heap.
+template<class Sm, class Level = typename tsmlib::impl::StatesOf<Sm>::Result>
+struct HeapStates {
+  using StatePolicy = typename Sm::StatePolicy;
+
+  static int count(const Sm& sm) {
+    return sm._activeState() != nullptr ? count(sm._activeState()) : 0;
+  }
+
+  static int count(StatePolicy* activeState) {
+    using S = typename Level::Head;
+    if (activeState->template typeOf<S>()) {
+      return (IsHeapCreator<typename S::CreatorType>::value ? 1 : 0)
+        + below(static_cast<S*>(activeState), LokiLight::Int2Type<tsmlib::impl::IsSubstatesHolder<S>::value>());
+    }
+    return HeapStates<Sm, typename Level::Tail>::count(activeState);
+  }
+
+private:
+  template<class S>
+  static int below(S*, const LokiLight::Int2Type<false>&) {
+    return 0;
+  }
+  template<class S>
+  static int below(S* holder, const LokiLight::Int2Type<true>&) {
+    return HeapStates<typename S::SubstatemachineType>::count(holder->_substatemachine());
+  }
+};
+template<class Sm>
+struct HeapStates<Sm, LokiLight::NullType> {
+  static int count(typename Sm::StatePolicy*) {
+    return 0;
+  }
+};
+
+/**
+  The stack below the outermost dispatch is painted before and searched for the deepest changed
+  byte after it. The painting loop must not call functions: their frames are in the painted area.
+*/
+enum : size_t { StackArea = 64 * 1024, StackGap = 256 };
+const char StackPattern = (char)0xa5;
+
+template<class Sm>
+class DispatchProbe {
+public:
+  explicit DispatchProbe(const Sm& sm) : sm_(sm) {
+    Counters& c = counters();
+    if (c.depth++ > 0) {
+      if (c.depth > c.maxDepth) c.maxDepth = c.depth;
+      return;
+    }
+
+    // Outside of the counted allocations: typeOf may create and destroy states.
+    c.heapStatesBefore = HeapStates<Sm>::count(sm);
+    c.maxDepth = 1;
+    c.depthLimit = tsmlib::impl::NestingDepth<Sm>::value;
+    c.newsBefore = c.news;
+    c.deletesBefore = c.deletes;
+
+    volatile char marker = 0;
+    c.stackBase = (volatile char*)((uintptr_t)&marker - StackGap);
+    for (size_t n = 1; n <= StackArea; n++) c.stackBase[-(ptrdiff_t)n] = StackPattern;
+  }
+
+  ~DispatchProbe() {
+    Counters& c = counters();
+    if (--c.depth > 0) return;
+
+    const volatile char* lowest = c.stackBase - StackArea;
+    size_t untouched = 0;
+    while (untouched < StackArea && lowest[untouched] == StackPattern) untouched++;
+    const size_t stack = StackArea - untouched + StackGap;
+
+    const uint64_t news = c.news - c.newsBefore;
+    const uint64_t deletes = c.deletes - c.deletesBefore;
+    const int heapStatesAfter = HeapStates<Sm>::count(sm_);
+
+    c.dispatches++;
+    if (stack > c.maxStack) c.maxStack = stack;
+    if (c.maxDepth > c.maxNesting) c.maxNesting = c.maxDepth;
+
+    if (!c.violation.empty()) return;
+    if (!HasHeapStates<typename tsmlib::impl::AllStatesOf<Sm>::Result>::value && (news != 0 || deletes != 0)) {
+      c.violation = "singleton states allocated " + std::to_string(news) + " times";
+    } else if ((int64_t)(news - deletes) != heapStatesAfter - c.heapStatesBefore) {
+      c.violation = std::to_string(news) + " news and " + std::to_string(deletes) + " deletes for " +
+        std::to_string(c.heapStatesBefore) + " heap states before and " + std::to_string(heapStatesAfter) + " after";
+    } else if (c.maxDepth > c.depthLimit) {
+      c.violation = "dispatch depth " + std::to_string(c.maxDepth) + " exceeds the nesting depth " + std::to_string(c.depthLimit);
+    } else if (stack > HOSTTESTS_STACK_LIMIT) {
+      c.violation = "dispatch used " + std::to_string(stack) + " bytes of stack";
+    }
+  }
+
+private:
+  const Sm& sm_;
+};
+}
+
+namespace tsmlib {
+using hosttests::DispatchProbe;
+}
+
+#define UNTRACKED_ALLOCATIONS hosttests::Untracked untracked_
@@ -0,0 +1,85 @@
+#!/bin/sh
+#
+#  Copyright 2022-2023 Stefan Grimm
+#
+#   Licensed under the Apache License, Version 2.0 (the "License");
+#   you may not use this file except in compliance with the License.
+#   You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+#   Unless required by applicable law or agreed to in writing, software
+#   distributed under the License is distributed on an "AS IS" BASIS,
+#   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#   See the License for the specific language governing permissions and
+#   limitations under the License.
+#
+# Builds unit tests of vsprojs/UnitTests with GCC or Clang against CppUnitTest.h and runs them.
+# Besides the asserts of the tests, each dispatch must keep the invariants of dispatchprobe.h:
+# no allocations if all states are singletons, as many news and deletes as heap states are
+# entered and left, nested dispatches not deeper than the nesting depth, and at most
+# HOSTTESTS_STACK_LIMIT bytes of stack.
+#
+# Usage: tools/hosttests/hosttests.sh [-v] [--all | Test.cpp...]
+#   -v     prints the dispatches, nesting and stack of each test
+#   --all  all tests of UnitTests.vcxproj instead of the call sequence scenarios
+# CXX selects the compiler (default c++), HOSTTESTS_FLAGS adds flags, e.g. -O2 or
+# -DHOSTTESTS_STACK_LIMIT=8192.
+
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+root=$(cd "$here/../.." && pwd)
+tests="$root/vsprojs/UnitTests"
+cxx=${CXX:-c++}
+# The factory creators delete states as their own type, never through a base: states with a
+# virtual getTypeId do not need a virtual destructor.
+flags="-std=c++17 -g -O0 -Wall -Wno-delete-non-virtual-dtor -pthread -I$here ${HOSTTESTS_FLAGS:-}"
+probe="-DTSM_DISPATCH_PROBE=\"dispatchprobe.h\""
+# Tests that measure the stack of a dispatch themselves run once more without the probe, whose
+# frames are on that stack.
+unprobed="DispatchStackTest.cpp"
+
+verbose=""
+if [ "$1" = "-v" ]; then
+  verbose="-v"
+  shift
+fi
+
+if [ "$1" = "--all" ]; then
+  sources=$(grep -o 'ClCompile Include="[^"]*"' "$tests/UnitTests.vcxproj" | sed 's/.*="\(.*\)"/\1/')
+elif [ $# -gt 0 ]; then
+  sources="$*"
+else
+  sources=$(cd "$tests" && ls StatemachineOnOff*Test.cpp Substatemachine*Test.cpp ChoiceTransition*Test.cpp)
+fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+objects="$work/main.o"
+$cxx $flags $probe -c "$here/main.cpp" -o "$work/main.o"
+for source in $sources; do
+  source=$(basename "$source")
+  $cxx $flags $probe -c "$tests/$source" -o "$work/${source%.cpp}.o"
+  objects="$objects $work/${source%.cpp}.o"
+done
+$cxx $flags $objects -o "$work/hosttests"
+"$work/hosttests" $verbose
+
+# main.o instantiates no state machine, so it links with sources built without the probe.
+objects="$work/main.o"
+for source in $sources; do
+  source=$(basename "$source")
+  case " $unprobed " in
+    *" $source "*)
+      $cxx $flags -c "$tests/$source" -o "$work/${source%.cpp}.unprobed.o"
+      objects="$objects $work/${source%.cpp}.unprobed.o"
+      ;;
+  esac
+done
+if [ "$objects" != "$work/main.o" ]; then
+  echo "Without the probe:"
+  $cxx $flags $objects -o "$work/unprobed"
+  "$work/unprobed" $verbose
+fi
@@ -0,0 +1,89 @@
+/*
+  Copyright 2022-2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+// Host only: runs the unit tests and reports the dispatch invariants of each test.
+
+#include <cxxabi.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include "CppUnitTest.h"
+#include "../../src/tsm.h"
+
+void* operator new(size_t size) {
+  hosttests::Counters& c = hosttests::counters();
+  if (c.untracked == 0) c.news++;
+  void* p = malloc(size != 0 ? size : 1);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  if (p == nullptr) return;
+  hosttests::Counters& c = hosttests::counters();
+  if (c.untracked == 0) c.deletes++;
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  operator delete(p);
+}
+
+static std::string demangled(const std::string& name) {
+  const size_t space = name.find(' ');
+  int status = 0;
+  char* type = abi::__cxa_demangle(name.substr(0, space).c_str(), nullptr, nullptr, &status);
+  std::string result = status == 0 ? std::string(type) + "::" + name.substr(space + 1) : name;
+  free(type);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+  const bool verbose = argc > 1 && std::string(argv[1]) == "-v";
+
+  size_t failed = 0;
+  uint64_t dispatches = 0;
+  size_t maxStack = 0;
+  for (const TestMethod& method : testMethods()) {
+    hosttests::Counters& c = hosttests::counters();
+    c.dispatches = 0;
+    c.maxStack = 0;
+    c.maxNesting = 0;
+    c.violation.clear();
+
+    std::string error;
+    try {
+      method.run();
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
+    if (error.empty() && !c.violation.empty()) error = c.violation;
+
+    dispatches += c.dispatches;
+    if (c.maxStack > maxStack) maxStack = c.maxStack;
+    if (!error.empty()) failed++;
+    if (!error.empty() || verbose) {
+      printf("%s %s: %llu dispatches, nesting %d, stack %zu bytes%s%s\n", error.empty() ? "OK  " : "FAIL",
+        demangled(method.name).c_str(), (unsigned long long)c.dispatches, c.maxNesting, c.maxStack,
+        error.empty() ? "" : ", ", error.c_str());
+    }
+  }
+
+  printf("%zu tests, %zu failed, %llu dispatches, at most %zu bytes of stack (limit %d)\n", testMethods().size(), failed,
+    (unsigned long long)dispatches, maxStack, HOSTTESTS_STACK_LIMIT);
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/asyncaction.h"
+#include "TestHelpers.h"
+#include <vector>
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace AsyncActionTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      namespace Trigger {
+        struct Toggle {
+          int sequence;
+        };
+      }
+
+      struct Off : BasicState<Off, StatePolicy>, SingletonCreator<Off> {};
+      struct On : BasicState<On, StatePolicy>, SingletonCreator<On> {};
+
+      // Only the worker writes, the test reads after flush.
+      struct Logger {
+        template<class Event>
+        void perform(const Event& ev) {
+          if (std::this_thread::get_id() != dispatcher) otherThread = true;
+          while (blocked.load()) { std::this_thread::yield(); }
+          sequences.push_back(ev.sequence);
+        }
+
+        static std::vector<int> sequences;
+        static std::thread::id dispatcher;
+        static std::atomic<bool> blocked;
+        static bool otherThread;
+      };
+      std::vector<int> Logger::sequences;
+      std::thread::id Logger::dispatcher;
+      std::atomic<bool> Logger::blocked{ false };
+      bool Logger::otherThread = false;
+
+      using Executor = AsyncExecutor<2, 64>;
+      using ToOnFromOff = Transition<Trigger::Toggle, On, Off, NoGuard, AsyncAction<Logger, Executor>>;
+      using ToOffFromOn = Transition<Trigger::Toggle, Off, On, NoGuard, AsyncAction<Logger, Executor>>;
+      using Transitions =
+        Typelist<ToOnFromOff,
+        Typelist<ToOffFromOn,
+        NullType>>;
+      using InitTransition = InitialTransition<Off, NoAction>;
+      using Sm = Statemachine<Transitions, InitTransition>;
+    }
+
+    BEGIN(AsyncActionTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace AsyncActionTestImpl;
+          Executor::instance().flush();
+          Logger::sequences.clear();
+          Logger::dispatcher = std::this_thread::get_id();
+          Logger::blocked = false;
+          Logger::otherThread = false;
+        })
+
+      TEST(
+        Dispatch,
+        AsyncAction,
+        RunsOnWorker)
+      {
+        using namespace AsyncActionTestImpl;
+        Sm sm;
+        sm.begin();
+
+        TRUE(sm.dispatch(Trigger::Toggle{ 1 }).consumed);
+        Executor::instance().flush();
+
+        EQ((size_t)1, Logger::sequences.size());
+        TRUE(Logger::otherThread);
+      }
+
+      TEST(
+        Dispatch,
+        ActionBlocked,
+        DispatchReturns)
+      {
+        using namespace AsyncActionTestImpl;
+        Sm sm;
+        sm.begin();
+
+        Logger::blocked = true;
+        sm.dispatch(Trigger::Toggle{ 1 });
+        sm.dispatch(Trigger::Toggle{ 2 });
+        TRUE(sm.dispatch(Trigger::Toggle{ 3 }).activeState->typeOf<On>());
+
+        Logger::blocked = false;
+        Executor::instance().flush();
+        EQ((size_t)3, Logger::sequences.size());
+      }
+
+      TEST(
+        Flush,
+        ManyEvents,
+        SameOrderAsDispatched)
+      {
+        using namespace AsyncActionTestImpl;
+        Sm sm;
+        sm.begin();
+
+        // More events than the capacity of the lane
+        for (int n = 0; n < 1000; n++) {
+          sm.dispatch(Trigger::Toggle{ n });
+        }
+        Executor::instance().flush();
+
+        EQ((size_t)1000, Logger::sequences.size());
+        bool ordered = true;
+        for (int n = 0; n < 1000; n++) {
+          ordered = ordered && Logger::sequences[n] == n;
+        }
+        TRUE(ordered);
+      }
+
+      TEST(
+        Dispatch,
+        MachineDispatchedFromThreads,
+        SameOrderAsDispatched)
+      {
+        using namespace AsyncActionTestImpl;
+        Sm sm;
+        sm.begin();
+
+        // Each thread dispatches after the one before, all actions go into the lane of machine 5
+        Logger::blocked = true;
+        for (int n = 0; n < 8; n++) {
+          std::thread dispatcher([&sm, n]() { Executor::instance().dispatch(sm, 5, Trigger::Toggle{ n }); });
+          dispatcher.join();
+        }
+        Logger::blocked = false;
+        Executor::instance().flush();
+
+        EQ((size_t)8, Logger::sequences.size());
+        bool ordered = true;
+        for (int n = 0; n < 8; n++) {
+          ordered = ordered && Logger::sequences[n] == n;
+        }
+        TRUE(ordered);
+      }
+
+    END
+
+  }
+}
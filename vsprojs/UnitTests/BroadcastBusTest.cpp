@@ -0,0 +1,164 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/broadcastbus.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace BroadcastBusTestImpl {
+
+      using StatePolicy = State<VirtualTypeIdComparator, false>;
+
+      namespace Trigger {
+        struct Start {};
+        struct Tick {};
+        struct Stop {};
+        struct Unused {};
+      }
+      using Events = Typelist<Trigger::Start, Typelist<Trigger::Tick, Typelist<Trigger::Stop, Typelist<Trigger::Unused, NullType>>>>;
+
+      struct Idle : BasicState<Idle, StatePolicy>, FactoryCreator<Idle> {
+        uint8_t getTypeId() const override { return 1; }
+      };
+      struct Running : BasicState<Running, StatePolicy>, FactoryCreator<Running> {
+        uint8_t getTypeId() const override { return 2; }
+        uint32_t ticks = 0;
+      };
+
+      struct CountTick {
+        template<class StateType>
+        void perform(StateType& state, const Trigger::Tick&) { state.ticks++; }
+      };
+
+      using Transitions =
+        Typelist<Transition<Trigger::Start, Running, Idle, NoGuard, NoAction>,
+        Typelist<SelfTransition<Trigger::Tick, Running, NoGuard, CountTick, false>,
+        Typelist<Transition<Trigger::Stop, Idle, Running, NoGuard, NoAction>,
+        NullType>>>;
+      using InitTransition = InitialTransition<Idle, NoAction>;
+      using Sm = Statemachine<Transitions, InitTransition>;
+      using Bus = BroadcastBus<Sm, Events>;
+
+      // Waiting - Start -> Polling (a choice, Waiting is destroyed before Polling is created) - Stop -> Waiting
+      struct Waiting : BasicState<Waiting, StatePolicy>, FactoryCreator<Waiting> {
+        uint8_t getTypeId() const override { return 3; }
+      };
+      struct Polling : BasicState<Polling, StatePolicy>, FactoryCreator<Polling> {
+        uint8_t getTypeId() const override { return 4; }
+      };
+      struct Always {
+        template<class StateType, class Event>
+        bool eval(const StateType&, const Event&) { return true; }
+      };
+      using ChoiceSm = Statemachine<
+        Typelist<ChoiceTransition<Trigger::Start, Polling, Waiting, Waiting, Always, NoAction>,
+        Typelist<Transition<Trigger::Stop, Waiting, Polling, NoGuard, NoAction>,
+        NullType>>,
+        InitialTransition<Waiting, NoAction>>;
+    }
+
+    BEGIN(BroadcastBusTest)
+
+      TEST(
+        StateEventMask,
+        TransitionsOfStates,
+        BitsOfTheirEvents)
+      {
+        using namespace BroadcastBusTestImpl;
+        using IdleMask = impl::StateEventMask<Transitions, Idle, Events>;
+        using RunningMask = impl::StateEventMask<Transitions, Running, Events>;
+        EQ((uint32_t)1, (uint32_t)IdleMask::value);
+        EQ((uint32_t)6, (uint32_t)RunningMask::value);
+      }
+
+      TEST(
+        BroadcastBus,
+        MachinesInDifferentStates,
+        OnlyMachinesWithTransitionDispatched)
+      {
+        using namespace BroadcastBusTestImpl;
+        Sm sms[100];
+        Bus bus;
+        for (int n = 0; n < 100; n++) {
+          sms[n].begin();
+          bus.add(sms[n]);
+        }
+        EQ((uint32_t)0, bus.broadcast(Trigger::Tick{}));
+        EQ((uint32_t)0, bus.broadcast(Trigger::Unused{}));
+
+        TRUE(bus.dispatch(3, Trigger::Start{}).consumed);
+        TRUE(bus.dispatch(70, Trigger::Start{}).consumed);
+        TRUE(bus.subscribed<Trigger::Tick>(70));
+        FALSE(bus.subscribed<Trigger::Start>(70));
+
+        EQ((uint32_t)2, bus.broadcast(Trigger::Tick{}));
+        EQ((uint32_t)1, static_cast<Running*>(sms[70]._activeState())->ticks);
+
+        EQ((uint32_t)98, bus.broadcast(Trigger::Start{}));
+        EQ((uint32_t)100, bus.broadcast(Trigger::Tick{}));
+        EQ((uint32_t)100, bus.broadcast(Trigger::Stop{}));
+        EQ((uint32_t)0, bus.broadcast(Trigger::Tick{}));
+      }
+
+      TEST(
+        BroadcastBus,
+        MachineDispatchedDirectly,
+        UpdateRefreshesBits)
+      {
+        using namespace BroadcastBusTestImpl;
+        Sm sm;
+        Bus bus;
+        const uint32_t id = bus.add(sm);
+        FALSE(bus.subscribed<Trigger::Start>(id));
+
+        sm.begin();
+        bus.update(id);
+        TRUE(bus.subscribed<Trigger::Start>(id));
+        sm.dispatch<Trigger::Start>();
+        bus.update(id);
+        FALSE(bus.subscribed<Trigger::Start>(id));
+        TRUE(bus.subscribed<Trigger::Stop>(id));
+      }
+
+      TEST(
+        BroadcastBus,
+        NewStateAtAddressOfOldOne,
+        BitsUpdated)
+      {
+        using namespace BroadcastBusTestImpl;
+        ChoiceSm sm;
+        sm.begin();
+        BroadcastBus<ChoiceSm, Events> bus;
+        const uint32_t id = bus.add(sm);
+
+        TRUE(bus.dispatch(id, Trigger::Start{}).consumed);
+        TRUE(sm._activeState()->typeOf<Polling>());
+        FALSE(bus.subscribed<Trigger::Start>(id));
+        TRUE(bus.subscribed<Trigger::Stop>(id));
+        EQ((uint32_t)1, bus.broadcast(Trigger::Stop{}));
+        TRUE(sm._activeState()->typeOf<Waiting>());
+      }
+
+    END
+
+  }
+}
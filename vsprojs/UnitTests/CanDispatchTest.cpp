@@ -0,0 +1,364 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/tsm.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace CanDispatchTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+      using RecorderType = Recorder<sizeof(__FILE__) + __LINE__>;
+      template<class Derived> struct Leaf : BasicState<Derived, StatePolicy, true, true, true>, SingletonCreatorFake<Derived> {};
+      template<class Derived, class Statemachine> struct Composite : SubstatesHolderState<Derived, StatePolicy, Statemachine, true, true>, SingletonCreatorFake<Derived> {};
+
+      struct InitialStateFake : StatePolicy {
+        using Policy = StatePolicy;
+        static const char* name;
+      };
+      const char* InitialStateFake::name = "*";
+
+      namespace Trigger
+      {
+        struct B_A {};
+        struct A_B {};
+        struct B_AA {};
+        struct B_AAB {};
+        struct AAB_AAA {};
+        struct Unhandled {};
+        struct Level {
+          int value;
+        };
+        struct Checked {};
+        struct Restart {};
+        struct Choose {};
+      }
+
+      // With type ids, typeOf creates a state of the compared type: Heap on the heap, Shared not.
+      using TypeIdPolicy = State<VirtualTypeIdComparator, false>;
+      struct Shared : BasicState<Shared, TypeIdPolicy>, SingletonCreator<Shared> {
+        uint8_t getTypeId() const override { return 1; }
+      };
+      struct Heap : BasicState<Heap, TypeIdPolicy>, FactoryCreator<Heap> {
+        uint8_t getTypeId() const override { return 2; }
+      };
+      using TypeIdTransitions =
+        Typelist<Transition<Trigger::A_B, Heap, Shared, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::B_A, Shared, Heap, NoGuard, NoAction>,
+        NullType>>;
+      using TypeIdSm = Statemachine<TypeIdTransitions, InitialTransition<Shared, NoAction>>;
+
+      struct Rejecting {
+        template<class StateType, class Event> bool eval(const StateType&, const Event&) { calls++; return false; }
+        static int calls;
+      };
+      int Rejecting::calls = 0;
+
+      struct B : Leaf<B> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("B::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("B::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add("B::Do"); }
+      };
+      const char* B::name = "B";
+
+      struct AAA : Leaf<AAA> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("AAA::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("AAA::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add("AAA::Do"); }
+      };
+      const char* AAA::name = "AAA";
+
+      struct AAB : Leaf<AAB> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("AAB::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("AAB::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add("AAB::Do"); }
+      };
+      const char* AAB::name = "AAB";
+
+      using ToAABfromAAA = Transition<Trigger::AAB_AAA, AAB, AAA, NoGuard, ActionSpy<AAB, AAA, RecorderType>>;
+      using ToBfromAAB = ExitTransition<Trigger::B_AAB, B, AAB, NoGuard, ActionSpy<B, AAB, RecorderType>>;
+      using ToAABfromAAARestart = Transition<Trigger::Restart, AAB, AAA, NoGuard, NoAction>;
+      using ToBorAAAfromAAA = ChoiceExitTransition<Trigger::Choose, B, AAA, AAA, Rejecting, NoAction>;
+      using ToFinalFromAAA = FinalTransition<AAA>;
+      using ToFinalFromAAB = FinalTransition<AAB>;
+      using TransitionsAA =
+        Typelist<ToAABfromAAA,
+        Typelist<ToBfromAAB,
+        Typelist<ToAABfromAAARestart,
+        Typelist<ToBorAAAfromAAA,
+        Typelist<ToFinalFromAAA,
+        Typelist<ToFinalFromAAB,
+        NullType>>>>>>;
+      using InitAA = InitialTransition<AAA, ActionSpy<AAA, InitialStateFake, RecorderType>>;
+      using SmAA = Statemachine<TransitionsAA, InitAA>;
+
+      struct AA : Composite<AA, SmAA> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("AA::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("AA::Exit"); }
+      };
+      const char* AA::name = "AA";
+
+      using ToBfromAA = ExitTransition<Trigger::B_AA, B, AA, NoGuard, ActionSpy<B, AA, RecorderType>>;
+      using ToFinalFromAA = FinalTransition<AA>;
+      using DeclToAABfromAAA1 = Declaration<Trigger::AAB_AAA, AA>;
+      using DeclToBfromAAB1 = Declaration<Trigger::B_AAB, AA>;
+      using DeclRestart1 = Declaration<Trigger::Restart, AA>;
+      using DeclChoose1 = Declaration<Trigger::Choose, AA>;
+      using TransitionsA =
+        Typelist<ToBfromAA,
+        Typelist<ToFinalFromAA,
+        Typelist<DeclToAABfromAAA1,
+        Typelist<DeclToBfromAAB1,
+        Typelist<DeclRestart1,
+        Typelist<DeclChoose1,
+        NullType>>>>>>;
+      using InitA = InitialTransition<AA, ActionSpy<AA, InitialStateFake, RecorderType>>;
+      using SmA = Statemachine<TransitionsA, InitA>;
+
+      struct A : Composite<A, SmA> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("A::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("A::Exit"); }
+      };
+      const char* A::name = "A";
+
+      struct PositiveLevel {
+        template<class StateType> bool eval(const StateType&, const Trigger::Level& ev) { calls++; return ev.value > 0; }
+        static int calls;
+      };
+      int PositiveLevel::calls = 0;
+
+      using ToBfromA = Transition<Trigger::B_A, B, A, NoGuard, ActionSpy<B, A, RecorderType>>;
+      using ToAfromB = Transition<Trigger::A_B, A, B, NoGuard, ActionSpy<A, B, RecorderType>>;
+      using ToBfromBLevel = Transition<Trigger::Level, B, B, PositiveLevel, ActionSpy<B, B, RecorderType>>;
+      using ToAfromBChecked = Transition<Trigger::Checked, A, B, Rejecting, ActionSpy<A, B, RecorderType>>;
+      using ToFinalFromA = FinalTransition<A>;
+      using ToFinalFromB = FinalTransition<B>;
+      using DeclToAABfromAAA = Declaration<Trigger::AAB_AAA, A>;
+      using DeclToBfromAA = ExitDeclaration<Trigger::B_AA, B, A>;
+      using DeclToBfromAAB = ExitDeclaration<Trigger::B_AAB, B, A>;
+      using ToAfromARestart = SelfTransition<Trigger::Restart, A, NoGuard, NoAction, true>;
+      using DeclChoose = Declaration<Trigger::Choose, A>;
+      using Transitions =
+        Typelist<ToBfromA,
+        Typelist<ToAfromB,
+        Typelist<ToBfromBLevel,
+        Typelist<ToAfromBChecked,
+        Typelist<ToFinalFromA,
+        Typelist<ToFinalFromB,
+        Typelist<DeclToAABfromAAA,
+        Typelist<DeclToBfromAA,
+        Typelist<DeclToBfromAAB,
+        Typelist<ToAfromARestart,
+        Typelist<DeclChoose,
+        NullType>>>>>>>>>>>;
+      using InitTransition = InitialTransition<A, ActionSpy<A, InitialStateFake, RecorderType>>;
+      using Sm = Statemachine<Transitions, InitTransition>;
+    }
+  }
+}
+
+namespace tsmlib {
+  template<>
+  struct IsPureGuard<UT::Classes::CanDispatchTestImpl::PositiveLevel> {
+    enum { value = true };
+  };
+}
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    BEGIN(CanDispatchTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace CanDispatchTestImpl;
+          RecorderType::reset();
+          PositiveLevel::calls = 0;
+          Rejecting::calls = 0;
+        })
+
+      TEST(
+        CanDispatch,
+        UnhandledEvent,
+        FalseAtCompileTime)
+      {
+        using namespace CanDispatchTestImpl;
+        static_assert(!Sm::handles<Trigger::Unhandled>(), "");
+        static_assert(Sm::handles<Trigger::B_A>(), "");
+
+        Sm sm;
+        sm.begin();
+        FALSE(sm.canDispatch<Trigger::Unhandled>());
+      }
+
+      TEST(
+        CanDispatch,
+        NotStarted,
+        False)
+      {
+        using namespace CanDispatchTestImpl;
+        Sm sm;
+        FALSE(sm.canDispatch<Trigger::B_A>());
+      }
+
+      TEST(
+        CanDispatch,
+        ThirdLevel,
+        NoSideEffects)
+      {
+        using namespace CanDispatchTestImpl;
+        Sm sm;
+        sm.begin();
+        RecorderType::reset();
+
+        TRUE(sm.canDispatch<Trigger::AAB_AAA>());
+        TRUE(sm.canDispatch<Trigger::B_AAB>());
+        TRUE(sm.canDispatch<Trigger::B_A>());
+        FALSE(sm.canDispatch<Trigger::A_B>());
+        RecorderType::checkUnchanged();
+
+        // AAA is still active
+        TRUE(sm.dispatch<Trigger::AAB_AAA>().consumed);
+        RecorderType::check({
+          "AAB<-AAA",
+          "AAA::Exit",
+          "AAB::Entry",
+          "AAB::Do" });
+      }
+
+      TEST(
+        CanDispatch,
+        ThirdLevel,
+        SameAsDispatch)
+      {
+        using namespace CanDispatchTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::AAB_AAA>();
+
+        const bool expected = sm.canDispatch<Trigger::AAB_AAA>();
+        FALSE(expected);
+        EQ(expected, sm.dispatch<Trigger::AAB_AAA>().consumed);
+
+        TRUE(sm.canDispatch<Trigger::B_AAB>());
+        TRUE(sm.dispatch<Trigger::B_AAB>().consumed);
+
+        FALSE(sm.canDispatch<Trigger::B_AAB>());
+        FALSE(sm.dispatch<Trigger::B_AAB>().consumed);
+
+        TRUE(sm.canDispatch<Trigger::A_B>());
+        TRUE(sm.dispatch<Trigger::A_B>().consumed);
+      }
+
+      TEST(
+        CanDispatch,
+        PureGuard,
+        GuardEvaluated)
+      {
+        using namespace CanDispatchTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::B_A>();
+        RecorderType::reset();
+
+        TRUE(sm.canDispatch(Trigger::Level{ 1 }));
+        FALSE(sm.canDispatch(Trigger::Level{ 0 }));
+        EQ(2, PositiveLevel::calls);
+        RecorderType::checkUnchanged();
+      }
+
+      TEST(
+        CanDispatch,
+        ImpureGuard,
+        AssumedTrue)
+      {
+        using namespace CanDispatchTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::B_A>();
+
+        TRUE(sm.canDispatch<Trigger::Checked>());
+        EQ(0, Rejecting::calls);
+        FALSE(sm.dispatch<Trigger::Checked>().consumed);
+      }
+
+      TEST(
+        CanDispatch,
+        ImpureGuardOfExitChoice,
+        EitherChoiceAssumed)
+      {
+        using namespace CanDispatchTestImpl;
+        Sm sm;
+        sm.begin();
+
+        // The guard rejects, AAA is chosen and the event consumed
+        TRUE(sm.canDispatch<Trigger::Choose>());
+        EQ(0, Rejecting::calls);
+        TRUE(sm.dispatch<Trigger::Choose>().consumed);
+      }
+
+      TEST(
+        CanDispatch,
+        ReenteringHolder,
+        NestedStatemachineBeginsAgain)
+      {
+        using namespace CanDispatchTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::AAB_AAA>();
+        RecorderType::reset();
+
+        // AAB does not handle Restart, the reentered AA begins with AAA which does
+        TRUE(sm.canDispatch<Trigger::Restart>());
+        RecorderType::checkUnchanged();
+        TRUE(sm.dispatch<Trigger::Restart>().consumed);
+        FALSE(sm.canDispatch<Trigger::AAB_AAA>());
+      }
+
+      TEST(
+        CanDispatch,
+        FromStatesOfTheFactoryComparedByTypeId,
+        RejectedAtCompileTime)
+      {
+        using namespace CanDispatchTestImpl;
+        // canDispatch<Trigger::B_A> does not compile, it would create a Heap state to compare it
+        static_assert(impl::QueryCreatesStates<impl::TransitionsFor<TypeIdTransitions, Trigger::B_A>::Result>::value, "");
+        static_assert(!impl::QueryCreatesStates<impl::TransitionsFor<TypeIdTransitions, Trigger::A_B>::Result>::value, "");
+
+        TypeIdSm sm;
+        sm.begin();
+        TRUE(sm.canDispatch<Trigger::A_B>());
+      }
+
+    END
+
+  }
+}
@@ -0,0 +1,191 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/tsm.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace ChangeStateTestImpl {
+
+      // Compares with typeid, so typeOf does not create states.
+      using StatePolicy = State<RttiComparator, false>;
+      using RecorderType = Recorder<sizeof(__FILE__) + __LINE__>;
+
+      namespace Trigger {
+        struct On {};
+        struct Off {};
+        struct Choose {};
+        struct Leave {};
+      }
+
+      // Records when the state machine creates and destroys a state.
+      template<class T>
+      struct RecordingCreator {
+        using CreatorType = RecordingCreator<T>;
+        using ObjectType = T;
+
+        static T* create() {
+          RecorderType::add(string(T::name) + "::Create");
+          return new T;
+        }
+        static void destroy(T* state) {
+          RecorderType::add(string(T::name) + "::Destroy");
+          delete state;
+        }
+      };
+
+      template<class Derived>
+      struct Recording : BasicState<Derived, StatePolicy, true, true, true>, RecordingCreator<Derived> {
+        template<class Event> void entry(const Event&) { RecorderType::add(string(Derived::name) + "::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add(string(Derived::name) + "::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add(string(Derived::name) + "::Do"); }
+      };
+
+      struct OnState : Recording<OnState> {
+        static const char* name;
+      };
+      const char* OnState::name = "On";
+
+      struct OffState : Recording<OffState> {
+        static const char* name;
+      };
+      const char* OffState::name = "Off";
+
+      struct IsOn {
+        template<class StateType, class EventType>
+        bool eval(const StateType&, const EventType&) { return true; }
+      };
+
+      using Sm = Statemachine<
+        Typelist<Transition<Trigger::On, OnState, OffState, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Off, OffState, OnState, NoGuard, NoAction>,
+        Typelist<ChoiceTransition<Trigger::Choose, OnState, OffState, OffState, IsOn, NoAction>,
+        NullType>>>,
+        InitialTransition<OffState, NoAction>>;
+
+      // Holder(Idle) - Leave -> On or Off, the nested state machine does not consume Leave.
+      struct Idle : BasicState<Idle, StatePolicy>, SingletonCreator<Idle> {};
+      using Inner = Statemachine<
+        Typelist<Transition<Trigger::On, Idle, Idle, NoGuard, NoAction>,
+        NullType>,
+        InitialTransition<Idle, NoAction>>;
+
+      struct Holder : SubstatesHolderState<Holder, StatePolicy, Inner, true, true>, RecordingCreator<Holder> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("Holder::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("Holder::Exit"); }
+      };
+      const char* Holder::name = "Holder";
+
+      using HolderSm = Statemachine<
+        Typelist<Exit2Declaration<Trigger::Leave, OnState, OffState, Holder, IsOn>,
+        NullType>,
+        InitialTransition<Holder, NoAction>>;
+    }
+
+    BEGIN(ChangeStateTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace ChangeStateTestImpl;
+          RecorderType::reset();
+        })
+
+      TEST(
+        ChangeState,
+        Transition,
+        ExitCreateEntryDoDestroy)
+      {
+        using namespace ChangeStateTestImpl;
+        Sm sm;
+        sm.begin();
+        RecorderType::check({
+          "Off::Create",
+          "Off::Entry",
+          "Off::Do" });
+
+        auto result = sm.dispatch<Trigger::On>();
+        TRUE(result.consumed);
+        TRUE(result.activeState->typeOf<OnState>());
+        RecorderType::check({
+          "Off::Exit",
+          "On::Create",
+          "On::Entry",
+          "On::Do",
+          "Off::Destroy" });
+
+        sm.dispatch<Trigger::Off>();
+        RecorderType::check({
+          "On::Exit",
+          "Off::Create",
+          "Off::Entry",
+          "Off::Do",
+          "On::Destroy" });
+      }
+
+      TEST(
+        ChangeState,
+        ChoiceTransition,
+        DestroysBeforeCreating)
+      {
+        using namespace ChangeStateTestImpl;
+        Sm sm;
+        sm.begin();
+        RecorderType::reset();
+
+        auto result = sm.dispatch<Trigger::Choose>();
+        TRUE(result.consumed);
+        TRUE(result.activeState->typeOf<OnState>());
+        RecorderType::check({
+          "Off::Exit",
+          "Off::Destroy",
+          "On::Create",
+          "On::Entry",
+          "On::Do" });
+      }
+
+      TEST(
+        ChangeState,
+        Exit2Declaration,
+        ExitCreateEntryDoDestroy)
+      {
+        using namespace ChangeStateTestImpl;
+        HolderSm sm;
+        sm.begin();
+        RecorderType::reset();
+
+        auto result = sm.dispatch<Trigger::Leave>();
+        TRUE(result.consumed);
+        TRUE(result.activeState->typeOf<OnState>());
+        RecorderType::check({
+          "Holder::Exit",
+          "On::Create",
+          "On::Entry",
+          "On::Do",
+          "Holder::Destroy" });
+      }
+
+    END
+
+  }
+}
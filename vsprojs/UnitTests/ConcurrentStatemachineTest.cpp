@@ -0,0 +1,159 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/concurrentstatemachine.h"
+#include "TestHelpers.h"
+#include <vector>
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace ConcurrentStatemachineTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      namespace Trigger {
+        struct Toggle {};
+        struct Count {};
+      }
+
+      struct Off : BasicState<Off, StatePolicy>, SingletonCreator<Off> {};
+      struct On : BasicState<On, StatePolicy>, SingletonCreator<On> {};
+
+      // Not thread-safe on purpose, the state machine serializes the calls.
+      struct Counter {
+        template<class StateType, class EventType>
+        void perform(StateType&, const EventType&) { calls++; }
+        static int calls;
+      };
+      int Counter::calls = 0;
+
+      using ToOnFromOff = Transition<Trigger::Toggle, On, Off, NoGuard, Counter>;
+      using ToOffFromOn = Transition<Trigger::Toggle, Off, On, NoGuard, Counter>;
+      using CountOn = SelfTransition<Trigger::Count, On, NoGuard, Counter, false>;
+      using CountOff = SelfTransition<Trigger::Count, Off, NoGuard, Counter, false>;
+      using ToFinalFromOff = FinalTransition<Off>;
+      using ToFinalFromOn = FinalTransition<On>;
+      using Transitions =
+        Typelist<ToOnFromOff,
+        Typelist<ToOffFromOn,
+        Typelist<CountOn,
+        Typelist<CountOff,
+        Typelist<ToFinalFromOff,
+        Typelist<ToFinalFromOn,
+        NullType>>>>>>;
+      using InitTransition = InitialTransition<Off, NoAction>;
+      using Sm = ConcurrentStatemachine<Transitions, InitTransition>;
+
+      const uint8_t OffIndex = 0;
+      const uint8_t OnIndex = 1;
+    }
+
+    BEGIN(ConcurrentStatemachineTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace ConcurrentStatemachineTestImpl;
+          Counter::calls = 0;
+        })
+
+      TEST(
+        ActiveStateIndex,
+        BeginDispatchEnd,
+        Published)
+      {
+        using namespace ConcurrentStatemachineTestImpl;
+        Sm sm;
+        EQ((uint8_t)impl::NoStateIndex, sm.activeStateIndex());
+
+        TRUE(sm.begin().consumed);
+        EQ(OffIndex, sm.activeStateIndex());
+
+        TRUE(sm.dispatch<Trigger::Toggle>().consumed);
+        EQ(OnIndex, sm.activeStateIndex());
+
+        TRUE(sm.end().consumed);
+        EQ((uint8_t)impl::NoStateIndex, sm.activeStateIndex());
+      }
+
+      TEST(
+        Dispatch,
+        SeveralThreads,
+        AllEventsSerialized)
+      {
+        using namespace ConcurrentStatemachineTestImpl;
+        Sm sm;
+        sm.begin();
+
+        const int threads = 4;
+        const int events = 10000;
+        std::atomic<int> consumed{ 0 };
+        std::atomic<bool> invalidIndex{ false };
+
+        std::vector<std::thread> producers;
+        for (int n = 0; n < threads; n++) {
+          producers.emplace_back([&]() {
+            for (int e = 0; e < events; e++) {
+              if (sm.dispatch<Trigger::Count>().consumed) consumed++;
+              const uint8_t index = sm.activeStateIndex();
+              if (index != OffIndex && index != OnIndex) invalidIndex = true;
+            }
+          });
+        }
+        for (auto& producer : producers) {
+          producer.join();
+        }
+
+        EQ(threads * events, consumed.load());
+        EQ(threads * events, Counter::calls);
+        FALSE(invalidIndex.load());
+        EQ(OffIndex, sm.activeStateIndex());
+      }
+
+      TEST(
+        Dispatch,
+        TogglingThreads,
+        EvenNumberOfToggles)
+      {
+        using namespace ConcurrentStatemachineTestImpl;
+        Sm sm;
+        sm.begin();
+
+        std::vector<std::thread> producers;
+        for (int n = 0; n < 4; n++) {
+          producers.emplace_back([&]() {
+            for (int e = 0; e < 1000; e++) {
+              sm.dispatch<Trigger::Toggle>();
+            }
+          });
+        }
+        for (auto& producer : producers) {
+          producer.join();
+        }
+
+        EQ(4000, Counter::calls);
+        EQ(OffIndex, sm.activeStateIndex());
+      }
+
+    END
+
+  }
+}
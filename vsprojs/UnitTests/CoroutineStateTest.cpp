@@ -0,0 +1,241 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/coroutinestate.h"
+#include "TestHelpers.h"
+
+#if defined(__cpp_impl_coroutine)
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace CoroutineStateTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+      using RecorderType = Recorder<sizeof(__FILE__) + __LINE__>;
+
+      namespace Trigger {
+        struct Start {};
+        struct Tick {};
+        struct Abort {};
+        struct Data {
+          int value;
+        };
+      }
+
+      struct Idle : BasicState<Idle, StatePolicy>, SingletonCreator<Idle> {};
+
+      struct Busy : CoroutineState<Busy, StatePolicy, 256, true, true>, SingletonCreator<Busy> {
+        template<class Event> void entry(const Event&) { RecorderType::add("Busy::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("Busy::Exit"); }
+
+        Activity activity() {
+          RecorderType::add("Activity::Started");
+          const Trigger::Data data = co_await next<Trigger::Data>();
+          received = data.value;
+          RecorderType::add("Activity::Data");
+
+          const bool arrived = co_await next<Trigger::Data, Trigger::Tick>(3);
+          RecorderType::add(arrived ? "Activity::Data" : "Activity::Timeout");
+
+          co_await after<Trigger::Tick>(2);
+          RecorderType::add("Activity::Done");
+        }
+
+        int received = 0;
+      };
+
+      // Frame does not fit, the activity is not started.
+      struct Tiny : CoroutineState<Tiny, StatePolicy, 1>, SingletonCreator<Tiny> {
+        Activity activity() {
+          co_await after<Trigger::Tick>(1);
+        }
+      };
+
+      // Waits for 0 ticks, which does not suspend.
+      struct Instant : CoroutineState<Instant, StatePolicy, 256>, SingletonCreator<Instant> {
+        Activity activity() {
+          const bool arrived = co_await next<Trigger::Data, Trigger::Tick>(0);
+          RecorderType::add(arrived ? "Activity::Data" : "Activity::Timeout");
+          co_await after<Trigger::Tick>(0);
+          RecorderType::add("Activity::Done");
+        }
+      };
+      using InstantSm = Statemachine<
+        Typelist<Transition<Trigger::Start, Instant, Idle, NoGuard, NoAction>,
+        NullType>,
+        InitialTransition<Idle, NoAction>>;
+
+      struct IsActivityDone {
+        template<class StateType, class EventType>
+        bool eval(const StateType& state, const EventType&) { return state.activityDone(); }
+      };
+
+      using ToBusyFromIdle = Transition<Trigger::Start, Busy, Idle, NoGuard, NoAction>;
+      using ToTinyFromIdle = Transition<Trigger::Abort, Tiny, Idle, NoGuard, NoAction>;
+      using ToIdleFromBusyDone = ChoiceTransition<Trigger::Tick, Idle, Busy, Busy, IsActivityDone, NoAction>;
+      using DataToBusy = Declaration<Trigger::Data, Busy>;
+      using ToIdleFromBusy = Transition<Trigger::Abort, Idle, Busy, NoGuard, NoAction>;
+      using Transitions =
+        Typelist<ToBusyFromIdle,
+        Typelist<ToTinyFromIdle,
+        Typelist<ToIdleFromBusyDone,
+        Typelist<DataToBusy,
+        Typelist<ToIdleFromBusy,
+        NullType>>>>>;
+      using InitTransition = InitialTransition<Idle, NoAction>;
+      using Sm = Statemachine<Transitions, InitTransition>;
+    }
+
+    BEGIN(CoroutineStateTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace CoroutineStateTestImpl;
+          RecorderType::reset();
+        })
+
+      TEST(
+        Entry,
+        CoroutineState,
+        ActivityRunsToFirstAwait)
+      {
+        using namespace CoroutineStateTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::Start>();
+
+        RecorderType::check({
+          "Busy::Entry",
+          "Activity::Started" });
+        RecorderType::checkUnchanged();
+      }
+
+      TEST(
+        Dispatch,
+        AwaitedEvents,
+        ActivityResumed)
+      {
+        using namespace CoroutineStateTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::Start>();
+        RecorderType::reset();
+
+        // Tick is not awaited
+        TRUE(sm.dispatch<Trigger::Tick>().consumed);
+        RecorderType::checkUnchanged();
+
+        sm.dispatch(Trigger::Data{ 42 });
+        RecorderType::check({ "Activity::Data" });
+        Sm::StatePolicy* busy = sm.dispatch<Trigger::Tick>().activeState;
+        EQ(42, static_cast<Busy*>(busy)->received);
+
+        sm.dispatch(Trigger::Data{ 1 });
+        RecorderType::check({ "Activity::Data" });
+
+        sm.dispatch<Trigger::Tick>();
+        RecorderType::checkUnchanged();
+        sm.dispatch<Trigger::Tick>();
+        RecorderType::check({ "Activity::Done" });
+
+        // Activity is done, choice leaves Busy
+        sm.dispatch<Trigger::Tick>();
+        RecorderType::check({ "Busy::Exit" });
+      }
+
+      TEST(
+        Dispatch,
+        AwaitWithTimeout,
+        ResumedAfterTicks)
+      {
+        using namespace CoroutineStateTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::Start>();
+        sm.dispatch(Trigger::Data{ 1 });
+        RecorderType::reset();
+
+        sm.dispatch<Trigger::Tick>();
+        sm.dispatch<Trigger::Tick>();
+        RecorderType::checkUnchanged();
+        sm.dispatch<Trigger::Tick>();
+        RecorderType::check({ "Activity::Timeout" });
+      }
+
+      TEST(
+        Exit,
+        ActivityRunning,
+        RestartedOnReentry)
+      {
+        using namespace CoroutineStateTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::Start>();
+        sm.dispatch(Trigger::Data{ 1 });
+        sm.dispatch<Trigger::Abort>();
+        RecorderType::reset();
+
+        sm.dispatch<Trigger::Start>();
+        RecorderType::check({
+          "Busy::Entry",
+          "Activity::Started" });
+
+        // The new activity waits for Data again
+        sm.dispatch<Trigger::Tick>();
+        sm.dispatch<Trigger::Tick>();
+        sm.dispatch<Trigger::Tick>();
+        RecorderType::checkUnchanged();
+      }
+
+      TEST(
+        Entry,
+        FrameTooSmall,
+        ActivityNotStarted)
+      {
+        using namespace CoroutineStateTestImpl;
+        Sm sm;
+        sm.begin();
+        Sm::StatePolicy* tiny = sm.dispatch<Trigger::Abort>().activeState;
+        TRUE(static_cast<Tiny*>(tiny)->activityDone());
+      }
+
+      TEST(
+        Entry,
+        AwaitZeroTicks,
+        ResumedWithoutTick)
+      {
+        using namespace CoroutineStateTestImpl;
+        InstantSm sm;
+        sm.begin();
+        Sm::StatePolicy* instant = sm.dispatch<Trigger::Start>().activeState;
+
+        RecorderType::check({
+          "Activity::Timeout",
+          "Activity::Done" });
+        TRUE(static_cast<Instant*>(instant)->activityDone());
+      }
+
+    END
+
+  }
+}
+#endif
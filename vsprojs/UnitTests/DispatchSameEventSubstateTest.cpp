@@ -195,7 +195,7 @@ namespace UT {
           "?<-BA",
           "BA::Do" });
 
-        auto result = sm.dispatch<Trigger::Count>();
+        sm.dispatch<Trigger::Count>();
         RecorderType::reset();
         sm.dispatch<Trigger::Count>();
         RecorderType::check({
@@ -0,0 +1,197 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/tsm.h"
+#include "TestHelpers.h"
+
+#if defined(_MSC_VER)
+#define STACK_NOINLINE __declspec(noinline)
+#else
+#define STACK_NOINLINE __attribute__((noinline))
+#endif
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace DispatchStackTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      namespace Trigger {
+        struct Toggle {};
+      }
+
+      // Level 1: Idle - Toggle -> Busy - Toggle -> Idle, after Pads transitions that are never taken.
+      template<int I>
+      struct Pad : BasicState<Pad<I>, StatePolicy>, SingletonCreator<Pad<I>> {};
+      struct Idle : BasicState<Idle, StatePolicy>, SingletonCreator<Idle> {};
+      struct Busy : BasicState<Busy, StatePolicy>, SingletonCreator<Busy> {};
+
+      template<int Pads>
+      struct PadTransitions {
+        typedef Typelist<Transition<Trigger::Toggle, Idle, Pad<Pads>, NoGuard, NoAction>, typename PadTransitions<Pads - 1>::Result> Result;
+      };
+      template<>
+      struct PadTransitions<0> {
+        typedef NullType Result;
+      };
+
+      // The transitions that are taken are the first ones, they are found last.
+      template<int Pads>
+      using Wide = Statemachine<
+        Typelist<Transition<Trigger::Toggle, Busy, Idle, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Toggle, Idle, Busy, NoGuard, NoAction>,
+        typename PadTransitions<Pads>::Result>>,
+        InitialTransition<Idle, NoAction>>;
+
+      // Level Depth: Holder<Depth>(level Depth - 1) declares Toggle.
+      template<int Depth>
+      struct Deep;
+      template<int Depth>
+      struct Holder : SubstatesHolderState<Holder<Depth>, StatePolicy, typename Deep<Depth - 1>::Result>, SingletonCreator<Holder<Depth>> {};
+      template<int Depth>
+      struct Deep {
+        typedef Statemachine<
+          Typelist<Declaration<Trigger::Toggle, Holder<Depth>>, NullType>,
+          InitialTransition<Holder<Depth>, NoAction>> Result;
+      };
+      template<>
+      struct Deep<1> {
+        typedef Wide<0> Result;
+      };
+
+      template<class Sm>
+      STACK_NOINLINE void begin(Sm& sm) {
+        sm.begin();
+      }
+
+      template<class Sm>
+      STACK_NOINLINE void toggle(Sm& sm) {
+        sm.template dispatch<Trigger::Toggle>();
+      }
+
+      template<class Sm>
+      STACK_NOINLINE void nothing(Sm&) {
+        volatile int n = 0;
+        (void)n;
+      }
+
+      /**
+        Bytes of stack below the frame of the measurement that the call takes: the stack below the
+        frame is painted, the call made and the deepest changed byte searched, all in one frame. The
+        painting loop must not call functions, the gap keeps it out of the frame's own locals.
+      */
+      enum : size_t { Area = 32 * 1024, Gap = 256 };
+      const unsigned char Pattern = 0xa5;
+
+      template<class Sm>
+      STACK_NOINLINE size_t stackBelow(void (*call)(Sm&), Sm& sm) {
+        volatile unsigned char marker = 0;
+        volatile unsigned char* lowest = (volatile unsigned char*)((uintptr_t)&marker - Gap - Area);
+        for (size_t n = 0; n < Area; n++) lowest[n] = Pattern;
+        call(sm);
+        size_t untouched = 0;
+        while (untouched < Area && lowest[untouched] == Pattern) untouched++;
+        return Area - untouched;
+      }
+
+      // Bytes of stack of the call, without the stack of a call that does nothing.
+      template<class Sm>
+      size_t stackOf(void (*call)(Sm&), Sm& sm) {
+        const size_t baseline = stackBelow(&nothing<Sm>, sm);
+        const size_t used = stackBelow(call, sm);
+        return used > baseline ? used - baseline : 0;
+      }
+
+      // The dispatchers visit the transitions in the order of the initializer-clauses of a braced-init-list.
+      template<int... I>
+      constexpr int visitOrder() {
+        int order = 0;
+        const int visited[] = { (order = order * 10 + I)... };
+        (void)visited;
+        return order;
+      }
+      static_assert(visitOrder<3, 2, 1>() == 321, "The initializer-clauses are not evaluated in order");
+
+      // The most stack of begin and of the Toggles after it.
+      template<class Sm>
+      size_t maxStack() {
+        Sm sm;
+        size_t stack = stackOf(&begin<Sm>, sm);
+        for (int n = 0; n < 4; n++) {
+          const size_t used = stackOf(&toggle<Sm>, sm);
+          if (used > stack) stack = used;
+        }
+        return stack;
+      }
+    }
+
+    BEGIN(DispatchStackTest)
+
+      TEST(
+        BracedInitializer,
+        PackExpansion,
+        EvaluatedInOrderAtRunTime)
+      {
+        using namespace DispatchStackTestImpl;
+        // Called through a pointer, so it is not evaluated at compile time
+        int (*volatile order)() = &visitOrder<3, 2, 1>;
+        EQ(321, order());
+      }
+
+      TEST(
+        ManyTransitions,
+        Dispatch,
+        StackDoesNotGrowWithTheTransitions)
+      {
+        using namespace DispatchStackTestImpl;
+        const size_t few = maxStack<Wide<0>>();
+        const size_t many = maxStack<Wide<60>>();
+
+        // One byte for each transition searched, a recursive search takes a frame for each.
+        TRUE(many <= few + 2 * 60);
+      }
+
+      TEST(
+        NestedStatemachines,
+        Dispatch,
+        StackWithinDispatchStackEstimate)
+      {
+        using namespace DispatchStackTestImpl;
+        const size_t stack1 = maxStack<Deep<1>::Result>();
+        const size_t stack2 = maxStack<Deep<2>::Result>();
+        const size_t stack4 = maxStack<Deep<4>::Result>();
+
+        TRUE(stack1 <= stack2);
+        TRUE(stack2 <= stack4);
+#if !defined(TSM_DISPATCH_PROBE)
+        // The probe of the host test harness is on the stack of the dispatch, hosttests.sh runs
+        // this test once more without it.
+        TRUE(stack1 <= (size_t)MachineTraits<Deep<1>::Result>::DispatchStackEstimate);
+        TRUE(stack2 <= (size_t)MachineTraits<Deep<2>::Result>::DispatchStackEstimate);
+        TRUE(stack4 <= (size_t)MachineTraits<Deep<4>::Result>::DispatchStackEstimate);
+        TRUE(maxStack<Wide<60>>() <= (size_t)MachineTraits<Wide<60>>::DispatchStackEstimate);
+#endif
+      }
+
+    END
+
+  }
+}
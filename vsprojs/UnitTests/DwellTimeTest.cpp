@@ -0,0 +1,175 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <thread>
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/dwelltime.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace DwellTimeTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      struct ManualClock {
+        static uint64_t now() { return time; }
+        static uint64_t time;
+      };
+      uint64_t ManualClock::time = 0;
+
+      namespace Trigger {
+        struct Toggle {};
+        struct Step {};
+      }
+
+      // Ready - Step -> Working
+      struct Ready : BasicState<Ready, StatePolicy>, SingletonCreator<Ready> {
+        static const char* name;
+      };
+      const char* Ready::name = "Ready";
+      struct Working : BasicState<Working, StatePolicy>, SingletonCreator<Working> {
+        static const char* name;
+      };
+      const char* Working::name = "Working";
+      struct InnerTag {};
+      using Inner = Statemachine<
+        Typelist<Transition<Trigger::Step, Working, Ready, NoGuard, NoAction>,
+        NullType>,
+        InitialTransition<Ready, NoAction>,
+        DwellTimeObserver<InnerTag, ManualClock>>;
+
+      // Off - Toggle -> On(Inner) - Toggle -> Off
+      struct Off : BasicState<Off, StatePolicy>, SingletonCreator<Off> {
+        static const char* name;
+      };
+      const char* Off::name = "Off";
+      struct On : SubstatesHolderState<On, StatePolicy, Inner>, SingletonCreator<On> {
+        static const char* name;
+      };
+      const char* On::name = "On";
+      struct OuterTag {};
+      using Sm = Statemachine<
+        Typelist<Transition<Trigger::Toggle, On, Off, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Toggle, Off, On, NoGuard, NoAction>,
+        Typelist<Declaration<Trigger::Step, On>,
+        NullType>>>,
+        InitialTransition<Off, NoAction>,
+        DwellTimeObserver<OuterTag, ManualClock>>;
+
+      // Off 0..10, On and Ready 10..15, On and Working 15..25, Off from 25.
+      void run(Sm& sm) {
+        ManualClock::time = 0;
+        sm.begin();
+        ManualClock::time = 10;
+        sm.dispatch<Trigger::Toggle>();
+        ManualClock::time = 15;
+        sm.dispatch<Trigger::Step>();
+        ManualClock::time = 25;
+        sm.dispatch<Trigger::Toggle>();
+      }
+    }
+
+    BEGIN(DwellTimeTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace DwellTimeTestImpl;
+          DwellTimes<Sm>::reset();
+          // Registers the shards of this thread outside of the dispatches, registering allocates.
+          impl::DwellShards<OuterTag>::local();
+          impl::DwellShards<InnerTag>::local();
+        })
+
+      TEST(
+        DwellTime,
+        Dispatch,
+        TicksAndEntriesOfAllLevels)
+      {
+        using namespace DwellTimeTestImpl;
+        Sm sm;
+        run(sm);
+
+        EQ((uint64_t)10, DwellTimes<Sm>::ticks<Off>());
+        EQ((uint64_t)2, DwellTimes<Sm>::entries<Off>());
+        EQ((uint64_t)15, DwellTimes<Sm>::ticks<On>());
+        EQ((uint64_t)5, DwellTimes<Sm>::ticks<Ready>());
+        EQ((uint64_t)10, DwellTimes<Sm>::ticks<Working>());
+        EQ((uint64_t)1, DwellTimes<Sm>::entries<Working>());
+      }
+
+      TEST(
+        DwellTime,
+        NotConsumedOrInternal,
+        SameStay)
+      {
+        using namespace DwellTimeTestImpl;
+        Sm sm;
+        ManualClock::time = 0;
+        sm.begin();
+        ManualClock::time = 3;
+        sm.dispatch<Trigger::Step>();
+        ManualClock::time = 7;
+        sm.dispatch<Trigger::Toggle>();
+
+        EQ((uint64_t)7, DwellTimes<Sm>::ticks<Off>());
+        EQ((uint64_t)1, DwellTimes<Sm>::entries<Off>());
+        EQ((uint64_t)0, DwellTimes<Sm>::ticks<On>());
+        EQ((uint64_t)1, DwellTimes<Sm>::entries<Ready>());
+      }
+
+      TEST(
+        DwellTime,
+        InstancesOnOtherThreads,
+        MergedOnRead)
+      {
+        using namespace DwellTimeTestImpl;
+        Sm sm;
+        run(sm);
+        // Singleton states are shared, so the instances run one after the other.
+        std::thread other([] { Sm sm; run(sm); });
+        other.join();
+
+        EQ((uint64_t)20, DwellTimes<Sm>::ticks<Off>());
+        EQ((uint64_t)2, DwellTimes<Sm>::entries<Working>());
+        EQ((uint64_t)20, DwellTimes<Sm>::ticks<Working>());
+      }
+
+      TEST(
+        DwellTime,
+        HeatMap,
+        ShareOfTheLevel)
+      {
+        using namespace DwellTimeTestImpl;
+        Sm sm;
+        run(sm);
+        const string dot = DwellTimes<Sm>::heatMap();
+
+        // Off 10 and On 15 of 25, Ready 5 and Working 10 of 15.
+        TRUE(dot.find("[label=\"Off\", style=\"rounded,filled\", fillcolor=\"0.000 0.400 1.000\", xlabel=\"40%\"];") != string::npos);
+        TRUE(dot.find("[label=\"On\", peripheries=2, style=\"rounded,filled\", fillcolor=\"0.000 0.600 1.000\", xlabel=\"60%\"];") != string::npos);
+        TRUE(dot.find("[label=\"Working\", style=\"rounded,filled\", fillcolor=\"0.000 0.667 1.000\", xlabel=\"67%\"];") != string::npos);
+      }
+
+    END
+
+  }
+}
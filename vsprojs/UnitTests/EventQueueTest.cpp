@@ -0,0 +1,259 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/eventqueue.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace EventQueueTestImpl {
+
+      using StatePolicy = State<VirtualTypeIdComparator, false>;
+
+      namespace Trigger {
+        struct Data {
+          uint8_t value;
+        };
+        struct Step {
+          enum { Priority = InternalLane };
+        };
+        struct Reset {
+          enum { Priority = UrgentLane };
+        };
+        struct Positionstream {
+          enum { Coalesce = LatestWins };
+          uint8_t position;
+        };
+        struct Timeout {
+          enum { Coalesce = CountMerge };
+          uint8_t count;
+        };
+      }
+      using Events =
+        Typelist<Trigger::Data,
+        Typelist<Trigger::Step,
+        Typelist<Trigger::Reset,
+        Typelist<Trigger::Positionstream,
+        Typelist<Trigger::Timeout,
+        NullType>>>>>;
+
+      struct Log {
+        static void add(char c) { text[length++] = c; }
+        static void clear() { length = 0; }
+        static char text[32];
+        static uint8_t length;
+      };
+      char Log::text[32] = {};
+      uint8_t Log::length = 0;
+
+      struct Idle : BasicState<Idle, StatePolicy>, FactoryCreator<Idle> {
+        uint8_t getTypeId() const override { return 1; }
+      };
+
+      struct Record {
+        template<class StateType>
+        void perform(StateType&, const Trigger::Data& ev) { Log::add((char)('0' + ev.value)); }
+        template<class StateType>
+        void perform(StateType&, const Trigger::Step&) { Log::add('s'); }
+        template<class StateType>
+        void perform(StateType&, const Trigger::Reset&) { Log::add('r'); }
+        template<class StateType>
+        void perform(StateType&, const Trigger::Positionstream& ev) { Log::add((char)('0' + ev.position)); }
+        template<class StateType>
+        void perform(StateType&, const Trigger::Timeout& ev) { Log::add((char)('a' + ev.count)); }
+      };
+
+      using Transitions =
+        Typelist<SelfTransition<Trigger::Data, Idle, NoGuard, Record, false>,
+        Typelist<SelfTransition<Trigger::Step, Idle, NoGuard, Record, false>,
+        Typelist<SelfTransition<Trigger::Reset, Idle, NoGuard, Record, false>,
+        Typelist<SelfTransition<Trigger::Positionstream, Idle, NoGuard, Record, false>,
+        Typelist<SelfTransition<Trigger::Timeout, Idle, NoGuard, Record, false>,
+        NullType>>>>>;
+      using InitTransition = InitialTransition<Idle, NoAction>;
+      using Sm = Statemachine<Transitions, InitTransition>;
+      using Queue = EventQueue<Sm, Events, 3, 4>;
+    }
+
+    BEGIN(EventQueueTest)
+
+      TEST(
+        EventPriority,
+        EventWithAndWithoutPriority,
+        LaneOfTheEvent)
+      {
+        using namespace EventQueueTestImpl;
+        EQ((int)ExternalLane, (int)EventPriority<Trigger::Data>::value);
+        EQ((int)InternalLane, (int)EventPriority<Trigger::Step>::value);
+        EQ((int)UrgentLane, (int)EventPriority<Trigger::Reset>::value);
+      }
+
+      TEST(
+        EventQueue,
+        EventsOfAllLanes,
+        HighestLaneFirstAndFifoInLane)
+      {
+        using namespace EventQueueTestImpl;
+        Log::clear();
+        Sm sm;
+        sm.begin();
+        Queue queue;
+        TRUE(queue.push(Trigger::Data{ 1 }));
+        TRUE(queue.push(Trigger::Step{}));
+        TRUE(queue.push(Trigger::Data{ 2 }));
+        TRUE(queue.push(Trigger::Reset{}));
+        FALSE(queue.empty());
+
+        EQ((uint16_t)4, queue.dispatchAll(sm));
+        TRUE(queue.empty());
+        EQ(0, strncmp("rs12", Log::text, Log::length));
+        EQ((uint32_t)2, queue.dispatched(ExternalLane));
+        EQ((uint32_t)1, queue.dispatched(UrgentLane));
+      }
+
+      TEST(
+        EventQueue,
+        LaneFull,
+        PushFails)
+      {
+        using namespace EventQueueTestImpl;
+        Queue queue;
+        for (uint8_t n = 0; n < 4; n++) {
+          TRUE(queue.push(Trigger::Data{ n }));
+        }
+        FALSE(queue.push(Trigger::Data{ 5 }));
+        TRUE(queue.push(Trigger::Step{}));
+        EQ((uint8_t)4, queue.size(ExternalLane));
+      }
+
+      TEST(
+        EventQueue,
+        HigherLanesDispatched,
+        WaitingLanesCountSkips)
+      {
+        using namespace EventQueueTestImpl;
+        Log::clear();
+        Sm sm;
+        sm.begin();
+        Queue queue;
+        queue.push(Trigger::Data{ 1 });
+        queue.push(Trigger::Step{});
+        queue.push(Trigger::Step{});
+        queue.push(Trigger::Reset{});
+
+        queue.dispatchOne(sm);
+        queue.dispatchOne(sm);
+        EQ((uint16_t)2, queue.skipped(ExternalLane));
+        EQ((uint16_t)0, queue.skipped(InternalLane));
+
+        queue.dispatchAll(sm);
+        EQ((uint16_t)0, queue.skipped(ExternalLane));
+        EQ((uint16_t)3, queue.maxSkipped(ExternalLane));
+        EQ((uint16_t)1, queue.maxSkipped(InternalLane));
+        FALSE(queue.dispatchOne(sm));
+      }
+
+      TEST(
+        EventQueue,
+        WrapAround,
+        OrderKept)
+      {
+        using namespace EventQueueTestImpl;
+        Log::clear();
+        Sm sm;
+        sm.begin();
+        Queue queue;
+        for (uint8_t n = 0; n < 3; n++) {
+          queue.push(Trigger::Data{ n });
+        }
+        queue.dispatchOne(sm);
+        queue.dispatchOne(sm);
+        queue.push(Trigger::Data{ 3 });
+        queue.push(Trigger::Data{ 4 });
+        queue.push(Trigger::Data{ 5 });
+        EQ((uint16_t)4, queue.dispatchAll(sm));
+        EQ(0, strncmp("012345", Log::text, Log::length));
+        EQ((uint8_t)6, Log::length);
+      }
+
+      TEST(
+        Coalescing,
+        EventWithAndWithoutCoalesce,
+        CoalescingOfTheEvent)
+      {
+        using namespace EventQueueTestImpl;
+        EQ((int)NotCoalesced, (int)Coalescing<Trigger::Data>::value);
+        EQ((int)LatestWins, (int)Coalescing<Trigger::Positionstream>::value);
+        EQ((int)CountMerge, (int)Coalescing<Trigger::Timeout>::value);
+      }
+
+      TEST(
+        EventQueue,
+        LatestWinsEventPending,
+        ReplacedInPlace)
+      {
+        using namespace EventQueueTestImpl;
+        Log::clear();
+        Sm sm;
+        sm.begin();
+        Queue queue;
+        queue.push(Trigger::Positionstream{ 1 });
+        queue.push(Trigger::Data{ 7 });
+        for (uint8_t n = 2; n < 6; n++) {
+          TRUE(queue.push(Trigger::Positionstream{ n }));
+        }
+        EQ((uint8_t)2, queue.size(ExternalLane));
+        EQ((uint32_t)4, queue.coalesced());
+
+        EQ((uint16_t)2, queue.dispatchAll(sm));
+        EQ(0, strncmp("57", Log::text, Log::length));
+        EQ((uint8_t)2, Log::length);
+      }
+
+      TEST(
+        EventQueue,
+        CountMergeEventPending,
+        CountsAdded)
+      {
+        using namespace EventQueueTestImpl;
+        Log::clear();
+        Sm sm;
+        sm.begin();
+        Queue queue;
+        queue.push(Trigger::Timeout{ 1 });
+        queue.push(Trigger::Timeout{ 1 });
+        queue.push(Trigger::Timeout{ 2 });
+        EQ((uint8_t)1, queue.size(ExternalLane));
+        EQ((uint16_t)1, queue.dispatchAll(sm));
+
+        // The next event of the type is pending again
+        queue.push(Trigger::Timeout{ 1 });
+        queue.push(Trigger::Timeout{ 1 });
+        EQ((uint16_t)1, queue.dispatchAll(sm));
+        EQ(0, strncmp("ec", Log::text, Log::length));
+        EQ((uint8_t)2, Log::length);
+        EQ((uint32_t)3, queue.coalesced());
+      }
+
+    END
+
+  }
+}
@@ -0,0 +1,145 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/eventrunner.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace EventRunnerTestImpl {
+
+      using StatePolicy = State<VirtualTypeIdComparator, false>;
+
+      namespace Trigger {
+        struct Count {
+          uint32_t sequence;
+        };
+      }
+      using Events = Typelist<Trigger::Count, NullType>;
+
+      // Only the runner writes, the test reads after flush.
+      struct Counting : BasicState<Counting, StatePolicy>, FactoryCreator<Counting> {
+        uint8_t getTypeId() const override { return 1; }
+        uint32_t count = 0;
+        uint32_t last = 0;
+        bool ordered = true;
+      };
+
+      struct Increment {
+        template<class StateType>
+        void perform(StateType& state, const Trigger::Count& ev) {
+          if (state.count > 0 && ev.sequence <= state.last) state.ordered = false;
+          state.last = ev.sequence;
+          state.count++;
+        }
+      };
+
+      using Transitions =
+        Typelist<SelfTransition<Trigger::Count, Counting, NoGuard, Increment, false>,
+        NullType>;
+      using InitTransition = InitialTransition<Counting, NoAction>;
+      using Sm = Statemachine<Transitions, InitTransition>;
+      using Runner = EventRunner<Sm, Events, 64>;
+
+      Counting& counting(Sm& sm) {
+        return *static_cast<Counting*>(sm._activeState());
+      }
+
+      template<class Condition>
+      bool waitFor(Condition condition) {
+        for (int n = 0; n < 1000 && !condition(); n++) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return condition();
+      }
+    }
+
+    BEGIN(EventRunnerTest)
+
+      TEST(
+        EventRunner,
+        EventsPostedFromSeveralThreads,
+        AllDispatchedInOrderPerThread)
+      {
+        using namespace EventRunnerTestImpl;
+        Sm sms[2];
+        sms[0].begin();
+        sms[1].begin();
+        {
+          Runner runner;
+          std::thread producers[2];
+          for (int p = 0; p < 2; p++) {
+            producers[p] = std::thread([&runner, &sms, p]() {
+              for (uint32_t n = 1; n <= 10000; n++) {
+                runner.post(sms[p], Trigger::Count{ n });
+              }
+            });
+          }
+          producers[0].join();
+          producers[1].join();
+          runner.flush();
+        }
+        EQ((uint32_t)10000, counting(sms[0]).count);
+        EQ((uint32_t)10000, counting(sms[1]).count);
+        TRUE(counting(sms[0]).ordered);
+        TRUE(counting(sms[1]).ordered);
+      }
+
+      TEST(
+        EventRunner,
+        Idle,
+        ParksAndIsWokenByNextEvent)
+      {
+        using namespace EventRunnerTestImpl;
+        Sm sm;
+        sm.begin();
+        Runner runner(std::chrono::microseconds(20));
+        TRUE(waitFor([&runner]() { return runner.parks() > 0; }));
+        EQ((uint64_t)0, runner.wakes());
+        TRUE(runner.spinLimit() < std::chrono::microseconds(20));
+
+        runner.post(sm, Trigger::Count{ 1 });
+        runner.flush();
+        EQ((uint32_t)1, counting(sm).count);
+        EQ((uint64_t)1, runner.wakes());
+      }
+
+      TEST(
+        EventRunner,
+        Destroyed,
+        PendingEventsDispatched)
+      {
+        using namespace EventRunnerTestImpl;
+        Sm sm;
+        sm.begin();
+        {
+          Runner runner;
+          for (uint32_t n = 1; n <= 100; n++) {
+            runner.post(sm, Trigger::Count{ n });
+          }
+        }
+        EQ((uint32_t)100, counting(sm).count);
+      }
+
+    END
+
+  }
+}
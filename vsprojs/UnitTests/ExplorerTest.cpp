@@ -0,0 +1,257 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/explorer.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace ExplorerTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      namespace Trigger {
+        struct Start {};
+        struct Stop {};
+        struct Fail {};
+        struct Tick {};
+      }
+
+      // Idle - Start -> Running - Stop -> Idle, Running - Fail -> Stuck, Orphan - Start -> Idle
+      struct Idle : BasicState<Idle, StatePolicy>, SingletonCreator<Idle> {};
+      struct Running : BasicState<Running, StatePolicy>, SingletonCreator<Running> {};
+      struct Stuck : BasicState<Stuck, StatePolicy>, SingletonCreator<Stuck> {};
+      struct Orphan : BasicState<Orphan, StatePolicy>, SingletonCreator<Orphan> {};
+      using Sm = Statemachine<
+        Typelist<Transition<Trigger::Start, Running, Idle, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Stop, Idle, Running, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Fail, Stuck, Running, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Start, Idle, Orphan, NoGuard, NoAction>,
+        NullType>>>>,
+        InitialTransition<Idle, NoAction>>;
+
+      // The counter of the persistent state is part of the configuration: Counting with 0..2, then Done.
+      // The action counts before the guard is evaluated.
+      struct Counting : BasicState<Counting, StatePolicy>, SingletonCreator<Counting> {
+        template<class Writer> void save(Writer& writer) const {
+          writer.write(&count, 1);
+        }
+        template<class Reader> bool restore(Reader& reader) {
+          return reader.readBytes(&count, 1) == 1;
+        }
+
+        uint8_t count = 0;
+      };
+      struct Done : BasicState<Done, StatePolicy>, SingletonCreator<Done> {};
+
+      struct Count {
+        template<class StateType, class EventType>
+        void perform(StateType& state, const EventType&) { state.count++; }
+      };
+      struct IsLast {
+        template<class StateType, class EventType>
+        bool eval(const StateType& state, const EventType&) { return state.count == 3; }
+      };
+
+      using CountingSm = Statemachine<
+        Typelist<ChoiceTransition<Trigger::Tick, Done, Counting, Counting, IsLast, Count>,
+        NullType>,
+        InitialTransition<Counting, NoAction>>;
+
+      // Hub - Start -> Idle, Hub - Stop -> Running, Hub - Fail -> Stuck: three configurations in one level.
+      struct Hub : BasicState<Hub, StatePolicy>, SingletonCreator<Hub> {};
+      using HubSm = Statemachine<
+        Typelist<Transition<Trigger::Start, Idle, Hub, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Stop, Running, Hub, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Fail, Stuck, Hub, NoGuard, NoAction>,
+        NullType>>>,
+        InitialTransition<Hub, NoAction>>;
+
+      // The field is not persistent, but the workers would write it at the same time.
+      struct Tally : BasicState<Tally, StatePolicy>, SingletonCreator<Tally> {
+        int visits = 0;
+      };
+      using TallySm = Statemachine<
+        Typelist<Transition<Trigger::Tick, Tally, Tally, NoGuard, NoAction>,
+        NullType>,
+        InitialTransition<Tally, NoAction>>;
+
+      // The snapshot with count 2 cannot be restored.
+      struct Fragile : BasicState<Fragile, StatePolicy>, SingletonCreator<Fragile> {
+        template<class Writer> void save(Writer& writer) const {
+          writer.write(&count, 1);
+        }
+        template<class Reader> bool restore(Reader& reader) {
+          return reader.readBytes(&count, 1) == 1 && count != 2;
+        }
+
+        uint8_t count = 0;
+      };
+      using FragileSm = Statemachine<
+        Typelist<ChoiceTransition<Trigger::Tick, Done, Fragile, Fragile, IsLast, Count>,
+        NullType>,
+        InitialTransition<Fragile, NoAction>>;
+    }
+  }
+}
+
+namespace tsmlib {
+  template<>
+  struct IsPersistent<UT::Classes::ExplorerTestImpl::Counting> {
+    enum { value = true };
+  };
+  template<>
+  struct IsPersistent<UT::Classes::ExplorerTestImpl::Fragile> {
+    enum { value = true };
+  };
+}
+
+namespace UT {
+  namespace Classes {
+
+    BEGIN(ExplorerTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace ExplorerTestImpl;
+          // begin does not reset the singleton.
+          Counting::CreatorType::create()->count = 0;
+          Fragile::CreatorType::create()->count = 0;
+        })
+
+      TEST(
+        Explorer,
+        Explore,
+        FindsUnreachableAndDeadEndStates)
+      {
+        using namespace ExplorerTestImpl;
+        Explorer<Sm> explorer;
+        TRUE(explorer.explore(1));
+
+        EQ((size_t)3, explorer.configurations());
+        EQ((uint64_t)3, explorer.edges());
+        EQ((uint64_t)0, explorer.terminated());
+        TRUE(explorer.reachable<Running>());
+        TRUE(explorer.reachable<Stuck>());
+        FALSE(explorer.reachable<Orphan>());
+        EQ((size_t)1, explorer.unreachableStates());
+        TRUE(explorer.deadEnd<Stuck>());
+        FALSE(explorer.deadEnd<Running>());
+        EQ((size_t)1, explorer.deadEndStates());
+      }
+
+      TEST(
+        Explorer,
+        Explore,
+        EventsConsumedByState)
+      {
+        using namespace ExplorerTestImpl;
+        // Events in the order of the transitions: Start, Stop, Fail.
+        Explorer<Sm> explorer;
+        explorer.explore(1);
+
+        EQ((uint64_t)1, explorer.consumedEvents<Idle>());
+        EQ((uint64_t)6, explorer.consumedEvents<Running>());
+        EQ((uint64_t)0, explorer.consumedEvents<Stuck>());
+      }
+
+      TEST(
+        Explorer,
+        ExploreInParallel,
+        SameResult)
+      {
+        using namespace ExplorerTestImpl;
+        Explorer<Sm> explorer;
+        TRUE(Explorer<Sm>::Parallel);
+        TRUE(explorer.explore(4));
+
+        EQ((size_t)3, explorer.configurations());
+        EQ((uint64_t)3, explorer.edges());
+        EQ((size_t)1, explorer.unreachableStates());
+        TRUE(explorer.deadEnd<Stuck>());
+      }
+
+      TEST(
+        Explorer,
+        PersistentState,
+        FieldsArePartOfTheConfiguration)
+      {
+        using namespace ExplorerTestImpl;
+        Explorer<CountingSm> explorer;
+        FALSE(Explorer<CountingSm>::Parallel);
+        TRUE(explorer.explore(4));
+
+        EQ((size_t)4, explorer.configurations());
+        EQ((uint64_t)3, explorer.edges());
+        TRUE(explorer.deadEnd<Done>());
+        FALSE(explorer.deadEnd<Counting>());
+      }
+
+      TEST(
+        Explorer,
+        MaxConfigurations,
+        Incomplete)
+      {
+        using namespace ExplorerTestImpl;
+        Explorer<CountingSm> explorer(3);
+        FALSE(explorer.explore(1));
+        FALSE(explorer.complete());
+      }
+
+      TEST(
+        Explorer,
+        MaxConfigurations,
+        CheckedForEachConfigurationFound)
+      {
+        using namespace ExplorerTestImpl;
+        Explorer<HubSm> explorer(2);
+        FALSE(explorer.explore(1));
+
+        EQ((size_t)2, explorer.configurations());
+        EQ((uint64_t)3, explorer.edges());
+      }
+
+      TEST(
+        Explorer,
+        SingletonWithField,
+        NotParallel)
+      {
+        using namespace ExplorerTestImpl;
+        FALSE(Explorer<TallySm>::Parallel);
+        TRUE(Explorer<HubSm>::Parallel);
+      }
+
+      TEST(
+        Explorer,
+        RestoreFails,
+        Incomplete)
+      {
+        using namespace ExplorerTestImpl;
+        Explorer<FragileSm> explorer;
+        FALSE(explorer.explore(1));
+        FALSE(explorer.deadEnd<Fragile>());
+      }
+
+    END
+
+  }
+}
@@ -0,0 +1,372 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/tsm.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace FlatStatemachineTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+      using RecorderType = Recorder<sizeof(__FILE__) + __LINE__>;
+      template<class Derived> struct Leaf : BasicState<Derived, StatePolicy, true, true, true>, SingletonCreatorFake<Derived> {};
+      template<class Derived, class Statemachine> struct Composite : SubstatesHolderState<Derived, StatePolicy, Statemachine, true, true>, SingletonCreatorFake<Derived> {};
+
+      struct InitialStateFake : StatePolicy {
+        using Policy = StatePolicy;
+        static const char* name;
+      };
+      const char* InitialStateFake::name = "*";
+
+      namespace Trigger
+      {
+        struct B_A {};
+        struct A_B {};
+        struct B_AA {};
+        struct B_AAB {};
+        struct AAB_AAA {};
+        struct Unhandled {};
+      }
+
+      struct B : Leaf<B> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("B::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("B::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add("B::Do"); }
+      };
+      const char* B::name = "B";
+
+      struct AAA : Leaf<AAA> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("AAA::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("AAA::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add("AAA::Do"); }
+      };
+      const char* AAA::name = "AAA";
+
+      struct AAB : Leaf<AAB> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("AAB::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("AAB::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add("AAB::Do"); }
+      };
+      const char* AAB::name = "AAB";
+
+      using ToAABfromAAA = Transition<Trigger::AAB_AAA, AAB, AAA, NoGuard, ActionSpy<AAB, AAA, RecorderType>>;
+      using ToBfromAAB = ExitTransition<Trigger::B_AAB, B, AAB, NoGuard, ActionSpy<B, AAB, RecorderType>>;
+      using ToFinalFromAAA = FinalTransition<AAA>;
+      using ToFinalFromAAB = FinalTransition<AAB>;
+      using TransitionsAA =
+        Typelist<ToAABfromAAA,
+        Typelist<ToBfromAAB,
+        Typelist<ToFinalFromAAA,
+        Typelist<ToFinalFromAAB,
+        NullType>>>>;
+      using InitAA = InitialTransition<AAA, ActionSpy<AAA, InitialStateFake, RecorderType>>;
+      using SmAA = Statemachine<TransitionsAA, InitAA>;
+
+      struct AA : Composite<AA, SmAA> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("AA::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("AA::Exit"); }
+      };
+      const char* AA::name = "AA";
+
+      using ToBfromAA = ExitTransition<Trigger::B_AA, B, AA, NoGuard, ActionSpy<B, AA, RecorderType>>;
+      using ToFinalFromAA = FinalTransition<AA>;
+      using DeclToAABfromAAA1 = Declaration<Trigger::AAB_AAA, AA>;
+      using DeclToBfromAAB1 = Declaration<Trigger::B_AAB, AA>;
+      using TransitionsA =
+        Typelist<ToBfromAA,
+        Typelist<ToFinalFromAA,
+        Typelist<DeclToAABfromAAA1,
+        Typelist<DeclToBfromAAB1,
+        NullType>>>>;
+      using InitA = InitialTransition<AA, ActionSpy<AA, InitialStateFake, RecorderType>>;
+      using SmA = Statemachine<TransitionsA, InitA>;
+
+      struct A : Composite<A, SmA> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("A::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("A::Exit"); }
+      };
+      const char* A::name = "A";
+
+      using ToBfromA = Transition<Trigger::B_A, B, A, NoGuard, ActionSpy<B, A, RecorderType>>;
+      using ToAfromB = Transition<Trigger::A_B, A, B, NoGuard, ActionSpy<A, B, RecorderType>>;
+      using ToFinalFromA = FinalTransition<A>;
+      using ToFinalFromB = FinalTransition<B>;
+      using DeclToAABfromAAA = Declaration<Trigger::AAB_AAA, A>;
+      using DeclToBfromAA = ExitDeclaration<Trigger::B_AA, B, A>;
+      using DeclToBfromAAB = ExitDeclaration<Trigger::B_AAB, B, A>;
+      using Transitions =
+        Typelist<ToBfromA,
+        Typelist< ToAfromB,
+        Typelist<ToFinalFromA,
+        Typelist<ToFinalFromB,
+        Typelist<DeclToAABfromAAA,
+        Typelist<DeclToBfromAA,
+        Typelist<DeclToBfromAAB,
+        NullType>>>>>>>;
+      using InitTransition = InitialTransition<A, ActionSpy<A, InitialStateFake, RecorderType>>;
+      using Sm = FlatStatemachine<Transitions, InitTransition>;
+
+      template<class Path>
+      uint8_t configurationOf() {
+        return LokiLight::IndexOf<Sm::Configurations, Path>::Result;
+      }
+      using A_AA_AAA = Typelist<A, Typelist<AA, Typelist<AAA, NullType>>>;
+      using A_AA_AAB = Typelist<A, Typelist<AA, Typelist<AAB, NullType>>>;
+      using B_ = Typelist<B, NullType>;
+
+      // Remembers the last index published on the level Tag.
+      template<class Tag>
+      struct LastIndexObserver {
+        void publish(uint8_t index) { last = index; }
+        static uint8_t last;
+      };
+      template<class Tag> uint8_t LastIndexObserver<Tag>::last = 0xff;
+
+      // Off - Toggle -> On(Ready - Step -> Working)
+      namespace Observed {
+        struct Toggle {};
+        struct Step {};
+        struct Ready : BasicState<Ready, StatePolicy>, SingletonCreator<Ready> {};
+        struct Working : BasicState<Working, StatePolicy>, SingletonCreator<Working> {};
+        struct InnerTag {};
+        using Inner = Statemachine<
+          Typelist<Transition<Step, Working, Ready, NoGuard, NoAction>, NullType>,
+          InitialTransition<Ready, NoAction>,
+          LastIndexObserver<InnerTag>>;
+        struct Off : BasicState<Off, StatePolicy>, SingletonCreator<Off> {};
+        struct On : SubstatesHolderState<On, StatePolicy, Inner>, SingletonCreator<On> {};
+        struct OuterTag {};
+        using FlatSm = FlatStatemachine<
+          Typelist<Transition<Toggle, On, Off, NoGuard, NoAction>,
+          Typelist<Declaration<Step, On>,
+          NullType>>,
+          InitialTransition<Off, NoAction>,
+          LastIndexObserver<OuterTag>>;
+      }
+    }
+
+    BEGIN(FlatStatemachineTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace FlatStatemachineTestImpl;
+          RecorderType::reset();
+
+          SingletonCreatorFake<A>::reset();
+          SingletonCreatorFake<AA>::reset();
+          SingletonCreatorFake<AAA>::reset();
+          SingletonCreatorFake<AAB>::reset();
+          SingletonCreatorFake<B>::reset();
+        })
+
+      TEST(
+        NestedStatemachines,
+        Flattened,
+        OneConfigurationPerLeafState)
+      {
+        using namespace FlatStatemachineTestImpl;
+        using Configs = Sm::Configurations;
+        const int indexAAA = LokiLight::IndexOf<Configs, A_AA_AAA>::Result;
+        const int indexAAB = LokiLight::IndexOf<Configs, A_AA_AAB>::Result;
+        const int indexB = LokiLight::IndexOf<Configs, B_>::Result;
+
+        EQ(3, (int)Sm::NumberOfConfigurations);
+        NEQ(-1, indexAAA);
+        NEQ(-1, indexAAB);
+        NEQ(-1, indexB);
+      }
+
+      TEST(
+        Begin,
+        InitStateA,
+        ActiveConfigurationAAA)
+      {
+        using namespace FlatStatemachineTestImpl;
+        Sm sm;
+        EQ((uint8_t)Sm::NumberOfConfigurations, sm.configuration());
+
+        sm.begin();
+        RecorderType::check({
+          "A<-*",
+          "A::Entry",
+          "AA<-*",
+          "AA::Entry",
+          "AAA<-*",
+          "AAA::Entry",
+          "AAA::Do" });
+
+        EQ(configurationOf<A_AA_AAA>(), sm.configuration());
+      }
+
+      TEST(
+        Dispatch,
+        TransitionOnThirdLevel,
+        NoExitOnHigherLevels)
+      {
+        using namespace FlatStatemachineTestImpl;
+        Sm sm;
+        sm.begin();
+
+        RecorderType::reset();
+        auto result = sm.dispatch<Trigger::AAB_AAA>();
+        TRUE(result.consumed);
+
+        RecorderType::check({
+          "AAB<-AAA",
+          "AAA::Exit",
+          "AAB::Entry",
+          "AAB::Do" });
+        EQ(configurationOf<A_AA_AAB>(), sm.configuration());
+      }
+
+      TEST(
+        Dispatch,
+        TransitionThirdToTopLevel,
+        SameCallsAsStatemachine)
+      {
+        using namespace FlatStatemachineTestImpl;
+        Sm sm;
+        sm.begin();
+
+        sm.dispatch<Trigger::AAB_AAA>();
+
+        RecorderType::reset();
+        auto result = sm.dispatch<Trigger::B_AAB>();
+        TRUE(result.consumed);
+
+        RecorderType::check({
+          "B<-AAB",
+          "AAB::Exit",
+          "AA::Exit",
+          "A::Exit",
+          "B::Entry",
+          "B::Do" });
+        EQ(configurationOf<B_>(), sm.configuration());
+
+        // Active state is B
+        EQ(SingletonCreatorFake<A>::createCalls, SingletonCreatorFake<A>::deleteCalls);
+        EQ(SingletonCreatorFake<AA>::createCalls, SingletonCreatorFake<AA>::deleteCalls);
+        EQ(SingletonCreatorFake<AAA>::createCalls, SingletonCreatorFake<AAA>::deleteCalls);
+        EQ(SingletonCreatorFake<AAB>::createCalls, SingletonCreatorFake<AAB>::deleteCalls);
+        EQ(SingletonCreatorFake<B>::createCalls, SingletonCreatorFake<B>::deleteCalls + 1);
+      }
+
+      TEST(
+        Dispatch,
+        TransitionToCompositeState,
+        InitialConfiguration)
+      {
+        using namespace FlatStatemachineTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::AAB_AAA>();
+        sm.dispatch<Trigger::B_AA>();
+
+        RecorderType::reset();
+        auto result = sm.dispatch<Trigger::A_B>();
+        TRUE(result.consumed);
+
+        RecorderType::check({
+          "A<-B",
+          "B::Exit",
+          "A::Entry",
+          "AA<-*",
+          "AA::Entry",
+          "AAA<-*",
+          "AAA::Entry",
+          "AAA::Do" });
+        EQ(configurationOf<A_AA_AAA>(), sm.configuration());
+      }
+
+      TEST(
+        Dispatch,
+        UnhandledEvent,
+        ConfigurationUnchanged)
+      {
+        using namespace FlatStatemachineTestImpl;
+        Sm sm;
+        sm.begin();
+
+        RecorderType::reset();
+        auto result = sm.dispatch<Trigger::Unhandled>();
+        FALSE(result.consumed);
+        RecorderType::checkUnchanged();
+
+        result = sm.dispatch<Trigger::A_B>();
+        FALSE(result.consumed);
+        RecorderType::checkUnchanged();
+
+        EQ(configurationOf<A_AA_AAA>(), sm.configuration());
+      }
+
+      TEST(
+        End,
+        ThirdLevel,
+        ExitIsCalled)
+      {
+        using namespace FlatStatemachineTestImpl;
+        Sm sm;
+        sm.begin();
+
+        RecorderType::reset();
+
+        sm.end();
+        RecorderType::check({
+          "AAA::Exit",
+          "AA::Exit",
+          "A::Exit" });
+        EQ((uint8_t)Sm::NumberOfConfigurations, sm.configuration());
+
+        auto result = sm.dispatch<Trigger::B_A>();
+        FALSE(result.consumed);
+        N(result.activeState);
+      }
+
+      TEST(
+        Observer,
+        TransitionsOnAllLevels,
+        EachLevelPublished)
+      {
+        using namespace FlatStatemachineTestImpl::Observed;
+        using FlatStatemachineTestImpl::LastIndexObserver;
+        FlatSm sm;
+        sm.begin();
+        EQ((uint8_t)0, LastIndexObserver<OuterTag>::last);
+
+        sm.dispatch<Toggle>();
+        EQ((uint8_t)1, LastIndexObserver<OuterTag>::last);
+        EQ((uint8_t)0, LastIndexObserver<InnerTag>::last);
+
+        sm.dispatch<Step>();
+        EQ((uint8_t)1, LastIndexObserver<InnerTag>::last);
+      }
+
+    END
+
+  }
+}
@@ -0,0 +1,142 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/instancestatemachine.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace InstanceStatemachineTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      namespace Trigger {
+        struct Toggle {};
+        struct Step {};
+      }
+
+      struct Counting {
+        template<class StateType, class Event>
+        void perform(StateType& state, const Event&) { state.count++; }
+      };
+
+      // Nested: Ready - Step -> Busy - Step -> Ready
+      struct Ready : BasicState<Ready, StatePolicy>, InstanceCreator<Ready> {
+        uint32_t count = 0;
+      };
+      struct Busy : BasicState<Busy, StatePolicy>, InstanceCreator<Busy> {
+        uint32_t count = 0;
+      };
+      using Nested = Statemachine<
+        Typelist<Transition<Trigger::Step, Busy, Ready, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Step, Ready, Busy, NoGuard, Counting>,
+        NullType>>,
+        InitialTransition<Ready, NoAction>>;
+
+      struct Off : BasicState<Off, StatePolicy>, InstanceCreator<Off> {
+        uint32_t count = 0;
+      };
+      struct On : SubstatesHolderState<On, StatePolicy, Nested>, InstanceCreator<On> {};
+
+      using Transitions =
+        Typelist<Transition<Trigger::Toggle, On, Off, NoGuard, Counting>,
+        Typelist<Transition<Trigger::Toggle, Off, On, NoGuard, NoAction>,
+        Typelist<Declaration<Trigger::Step, On>,
+        NullType>>>;
+      using Sm = InstanceStatemachine<Transitions, InitialTransition<Off, NoAction>>;
+    }
+
+    BEGIN(InstanceStatemachineTest)
+
+      TEST(
+        InstanceStatemachine,
+        Layout,
+        AlignedAndPaddedToCacheLine)
+      {
+        using namespace InstanceStatemachineTestImpl;
+        EQ((size_t)64, alignof(Sm));
+        EQ((size_t)Sm::InstanceSize, sizeof(Sm));
+        EQ((size_t)0, sizeof(Sm) % 64);
+
+        Sm sms[2];
+        EQ((ptrdiff_t)sizeof(Sm), reinterpret_cast<char*>(&sms[1]) - reinterpret_cast<char*>(&sms[0]));
+        TRUE(reinterpret_cast<char*>(&sms[0].state<Busy>()) - reinterpret_cast<char*>(&sms[0]) < (ptrdiff_t)sizeof(Sm));
+      }
+
+      TEST(
+        InstanceStatemachine,
+        TwoInstances,
+        EachHasItsOwnStateObjects)
+      {
+        using namespace InstanceStatemachineTestImpl;
+        Sm a;
+        Sm b;
+        a.begin();
+        b.begin();
+        TRUE(a._activeState() == &a.state<Off>());
+        TRUE(b._activeState() == &b.state<Off>());
+
+        a.dispatch<Trigger::Toggle>();
+        TRUE(a._activeState() == &a.state<On>());
+        TRUE(a.typeOf<On>());
+        TRUE(b.typeOf<Off>());
+
+        a.dispatch<Trigger::Step>();
+        a.dispatch<Trigger::Step>();
+        a.dispatch<Trigger::Toggle>();
+        TRUE(a.typeOf<Off>());
+        EQ((uint32_t)1, a.state<Off>().count);
+        EQ((uint32_t)1, a.state<Busy>().count);
+        EQ((uint32_t)0, b.state<Off>().count);
+        EQ((uint32_t)0, b.state<Busy>().count);
+      }
+
+      TEST(
+        InstanceStatemachine,
+        Copied,
+        CopyDispatchesItsOwnStateObjects)
+      {
+        using namespace InstanceStatemachineTestImpl;
+        Sm a;
+        a.begin();
+        a.dispatch<Trigger::Toggle>();
+        a.dispatch<Trigger::Step>();
+
+        Sm b(a);
+        TRUE(b._activeState() == &b.state<On>());
+        TRUE(b.typeOf<On>());
+        TRUE(b.dispatch<Trigger::Step>().consumed);
+        EQ((uint32_t)1, b.state<Busy>().count);
+        EQ((uint32_t)0, a.state<Busy>().count);
+
+        // a is still in Busy
+        Sm c;
+        c = a;
+        TRUE(c.dispatch<Trigger::Step>().consumed);
+        TRUE(c.dispatch<Trigger::Toggle>().consumed);
+        TRUE(c.typeOf<Off>());
+        TRUE(a.typeOf<On>());
+      }
+
+    END
+
+  }
+}
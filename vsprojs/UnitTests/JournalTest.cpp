@@ -0,0 +1,305 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/journal.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace JournalTestImpl {
+
+      using StatePolicy = State<VirtualTypeIdComparator, false>;
+
+      namespace Trigger {
+        struct On {
+          uint16_t brightness;
+        };
+        struct Off {};
+        struct Unrecorded {};
+      }
+      using Events = Typelist<Trigger::On, Typelist<Trigger::Off, NullType>>;
+
+      struct Off : BasicState<Off, StatePolicy>, FactoryCreator<Off> {
+        uint8_t getTypeId() const override { return 1; }
+      };
+      struct On : BasicState<On, StatePolicy>, FactoryCreator<On> {
+        uint8_t getTypeId() const override { return 2; }
+      };
+
+      struct Dimmer {
+        template<class StateType>
+        void perform(StateType&, const Trigger::On& ev) { brightness = ev.brightness; }
+        static uint16_t brightness;
+      };
+      uint16_t Dimmer::brightness = 0;
+
+      using ToOnFromOff = Transition<Trigger::On, On, Off, NoGuard, Dimmer>;
+      using ToOffFromOn = Transition<Trigger::Off, Off, On, NoGuard, NoAction>;
+      using Transitions =
+        Typelist<ToOnFromOff,
+        Typelist<ToOffFromOn,
+        NullType>>;
+      using InitTransition = InitialTransition<Off, NoAction>;
+      using Sm = Statemachine<Transitions, InitTransition>;
+
+      struct Machines {
+        Sm* operator()(uint32_t machineId) { return machineId < 3 ? &sms[machineId] : nullptr; }
+        Sm sms[3];
+      };
+    }
+
+    BEGIN(JournalTest)
+
+      TEST(
+        Writer,
+        EventsAppended,
+        WrittenInBatches)
+      {
+        using namespace JournalTestImpl;
+        uint8_t buffer[256] = {};
+        BufferWriter file(buffer, sizeof(buffer));
+        {
+          JournalWriter<Events, BufferWriter, 32> journal(file);
+          // Header (8 bytes) and two records (8 + 2 bytes, 8 bytes) fit into the buffer
+          journal.append(0, Trigger::On{ 100 });
+          journal.append(1, Trigger::Off{});
+          EQ((size_t)0, file.position);
+
+          journal.append(2, Trigger::Off{});
+          EQ((size_t)26, file.position);
+        }
+        EQ((size_t)34, file.position);
+      }
+
+      TEST(
+        Writer,
+        WriterFull,
+        BufferKeptAndFailed)
+      {
+        using namespace JournalTestImpl;
+        uint8_t buffer[256] = {};
+        BufferWriter full(buffer, 4);
+        Machines live;
+        live.sms[0].begin();
+        JournalWriter<Events, BufferWriter, 32> journal(full);
+        journal.append(0, Trigger::On{ 100 });
+        journal.append(1, Trigger::Off{});
+        FALSE(journal.flush());
+        FALSE(journal.failed());
+
+        // The buffer is still full, the event is dispatched but not recorded
+        TRUE(journal.dispatch(live.sms[0], 0, Trigger::On{ 10 }).consumed);
+        TRUE(journal.failed());
+
+        // The kept bytes are written once the writer takes them
+        full.size = sizeof(buffer);
+        TRUE(journal.flush());
+        EQ((size_t)26, full.position);
+      }
+
+      TEST(
+        Reader,
+        Replay,
+        SameStatesAsDispatched)
+      {
+        using namespace JournalTestImpl;
+        uint8_t buffer[256] = {};
+        BufferWriter file(buffer, sizeof(buffer));
+        Machines live;
+        {
+          JournalWriter<Events, BufferWriter, 32> journal(file);
+          for (uint32_t n = 0; n < 3; n++) {
+            live.sms[n].begin();
+          }
+          TRUE(journal.dispatch(live.sms[0], 0, Trigger::On{ 10 }).consumed);
+          journal.dispatch(live.sms[1], 1, Trigger::On{ 20 });
+          journal.dispatch(live.sms[1], 1, Trigger::Off{});
+          journal.dispatch(live.sms[2], 2, Trigger::On{ 30 });
+        }
+
+        Dimmer::brightness = 0;
+        Machines replayed;
+        for (uint32_t n = 0; n < 3; n++) {
+          replayed.sms[n].begin();
+        }
+        JournalReader<Events> reader;
+        TRUE(reader.attach(buffer, file.position));
+        EQ((size_t)4, reader.replay<Sm>(replayed));
+
+        TRUE(replayed.sms[0]._activeState()->typeOf<On>());
+        TRUE(replayed.sms[1]._activeState()->typeOf<Off>());
+        TRUE(replayed.sms[2]._activeState()->typeOf<On>());
+        EQ((uint16_t)30, Dimmer::brightness);
+      }
+
+      TEST(
+        Reader,
+        Partitions,
+        EachMachineInOnePart)
+      {
+        using namespace JournalTestImpl;
+        uint8_t buffer[256] = {};
+        BufferWriter file(buffer, sizeof(buffer));
+        {
+          JournalWriter<Events, BufferWriter> journal(file);
+          journal.append(0, Trigger::On{ 1 });
+          journal.append(1, Trigger::On{ 2 });
+          journal.append(2, Trigger::On{ 3 });
+          journal.append(7, Trigger::On{ 4 });
+        }
+
+        Machines machines;
+        for (uint32_t n = 0; n < 3; n++) {
+          machines.sms[n].begin();
+        }
+        JournalReader<Events> reader;
+        TRUE(reader.attach(buffer, file.position));
+        EQ((size_t)2, reader.replay<Sm>(machines, 0, 2));
+        TRUE(machines.sms[0]._activeState()->typeOf<On>());
+        TRUE(machines.sms[1]._activeState()->typeOf<Off>());
+        TRUE(machines.sms[2]._activeState()->typeOf<On>());
+
+        // Machine 7 is unknown
+        EQ((size_t)1, reader.replay<Sm>(machines, 1, 2));
+        TRUE(machines.sms[1]._activeState()->typeOf<On>());
+      }
+
+      TEST(
+        Reader,
+        TruncatedRecord,
+        ReplayEndsBeforeIt)
+      {
+        using namespace JournalTestImpl;
+        uint8_t buffer[256] = {};
+        BufferWriter file(buffer, sizeof(buffer));
+        {
+          JournalWriter<Events, BufferWriter> journal(file);
+          journal.append(0, Trigger::On{ 1 });
+          journal.append(0, Trigger::Off{});
+        }
+
+        Machines machines;
+        machines.sms[0].begin();
+        JournalReader<Events> reader;
+        TRUE(reader.attach(buffer, file.position - 1));
+        EQ((size_t)1, reader.replay<Sm>(machines));
+        TRUE(machines.sms[0]._activeState()->typeOf<On>());
+      }
+
+      TEST(
+        Reader,
+        OtherEvents,
+        AttachFails)
+      {
+        using namespace JournalTestImpl;
+        uint8_t buffer[64] = {};
+        BufferWriter file(buffer, sizeof(buffer));
+        {
+          JournalWriter<Events, BufferWriter> journal(file);
+        }
+
+        using OtherEvents = Typelist<Trigger::On, Typelist<Trigger::Off, Typelist<Trigger::Unrecorded, NullType>>>;
+        JournalReader<OtherEvents> reader;
+        FALSE(reader.attach(buffer, file.position));
+        FALSE(reader.attach(buffer, 4));
+      }
+
+      TEST(
+        Reader,
+        PayloadSizeOfOtherEvent,
+        ReplayEndsBeforeIt)
+      {
+        using namespace JournalTestImpl;
+        uint8_t buffer[256] = {};
+        BufferWriter file(buffer, sizeof(buffer));
+        {
+          JournalWriter<Events, BufferWriter> journal(file);
+          journal.append(0, Trigger::On{ 1 });
+          journal.append(0, Trigger::Off{});
+        }
+        // The payload size of the first record (header 8 bytes, then machineId and eventId)
+        impl::JournalRecord record;
+        memcpy(&record, buffer + 8, sizeof(record));
+        record.payloadSize = 1;
+        memcpy(buffer + 8, &record, sizeof(record));
+
+        Machines machines;
+        machines.sms[0].begin();
+        JournalReader<Events> reader;
+        TRUE(reader.attach(buffer, file.position));
+        EQ((size_t)0, reader.replay<Sm>(machines));
+        TRUE(machines.sms[0]._activeState()->typeOf<Off>());
+      }
+
+      TEST(
+        Reader,
+        NoParts,
+        NothingReplayed)
+      {
+        using namespace JournalTestImpl;
+        uint8_t buffer[256] = {};
+        BufferWriter file(buffer, sizeof(buffer));
+        {
+          JournalWriter<Events, BufferWriter> journal(file);
+          journal.append(0, Trigger::On{ 1 });
+        }
+
+        Machines machines;
+        machines.sms[0].begin();
+        JournalReader<Events> reader;
+        TRUE(reader.attach(buffer, file.position));
+        EQ((size_t)0, reader.replay<Sm>(machines, 0, 0));
+        EQ((size_t)0, reader.replayParallel<Sm>(machines, 0));
+        TRUE(machines.sms[0]._activeState()->typeOf<Off>());
+      }
+
+#if defined(__unix__) || defined(__APPLE__)
+      TEST(
+        FileWriter,
+        Reopened,
+        EventsAppended)
+      {
+        using namespace JournalTestImpl;
+        const char* path = "JournalTest.journal";
+        unlink(path);
+        for (uint32_t n = 0; n < 2; n++) {
+          FileWriter file;
+          TRUE(file.open(path));
+          JournalWriter<Events, FileWriter> journal(file);
+          journal.append(n, Trigger::On{ 1 });
+        }
+
+        Machines machines;
+        machines.sms[0].begin();
+        machines.sms[1].begin();
+        MappedJournal<Events> mapped;
+        TRUE(mapped.open(path));
+        EQ((size_t)2, mapped.reader().replay<Sm>(machines));
+        TRUE(machines.sms[1]._activeState()->typeOf<On>());
+        mapped.close();
+        unlink(path);
+      }
+#endif
+
+    END
+
+  }
+}
@@ -0,0 +1,224 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/machineregistry.h"
+#include "../../src/instancestatemachine.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace MachineRegistryTestImpl {
+
+      using StatePolicy = State<VirtualTypeIdComparator, false>;
+
+      namespace Trigger {
+        struct Toggle {};
+      }
+
+      struct Off : BasicState<Off, StatePolicy>, FactoryCreator<Off> {
+        uint8_t getTypeId() const override { return 1; }
+      };
+      struct On : BasicState<On, StatePolicy>, FactoryCreator<On> {
+        uint8_t getTypeId() const override { return 2; }
+      };
+
+      using ToOnFromOff = Transition<Trigger::Toggle, On, Off, NoGuard, NoAction>;
+      using ToOffFromOn = Transition<Trigger::Toggle, Off, On, NoGuard, NoAction>;
+      using Transitions =
+        Typelist<ToOnFromOff,
+        Typelist<ToOffFromOn,
+        NullType>>;
+      using InitTransition = InitialTransition<Off, NoAction>;
+      using Sm = Statemachine<Transitions, InitTransition>;
+      using Registry = MachineRegistry<Sm, 4>;
+
+      // Idle(Running: Slow - Toggle -> Fast), without exit or final transitions.
+      struct Slow : BasicState<Slow, StatePolicy>, FactoryCreatorFake<Slow> {
+        uint8_t getTypeId() const override { return 3; }
+      };
+      struct Fast : BasicState<Fast, StatePolicy>, FactoryCreatorFake<Fast> {
+        uint8_t getTypeId() const override { return 4; }
+      };
+      using Running = Statemachine<
+        Typelist<Transition<Trigger::Toggle, Fast, Slow, NoGuard, NoAction>,
+        NullType>,
+        InitialTransition<Slow, NoAction>>;
+      struct Idle : SubstatesHolderState<Idle, StatePolicy, Running>, FactoryCreatorFake<Idle> {
+        uint8_t getTypeId() const override { return 5; }
+      };
+      using SmWithoutExit = Statemachine<
+        Typelist<Declaration<Trigger::Toggle, Idle>,
+        NullType>,
+        InitialTransition<Idle, NoAction>>;
+
+      // Counter: Zero - Toggle -> One, the states are in the instance.
+      using InstancePolicy = State<MemoryAddressComparator, true>;
+      struct Zero : BasicState<Zero, InstancePolicy>, InstanceCreator<Zero> {};
+      struct One : BasicState<One, InstancePolicy>, InstanceCreator<One> {};
+      using Counter = InstanceStatemachine<
+        Typelist<Transition<Trigger::Toggle, One, Zero, NoGuard, NoAction>,
+        NullType>,
+        InitialTransition<Zero, NoAction>>;
+    }
+
+    BEGIN(MachineRegistryTest)
+
+      TEST(
+        MachineRegistry,
+        Created,
+        FoundByHandle)
+      {
+        using namespace MachineRegistryTestImpl;
+        Registry registry;
+        const uint32_t a = registry.create();
+        const uint32_t b = registry.create();
+        NEQ((uint32_t)Registry::NullHandle, a);
+        NEQ(a, b);
+        EQ((uint32_t)2, registry.size());
+
+        Sm* sm = registry.get(a);
+        NN(sm);
+        sm->begin();
+        sm->dispatch<Trigger::Toggle>();
+        TRUE(registry.get(a)->_activeState()->typeOf<On>());
+        N(registry.get(b)->_activeState());
+        N(registry.get(Registry::NullHandle));
+      }
+
+      TEST(
+        MachineRegistry,
+        Destroyed,
+        HandleIsStaleAndSlotReused)
+      {
+        using namespace MachineRegistryTestImpl;
+        Registry registry;
+        const uint32_t a = registry.create();
+        registry.get(a)->begin();
+        TRUE(registry.destroy(a));
+        N(registry.get(a));
+        FALSE(registry.destroy(a));
+
+        const uint32_t b = registry.create();
+        NEQ(a, b);
+        EQ(a & 0xFFFF, b & 0xFFFF);
+        N(registry.get(a));
+        NN(registry.get(b));
+      }
+
+      TEST(
+        MachineRegistry,
+        Full,
+        CreateReturnsNullHandle)
+      {
+        using namespace MachineRegistryTestImpl;
+        Registry registry;
+        for (int n = 0; n < 4; n++) {
+          NEQ((uint32_t)Registry::NullHandle, registry.create());
+        }
+        EQ((uint32_t)Registry::NullHandle, registry.create());
+      }
+
+      TEST(
+        MachineRegistry,
+        MiddleMachineDestroyed,
+        LastMovedIntoGapAndStillFound)
+      {
+        using namespace MachineRegistryTestImpl;
+        Registry registry;
+        uint32_t handles[3];
+        for (int n = 0; n < 3; n++) {
+          handles[n] = registry.create();
+          registry.get(handles[n])->begin();
+        }
+        registry.get(handles[2])->dispatch<Trigger::Toggle>();
+
+        registry.destroy(handles[0]);
+        EQ((uint32_t)2, registry.size());
+        TRUE(registry.get(handles[2]) == &registry.data()[0]);
+        EQ(handles[2], registry.handleAt(0));
+        EQ(handles[1], registry.handleAt(1));
+        TRUE(registry.get(handles[2])->_activeState()->typeOf<On>());
+
+        registry.broadcast(Trigger::Toggle{});
+        TRUE(registry.get(handles[1])->_activeState()->typeOf<On>());
+        TRUE(registry.get(handles[2])->_activeState()->typeOf<Off>());
+      }
+
+      TEST(
+        MachineRegistry,
+        DestroyedWithoutExitTransitions,
+        StatesOfAllLevelsDestroyed)
+      {
+        using namespace MachineRegistryTestImpl;
+        FactoryCreatorFake<Idle>::reset();
+        FactoryCreatorFake<Slow>::reset();
+        FactoryCreatorFake<Fast>::reset();
+        {
+          MachineRegistry<SmWithoutExit, 2> registry;
+          const uint32_t a = registry.create();
+          registry.get(a)->begin();
+          registry.get(a)->dispatch<Trigger::Toggle>();
+          TRUE(registry.destroy(a));
+        }
+
+        EQ(FactoryCreatorFake<Idle>::createCalls, FactoryCreatorFake<Idle>::deleteCalls);
+        EQ(FactoryCreatorFake<Slow>::createCalls, FactoryCreatorFake<Slow>::deleteCalls);
+        EQ(FactoryCreatorFake<Fast>::createCalls, FactoryCreatorFake<Fast>::deleteCalls);
+      }
+
+      TEST(
+        MachineRegistry,
+        InstanceStatemachineMovedIntoGap,
+        DispatchesItsOwnStateObjects)
+      {
+        using namespace MachineRegistryTestImpl;
+        MachineRegistry<Counter, 2> registry;
+        const uint32_t a = registry.create();
+        const uint32_t b = registry.create();
+        registry.get(a)->begin();
+        registry.get(b)->begin();
+
+        registry.destroy(a);
+        Counter* sm = registry.get(b);
+        TRUE(sm == &registry.data()[0]);
+        TRUE(sm->typeOf<Zero>());
+        TRUE(sm->dispatch<Trigger::Toggle>().consumed);
+        TRUE(sm->_activeState() == &sm->state<One>());
+      }
+
+      TEST(
+        MachineRegistry,
+        Handle64,
+        StaleAfterDestroy)
+      {
+        using namespace MachineRegistryTestImpl;
+        MachineRegistry<Sm, 2, uint64_t> registry;
+        const uint64_t a = registry.create();
+        EQ((uint64_t)1 << 32, a);
+        registry.destroy(a);
+        N(registry.get(a));
+        EQ(((uint64_t)2 << 32), registry.create());
+      }
+
+    END
+
+  }
+}
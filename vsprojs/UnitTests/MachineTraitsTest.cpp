@@ -0,0 +1,130 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/tsm.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace MachineTraitsTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      namespace Trigger {
+        struct Toggle {};
+        struct Step {};
+        struct Reset {};
+      }
+
+      // Innermost: Idle - Step -> Running
+      struct Idle : BasicState<Idle, StatePolicy>, SingletonCreator<Idle> {
+        uint32_t data[4];
+      };
+      struct Running : BasicState<Running, StatePolicy>, FactoryCreator<Running> {
+        uint32_t data[16];
+      };
+      using Inner = Statemachine<
+        Typelist<Transition<Trigger::Step, Running, Idle, NoGuard, NoAction>, NullType>,
+        InitialTransition<Idle, NoAction>>;
+
+      // Middle: Ready - Step -> Working(Inner) - Reset -> Ready
+      struct Ready : BasicState<Ready, StatePolicy>, SingletonCreator<Ready> {};
+      struct Working : SubstatesHolderState<Working, StatePolicy, Inner>, SingletonCreator<Working> {};
+      using Middle = Statemachine<
+        Typelist<Transition<Trigger::Step, Working, Ready, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Reset, Ready, Working, NoGuard, NoAction>,
+        Typelist<Declaration<Trigger::Step, Working>,
+        NullType>>>,
+        InitialTransition<Ready, NoAction>>;
+
+      // Outer: Off - Toggle -> On(Middle) - Toggle -> Off
+      struct Off : BasicState<Off, StatePolicy>, SingletonCreator<Off> {};
+      struct On : SubstatesHolderState<On, StatePolicy, Middle>, SingletonCreator<On> {};
+      using Outer = Statemachine<
+        Typelist<Transition<Trigger::Toggle, On, Off, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Toggle, Off, On, NoGuard, NoAction>,
+        Typelist<Declaration<Trigger::Step, On>,
+        Typelist<Declaration<Trigger::Reset, On>,
+        NullType>>>>,
+        InitialTransition<Off, NoAction>>;
+
+      using Traits = MachineTraits<Outer>;
+      using InnerTraits = MachineTraits<Inner>;
+
+      static_assert(FitsRamBudget<Inner, sizeof(Idle) + sizeof(Inner)>::value, "Budget is exactly met");
+      static_assert(!FitsRamBudget<Inner, sizeof(Idle) + sizeof(Inner) - 1>::value, "Budget is exceeded by one byte");
+    }
+
+    BEGIN(MachineTraitsTest)
+
+      TEST(
+        MachineTraits,
+        FlatStatemachine,
+        CountsItsLevel)
+      {
+        using namespace MachineTraitsTestImpl;
+        EQ((size_t)2, (size_t)InnerTraits::NumberOfStates);
+        EQ((size_t)1, (size_t)InnerTraits::NumberOfTransitions);
+        EQ((size_t)1, (size_t)InnerTraits::NumberOfEvents);
+        EQ((size_t)1, (size_t)InnerTraits::NestingDepth);
+      }
+
+      TEST(
+        MachineTraits,
+        NestedStatemachines,
+        CountsAllLevels)
+      {
+        using namespace MachineTraitsTestImpl;
+        EQ((size_t)6, (size_t)Traits::NumberOfStates);
+        EQ((size_t)8, (size_t)Traits::NumberOfTransitions);
+        EQ((size_t)3, (size_t)Traits::NumberOfEvents);
+        EQ((size_t)3, (size_t)Traits::NestingDepth);
+      }
+
+      TEST(
+        MachineTraits,
+        Ram,
+        SingletonsAndInstanceButNoFactoryStates)
+      {
+        using namespace MachineTraitsTestImpl;
+        EQ(sizeof(Idle), (size_t)InnerTraits::SingletonRam);
+        EQ(sizeof(Inner), (size_t)InnerTraits::InstanceRam);
+        EQ(sizeof(Idle) + sizeof(Ready) + sizeof(Working) + sizeof(Off) + sizeof(On), (size_t)Traits::SingletonRam);
+        EQ(sizeof(Outer), (size_t)Traits::InstanceRam);
+        EQ((size_t)Traits::SingletonRam + (size_t)Traits::InstanceRam, (size_t)Traits::Ram);
+      }
+
+      TEST(
+        FitsRamBudget,
+        Exceeded,
+        BytesAboveBudget)
+      {
+        using namespace MachineTraitsTestImpl;
+        using Fits = FitsRamBudget<Outer, 4096>;
+        using ExceededByOne = FitsRamBudget<Outer, Traits::Ram - 1>;
+        EQ((size_t)0, (size_t)Fits::Exceeded);
+        EQ((size_t)1, (size_t)ExceededByOne::Exceeded);
+      }
+
+    END
+
+  }
+}
@@ -35,6 +35,7 @@
   
   Begin test scenario.
   name: class name
+  An optional second argument, e.g. the link to the diagram, is ignored.
   BEGIN(name)
   
   End test scenario.
@@ -47,6 +48,7 @@
   
   Test name followed by the method body.
   given, when, then: steps
+  An optional fourth argument, e.g. the link to the diagram, is ignored.
   TEST(given, when, then)
   
   Assert are equal.
@@ -70,10 +72,10 @@
 
 #ifdef MS_CPP_UNITTESTFRAMEWORK
 
-#define BEGIN(name) TEST_CLASS(name) {
+#define BEGIN(name, ...) TEST_CLASS(name) {
 #define END };
 #define INIT(name, definition) TEST_METHOD_INITIALIZE(name) definition
-#define TEST(given, when, then) TEST_METHOD(GIVEN_##given##_WHEN_##when##_THEN_##then)
+#define TEST(given, when, then, ...) TEST_METHOD(GIVEN_##given##_WHEN_##when##_THEN_##then)
 #define EQ(a, b) Microsoft::VisualStudio::CppUnitTestFramework::Assert::AreEqual(a, b)
 #define NEQ(a, b) Microsoft::VisualStudio::CppUnitTestFramework::Assert::AreNotEqual(a, b)
 #define TRUE(a) Microsoft::VisualStudio::CppUnitTestFramework::Assert::IsTrue(a)
@@ -81,12 +83,12 @@
 #define N(a) Microsoft::VisualStudio::CppUnitTestFramework::Assert::IsNull(a)
 #define NN(a) Microsoft::VisualStudio::CppUnitTestFramework::Assert::IsNotNull(a)
 
-#else defined(ARDUINO_UNIT_TESTS)
+#else // defined(ARDUINO_UNIT_TESTS)
 
-#define BEGIN(name)
+#define BEGIN(name, ...)
 #define END
 #define INIT(name, definition)
-#define TEST(given, when, then) test(GIVEN_##given##_WHEN_##when##_THEN_##then)
+#define TEST(given, when, then, ...) test(GIVEN_##given##_WHEN_##when##_THEN_##then)
 #define EQ(a, b) assertEqual(a, b)
 #define NEQ(a, b) assertNotEqual(a, b)
 #define TRUE(a) assertTrue(a)
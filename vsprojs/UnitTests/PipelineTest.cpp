@@ -0,0 +1,155 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/pipeline.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace PipelineTestImpl {
+
+      using StatePolicy = State<VirtualTypeIdComparator, false>;
+
+      namespace Trigger {
+        struct Number {
+          uint32_t value;
+        };
+        struct Doubled {
+          uint32_t value;
+        };
+        struct Stored {
+          uint32_t value;
+        };
+        struct Unknown {};
+      }
+
+      // Parser: doubles the numbers
+      struct Parsing : BasicState<Parsing, StatePolicy>, FactoryCreator<Parsing> {
+        uint8_t getTypeId() const override { return 1; }
+      };
+      struct Double {
+        template<class StateType>
+        void perform(StateType&, const Trigger::Number& ev) { emit(Trigger::Doubled{ 2 * ev.value }); }
+      };
+      using ParserSm = Statemachine<
+        Typelist<SelfTransition<Trigger::Number, Parsing, NoGuard, Double, false>, NullType>,
+        InitialTransition<Parsing, NoAction>>;
+
+      // Session: forwards the values and counts them
+      struct Active : BasicState<Active, StatePolicy>, FactoryCreator<Active> {
+        uint8_t getTypeId() const override { return 2; }
+        uint32_t count = 0;
+        bool unknownEmitted = true;
+      };
+      struct Forward {
+        template<class StateType>
+        void perform(StateType& state, const Trigger::Doubled& ev) {
+          state.count++;
+          emit(Trigger::Stored{ ev.value });
+          state.unknownEmitted = emit(Trigger::Unknown{});
+        }
+      };
+      using SessionSm = Statemachine<
+        Typelist<SelfTransition<Trigger::Doubled, Active, NoGuard, Forward, false>, NullType>,
+        InitialTransition<Active, NoAction>>;
+
+      // Persistence: sums up, the last stage
+      struct Storing : BasicState<Storing, StatePolicy>, FactoryCreator<Storing> {
+        uint8_t getTypeId() const override { return 3; }
+        uint64_t sum = 0;
+        bool lastEmitted = true;
+      };
+      struct Sum {
+        template<class StateType>
+        void perform(StateType& state, const Trigger::Stored& ev) {
+          state.sum += ev.value;
+          state.lastEmitted = emit(Trigger::Number{ 0 });
+          calls++;
+        }
+        static std::atomic<uint32_t> calls;
+      };
+      std::atomic<uint32_t> Sum::calls{ 0 };
+      using PersistenceSm = Statemachine<
+        Typelist<SelfTransition<Trigger::Stored, Storing, NoGuard, Sum, false>, NullType>,
+        InitialTransition<Storing, NoAction>>;
+
+      using Parser = PipelineStage<ParserSm, Typelist<Trigger::Number, NullType>, 4>;
+      using Session = PipelineStage<SessionSm, Typelist<Trigger::Doubled, NullType>, 4>;
+      using Persistence = PipelineStage<PersistenceSm, Typelist<Trigger::Stored, NullType>, 4>;
+      using Chain = Pipeline<Parser, Session, Persistence>;
+    }
+
+    BEGIN(PipelineTest)
+
+      TEST(
+        Pipeline,
+        EventsPosted,
+        PassedThroughAllStages)
+      {
+        using namespace PipelineTestImpl;
+        Chain pipeline;
+        for (uint32_t n = 1; n <= 1000; n++) {
+          pipeline.post(Trigger::Number{ n });
+        }
+        pipeline.flush();
+
+        EQ((uint64_t)1000, pipeline.stage<0>().processed());
+        EQ((uint64_t)1000, pipeline.stage<2>().processed());
+        EQ((size_t)0, pipeline.stage<1>().depth());
+        TRUE(pipeline.stage<1>().maxDepth() <= 4);
+
+        Active* active = static_cast<Active*>(pipeline.stage<1>().statemachine()._activeState());
+        EQ((uint32_t)1000, active->count);
+        FALSE(active->unknownEmitted);
+        Storing* storing = static_cast<Storing*>(pipeline.stage<2>().statemachine()._activeState());
+        EQ((uint64_t)1001000, storing->sum);
+        FALSE(storing->lastEmitted);
+      }
+
+      TEST(
+        Pipeline,
+        Destroyed,
+        EventsInFlightDispatched)
+      {
+        using namespace PipelineTestImpl;
+        Sum::calls = 0;
+        {
+          Chain pipeline;
+          for (uint32_t n = 1; n <= 100; n++) {
+            pipeline.post(Trigger::Number{ n });
+          }
+        }
+        EQ((uint32_t)100, Sum::calls.load());
+      }
+
+      TEST(
+        Emit,
+        OutsideOfPipeline,
+        ReturnsFalse)
+      {
+        using namespace PipelineTestImpl;
+        FALSE(emit(Trigger::Number{ 1 }));
+      }
+
+    END
+
+  }
+}
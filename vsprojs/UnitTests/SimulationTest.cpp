@@ -0,0 +1,190 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/simulation.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace SimulationTestImpl {
+
+      // Compares with typeid, so the instances can have their own On with its own nested state machine.
+      using StatePolicy = State<RttiComparator, false>;
+
+      namespace Trigger {
+        struct Toggle {};
+        struct Step {};
+        struct Reset {};
+      }
+
+      // Ready - Step -> Working - Reset -> Ready
+      struct Ready : BasicState<Ready, StatePolicy>, SingletonCreator<Ready> {};
+      struct Working : BasicState<Working, StatePolicy>, SingletonCreator<Working> {};
+      using Inner = Statemachine<
+        Typelist<Transition<Trigger::Step, Working, Ready, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Reset, Ready, Working, NoGuard, NoAction>,
+        NullType>>,
+        InitialTransition<Ready, NoAction>>;
+
+      // Off - Toggle -> On(Inner) - Toggle -> Off
+      struct Off : BasicState<Off, StatePolicy>, SingletonCreator<Off> {};
+      struct On : SubstatesHolderState<On, StatePolicy, Inner>, FactoryCreator<On> {};
+      using Sm = Statemachine<
+        Typelist<Transition<Trigger::Toggle, On, Off, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Toggle, Off, On, NoGuard, NoAction>,
+        Typelist<Declaration<Trigger::Step, On>,
+        Typelist<Declaration<Trigger::Reset, On>,
+        NullType>>>>,
+        InitialTransition<Off, NoAction>>;
+
+      using Events = Typelist<Trigger::Toggle, Typelist<Trigger::Step, Typelist<Trigger::Reset, NullType>>>;
+      using Sim = Simulation<Sm, Events>;
+
+      const uint8_t OffConfiguration = impl::ConfigurationIndex<Sim::Configurations, Typelist<Off, NullType>>::value;
+      const uint8_t ReadyConfiguration = impl::ConfigurationIndex<Sim::Configurations, Typelist<On, Typelist<Ready, NullType>>>::value;
+      const uint8_t WorkingConfiguration = impl::ConfigurationIndex<Sim::Configurations, Typelist<On, Typelist<Working, NullType>>>::value;
+    }
+
+    BEGIN(SimulationTest)
+
+      TEST(
+        Simulation,
+        PeriodicEvent,
+        DispatchedToAllInstancesOnTheVirtualClock)
+      {
+        using namespace SimulationTestImpl;
+        Sim sim(3, 1);
+        sim.begin();
+        sim.every<Trigger::Toggle>(10, 10);
+
+        EQ((uint64_t)30, sim.run(100));
+        EQ((uint64_t)100, sim.now());
+        EQ((uint64_t)30, sim.dispatched<Trigger::Toggle>());
+        EQ((uint64_t)30, sim.consumed<Trigger::Toggle>());
+        EQ(OffConfiguration, sim.configuration(2));
+      }
+
+      TEST(
+        Simulation,
+        PeriodicEvent,
+        OccupancyAndTransitionsOfAllInstances)
+      {
+        using namespace SimulationTestImpl;
+        Sim sim(3, 1);
+        sim.begin();
+        sim.every<Trigger::Toggle>(10, 10);
+        sim.run(100);
+
+        EQ((uint64_t)150, sim.occupancy(OffConfiguration));
+        EQ((uint64_t)150, sim.occupancy(ReadyConfiguration));
+        EQ((uint64_t)0, sim.occupancy(WorkingConfiguration));
+        EQ((uint64_t)15, sim.transitions(OffConfiguration, ReadyConfiguration));
+        EQ((uint64_t)15, sim.transitions(ReadyConfiguration, OffConfiguration));
+      }
+
+      TEST(
+        Simulation,
+        SingleEvents,
+        NestedConfigurationOfOneInstance)
+      {
+        using namespace SimulationTestImpl;
+        Sim sim(2, 1);
+        sim.begin();
+        sim.at<Trigger::Toggle>(5, 1);
+        sim.at<Trigger::Step>(8, 1);
+        sim.at<Trigger::Step>(9, 0);
+
+        EQ((uint64_t)3, sim.run(10));
+        EQ(OffConfiguration, sim.configuration(0));
+        EQ(WorkingConfiguration, sim.configuration(1));
+        EQ((uint64_t)15, sim.occupancy(OffConfiguration));
+        EQ((uint64_t)3, sim.occupancy(ReadyConfiguration));
+        EQ((uint64_t)2, sim.occupancy(WorkingConfiguration));
+        EQ((uint64_t)2, sim.dispatched<Trigger::Step>());
+        EQ((uint64_t)1, sim.consumed<Trigger::Step>());
+      }
+
+      TEST(
+        Simulation,
+        IntervalsThatNeverAdvanceTheClock,
+        Rejected)
+      {
+        using namespace SimulationTestImpl;
+        Sim sim(2, 1);
+        sim.begin();
+        FALSE(sim.every<Trigger::Toggle>(0));
+        FALSE(sim.randomly<Trigger::Toggle>(0, 0));
+        FALSE(sim.randomly<Trigger::Toggle>(20, 10));
+        TRUE(sim.randomly<Trigger::Step>(0, 1));
+
+        // Intervals of 0 or 1 still advance the clock, each instance gets at least 100 Steps
+        TRUE(sim.run(100) >= (uint64_t)200);
+        EQ((uint64_t)0, sim.dispatched<Trigger::Toggle>());
+      }
+
+      TEST(
+        Simulation,
+        EventInThePastOrForUnknownInstance,
+        Rejected)
+      {
+        using namespace SimulationTestImpl;
+        Sim sim(2, 1);
+        sim.begin();
+        EQ((uint64_t)0, sim.run(50));
+        FALSE(sim.at<Trigger::Toggle>(49, 0));
+        FALSE(sim.at<Trigger::Toggle>(60, 2));
+        TRUE(sim.at<Trigger::Toggle>(50, 1));
+
+        EQ((uint64_t)1, sim.run(100));
+        EQ((uint64_t)100, sim.now());
+        EQ((uint64_t)1, sim.dispatched<Trigger::Toggle>());
+      }
+
+      TEST(
+        Simulation,
+        RandomEvents,
+        SameSeedSameRun)
+      {
+        using namespace SimulationTestImpl;
+        Sim first(16, 42);
+        Sim second(16, 42);
+        Sim other(16, 43);
+        for (Sim* sim : { &first, &second, &other }) {
+          sim->begin();
+          sim->randomly<Trigger::Toggle>(50, 150);
+          sim->randomly<Trigger::Step>(1, 20);
+          sim->randomly<Trigger::Reset>(10, 30);
+          sim->run(100000);
+        }
+
+        EQ(first.consumed<Trigger::Step>(), second.consumed<Trigger::Step>());
+        EQ(first.occupancy(WorkingConfiguration), second.occupancy(WorkingConfiguration));
+        for (size_t n = 0; n < first.instances(); n++) {
+          EQ(first.configuration(n), second.configuration(n));
+        }
+        NEQ(first.occupancy(WorkingConfiguration), other.occupancy(WorkingConfiguration));
+        EQ((uint64_t)16 * 100000, first.occupancy(OffConfiguration) + first.occupancy(ReadyConfiguration) + first.occupancy(WorkingConfiguration));
+      }
+
+    END
+
+  }
+}
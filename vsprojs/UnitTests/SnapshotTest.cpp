@@ -0,0 +1,365 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/tsm.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace SnapshotTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+      using RecorderType = Recorder<sizeof(__FILE__) + __LINE__>;
+      template<class Derived> struct Leaf : BasicState<Derived, StatePolicy, true, true, true>, SingletonCreatorFake<Derived> {};
+      template<class Derived, class Statemachine> struct Composite : SubstatesHolderState<Derived, StatePolicy, Statemachine, true, true>, SingletonCreatorFake<Derived> {};
+
+      struct InitialStateFake : StatePolicy {
+        using Policy = StatePolicy;
+        static const char* name;
+      };
+      const char* InitialStateFake::name = "*";
+
+      namespace Trigger
+      {
+        struct B_A {};
+        struct A_B {};
+        struct B_AA {};
+        struct B_AAB {};
+        struct AAB_AAA {};
+        struct Unhandled {};
+      }
+
+      struct B : Leaf<B> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("B::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("B::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add("B::Do"); counter++; }
+
+        template<class Writer> void save(Writer& writer) const {
+          writer.write(&counter, 1);
+        }
+        template<class Reader> bool restore(Reader& reader) {
+          return reader.readBytes(&counter, 1) == 1;
+        }
+
+        uint8_t counter = 0;
+      };
+      const char* B::name = "B";
+
+      struct AAA : Leaf<AAA> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("AAA::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("AAA::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add("AAA::Do"); }
+      };
+      const char* AAA::name = "AAA";
+
+      struct AAB : Leaf<AAB> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("AAB::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("AAB::Exit"); }
+        template<class Event> void doit(const Event&) { RecorderType::add("AAB::Do"); }
+      };
+      const char* AAB::name = "AAB";
+
+      using ToAABfromAAA = Transition<Trigger::AAB_AAA, AAB, AAA, NoGuard, ActionSpy<AAB, AAA, RecorderType>>;
+      using ToBfromAAB = ExitTransition<Trigger::B_AAB, B, AAB, NoGuard, ActionSpy<B, AAB, RecorderType>>;
+      using ToFinalFromAAA = FinalTransition<AAA>;
+      using ToFinalFromAAB = FinalTransition<AAB>;
+      using TransitionsAA =
+        Typelist<ToAABfromAAA,
+        Typelist<ToBfromAAB,
+        Typelist<ToFinalFromAAA,
+        Typelist<ToFinalFromAAB,
+        NullType>>>>;
+      using InitAA = InitialTransition<AAA, ActionSpy<AAA, InitialStateFake, RecorderType>>;
+      using SmAA = Statemachine<TransitionsAA, InitAA>;
+
+      struct AA : Composite<AA, SmAA> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("AA::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("AA::Exit"); }
+      };
+      const char* AA::name = "AA";
+
+      using ToBfromAA = ExitTransition<Trigger::B_AA, B, AA, NoGuard, ActionSpy<B, AA, RecorderType>>;
+      using ToFinalFromAA = FinalTransition<AA>;
+      using DeclToAABfromAAA1 = Declaration<Trigger::AAB_AAA, AA>;
+      using DeclToBfromAAB1 = Declaration<Trigger::B_AAB, AA>;
+      using TransitionsA =
+        Typelist<ToBfromAA,
+        Typelist<ToFinalFromAA,
+        Typelist<DeclToAABfromAAA1,
+        Typelist<DeclToBfromAAB1,
+        NullType>>>>;
+      using InitA = InitialTransition<AA, ActionSpy<AA, InitialStateFake, RecorderType>>;
+      using SmA = Statemachine<TransitionsA, InitA>;
+
+      struct A : Composite<A, SmA> {
+        static const char* name;
+        template<class Event> void entry(const Event&) { RecorderType::add("A::Entry"); }
+        template<class Event> void exit(const Event&) { RecorderType::add("A::Exit"); }
+      };
+      const char* A::name = "A";
+
+      using ToBfromA = Transition<Trigger::B_A, B, A, NoGuard, ActionSpy<B, A, RecorderType>>;
+      using ToAfromB = Transition<Trigger::A_B, A, B, NoGuard, ActionSpy<A, B, RecorderType>>;
+      using ToFinalFromA = FinalTransition<A>;
+      using ToFinalFromB = FinalTransition<B>;
+      using DeclToAABfromAAA = Declaration<Trigger::AAB_AAA, A>;
+      using DeclToBfromAA = ExitDeclaration<Trigger::B_AA, B, A>;
+      using DeclToBfromAAB = ExitDeclaration<Trigger::B_AAB, B, A>;
+      using Transitions =
+        Typelist<ToBfromA,
+        Typelist< ToAfromB,
+        Typelist<ToFinalFromA,
+        Typelist<ToFinalFromB,
+        Typelist<DeclToAABfromAAA,
+        Typelist<DeclToBfromAA,
+        Typelist<DeclToBfromAAB,
+        NullType>>>>>>>;
+      using InitTransition = InitialTransition<A, ActionSpy<A, InitialStateFake, RecorderType>>;
+      using Sm = Statemachine<Transitions, InitTransition>;
+      using FlatSm = FlatStatemachine<Transitions, InitTransition>;
+    }
+  }
+}
+
+namespace tsmlib {
+  template<>
+  struct IsPersistent<UT::Classes::SnapshotTestImpl::B> {
+    enum { value = true };
+  };
+}
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    BEGIN(SnapshotTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace SnapshotTestImpl;
+          RecorderType::reset();
+
+          SingletonCreatorFake<A>::reset();
+          SingletonCreatorFake<AA>::reset();
+          SingletonCreatorFake<AAA>::reset();
+          SingletonCreatorFake<AAB>::reset();
+          SingletonCreatorFake<B>::reset();
+        })
+
+      TEST(
+        Save,
+        ThirdLevel,
+        OneIndexPerLevel)
+      {
+        using namespace SnapshotTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::AAB_AAA>();
+
+        uint8_t buffer[8] = {};
+        BufferWriter writer(buffer, sizeof(buffer));
+        sm.save(writer);
+
+        EQ((size_t)4, writer.position);
+        EQ((uint8_t)impl::SnapshotVersion, buffer[0]);
+        EQ((uint8_t)0, buffer[1]); // A
+        EQ((uint8_t)0, buffer[2]); // AA
+        EQ((uint8_t)1, buffer[3]); // AAB
+      }
+
+      TEST(
+        Restore,
+        ThirdLevel,
+        NoEntryCalled)
+      {
+        using namespace SnapshotTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::AAB_AAA>();
+
+        uint8_t buffer[8] = {};
+        BufferWriter writer(buffer, sizeof(buffer));
+        sm.save(writer);
+        sm.end();
+
+        RecorderType::reset();
+        Sm restored;
+        BufferReader reader(buffer, writer.position);
+        TRUE(restored.restore(reader));
+        RecorderType::checkUnchanged();
+
+        auto result = restored.dispatch<Trigger::B_AAB>();
+        TRUE(result.consumed);
+        RecorderType::check({
+          "B<-AAB",
+          "AAB::Exit",
+          "AA::Exit",
+          "A::Exit",
+          "B::Entry",
+          "B::Do" });
+      }
+
+      TEST(
+        Restore,
+        PersistentState,
+        FieldsRestored)
+      {
+        using namespace SnapshotTestImpl;
+        Sm sm;
+        sm.begin();
+        sm.dispatch<Trigger::B_A>();
+        B* b = SingletonCreatorFake<B>::create();
+        b->counter = 42;
+
+        uint8_t buffer[8] = {};
+        BufferWriter writer(buffer, sizeof(buffer));
+        sm.save(writer);
+        EQ((size_t)3, writer.position);
+
+        b->counter = 0;
+        Sm restored;
+        BufferReader reader(buffer, writer.position);
+        TRUE(restored.restore(reader));
+        EQ((uint8_t)42, b->counter);
+        EQ((void*)b, (void*)restored._activeState());
+      }
+
+      TEST(
+        Restore,
+        FlatStatemachine,
+        ConfigurationRestored)
+      {
+        using namespace SnapshotTestImpl;
+        FlatSm sm;
+        sm.begin();
+        sm.dispatch<Trigger::AAB_AAA>();
+
+        uint8_t buffer[8] = {};
+        BufferWriter writer(buffer, sizeof(buffer));
+        sm.save(writer);
+
+        FlatSm restored;
+        BufferReader reader(buffer, writer.position);
+        TRUE(restored.restore(reader));
+        EQ(sm.configuration(), restored.configuration());
+      }
+
+      TEST(
+        Restore,
+        InvalidData,
+        Rejected)
+      {
+        using namespace SnapshotTestImpl;
+        Sm sm;
+
+        const uint8_t wrongVersion[] = { impl::SnapshotVersion + 1, 0, 0, 0 };
+        BufferReader reader1(wrongVersion, sizeof(wrongVersion));
+        FALSE(sm.restore(reader1));
+
+        const uint8_t wrongIndex[] = { impl::SnapshotVersion, 7 };
+        BufferReader reader2(wrongIndex, sizeof(wrongIndex));
+        FALSE(sm.restore(reader2));
+
+        const uint8_t truncated[] = { impl::SnapshotVersion, 0, 0 };
+        BufferReader reader3(truncated, sizeof(truncated));
+        Sm other;
+        FALSE(other.restore(reader3));
+
+        // The states created for A and AA are destroyed again, and the state machine can be restored.
+        N(other._activeState());
+        EQ(SingletonCreatorFake<A>::createCalls, SingletonCreatorFake<A>::deleteCalls);
+        EQ(SingletonCreatorFake<AA>::createCalls, SingletonCreatorFake<AA>::deleteCalls);
+        const uint8_t complete[] = { impl::SnapshotVersion, 0, 0, 1 };
+        BufferReader reader4(complete, sizeof(complete));
+        TRUE(other.restore(reader4));
+        TRUE(other.dispatch<Trigger::B_AAB>().consumed);
+      }
+
+      TEST(
+        Restore,
+        InvalidDataIntoActiveStatemachine,
+        StatemachineUnchanged)
+      {
+        using namespace SnapshotTestImpl;
+        Sm sm;
+        sm.begin();
+        StatePolicy* active = sm._activeState();
+
+        const uint8_t truncated[] = { impl::SnapshotVersion, 0, 0 };
+        BufferReader reader(truncated, sizeof(truncated));
+        FALSE(sm.restore(reader));
+
+        EQ((void*)active, (void*)sm._activeState());
+        RecorderType::reset();
+        TRUE(sm.dispatch<Trigger::AAB_AAA>().consumed);
+        RecorderType::check({
+          "AAB<-AAA",
+          "AAA::Exit",
+          "AAB::Entry",
+          "AAB::Do" });
+      }
+
+      TEST(
+        Save,
+        WriterFull,
+        ReturnsFalse)
+      {
+        using namespace SnapshotTestImpl;
+        Sm sm;
+        sm.begin();
+
+        uint8_t buffer[3] = {};
+        BufferWriter writer(buffer, sizeof(buffer));
+        FALSE(sm.save(writer));
+
+        uint8_t complete[4] = {};
+        BufferWriter writer2(complete, sizeof(complete));
+        TRUE(sm.save(writer2));
+      }
+
+      TEST(
+        Restore,
+        ActiveStatemachine,
+        Rejected)
+      {
+        using namespace SnapshotTestImpl;
+        Sm sm;
+        sm.begin();
+
+        uint8_t buffer[8] = {};
+        BufferWriter writer(buffer, sizeof(buffer));
+        sm.save(writer);
+
+        BufferReader reader(buffer, writer.position);
+        FALSE(sm.restore(reader));
+      }
+
+    END
+
+  }
+}
@@ -0,0 +1,223 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <type_traits>
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/statetable.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace StateTableTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      namespace Trigger {
+        struct On {};
+        struct Off {};
+      }
+
+      struct Off : BasicState<Off, StatePolicy>, SingletonCreator<Off> {};
+      struct On : BasicState<On, StatePolicy>, SingletonCreator<On> {};
+
+      using ToOnFromOff = Transition<Trigger::On, On, Off, NoGuard, NoAction>;
+      using ToOffFromOn = Transition<Trigger::Off, Off, On, NoGuard, NoAction>;
+      using ToFinalFromOff = FinalTransition<Off>;
+      using Transitions =
+        Typelist<ToOnFromOff,
+        Typelist<ToOffFromOn,
+        Typelist<ToFinalFromOff,
+        NullType>>>;
+      using InitTransition = InitialTransition<Off, NoAction>;
+      using Sm = Statemachine<Transitions, InitTransition, StateTableObserver>;
+
+      // Index of the states in the state machine's level
+      const uint8_t OffIndex = 0;
+      const uint8_t OnIndex = 1;
+    }
+
+    BEGIN(StateTableTest)
+
+      TEST(
+        Observer,
+        ConsumedDispatch,
+        StateAndSequencePublished)
+      {
+        using namespace StateTableTestImpl;
+        uint64_t region[16];
+        StateTable table;
+        TRUE(table.format(region, sizeof(region), 2));
+
+        Sm sm;
+        sm.observer().attach(&table.slot(1));
+        sm.begin();
+
+        uint8_t state = 0;
+        uint32_t sequence = 0;
+        TRUE(readSlot(table.slot(1), state, sequence));
+        EQ(OffIndex, state);
+        EQ((uint32_t)2, sequence);
+
+        sm.dispatch<Trigger::On>();
+        TRUE(readSlot(table.slot(1), state, sequence));
+        EQ(OnIndex, state);
+        EQ((uint32_t)4, sequence);
+
+        // Slot 0 is not written
+        TRUE(readSlot(table.slot(0), state, sequence));
+        EQ((uint8_t)impl::NoStateIndex, state);
+        EQ((uint32_t)0, sequence);
+      }
+
+      TEST(
+        Observer,
+        UnhandledEvent,
+        NothingPublished)
+      {
+        using namespace StateTableTestImpl;
+        uint64_t region[16];
+        StateTable table;
+        table.format(region, sizeof(region), 1);
+
+        Sm sm;
+        sm.observer().attach(&table.slot(0));
+        sm.begin();
+        sm.dispatch<Trigger::Off>();
+
+        uint8_t state = 0;
+        uint32_t sequence = 0;
+        TRUE(readSlot(table.slot(0), state, sequence));
+        EQ(OffIndex, state);
+        EQ((uint32_t)2, sequence);
+      }
+
+      TEST(
+        Observer,
+        End,
+        NoActiveStatePublished)
+      {
+        using namespace StateTableTestImpl;
+        uint64_t region[16];
+        StateTable table;
+        table.format(region, sizeof(region), 1);
+
+        Sm sm;
+        sm.observer().attach(&table.slot(0));
+        sm.begin();
+        sm.end();
+
+        uint8_t state = 0;
+        uint32_t sequence = 0;
+        TRUE(readSlot(table.slot(0), state, sequence));
+        EQ((uint8_t)impl::NoStateIndex, state);
+        EQ((uint32_t)4, sequence);
+      }
+
+      TEST(
+        Reader,
+        SlotBeingWritten,
+        NotConsistent)
+      {
+        uint64_t region[16];
+        StateTable table;
+        table.format(region, sizeof(region), 1);
+        table.slot(0).sequence.store(1);
+
+        uint8_t state = 0;
+        uint32_t sequence = 0;
+        FALSE(readSlot(table.slot(0), state, sequence));
+      }
+
+      TEST(
+        Reader,
+        Histogram,
+        StatesCounted)
+      {
+        using namespace StateTableTestImpl;
+        uint64_t region[32];
+        StateTable table;
+        TRUE(table.format(region, sizeof(region), 5));
+
+        Sm sms[4];
+        for (int n = 0; n < 4; n++) {
+          sms[n].observer().attach(&table.slot(n));
+          sms[n].begin();
+        }
+        sms[1].dispatch<Trigger::On>();
+        sms[2].dispatch<Trigger::On>();
+        sms[3].dispatch<Trigger::On>();
+
+        StateTable reader;
+        TRUE(reader.attach(region, sizeof(region)));
+        StateHistogram histogram;
+        histogram.scan(reader);
+
+        EQ((uint32_t)1, histogram.counts[OffIndex]);
+        EQ((uint32_t)3, histogram.counts[OnIndex]);
+        EQ((uint32_t)1, histogram.counts[impl::NoStateIndex]);
+        EQ((uint32_t)0, histogram.inFlux);
+      }
+
+      TEST(
+        Reader,
+        WriterDiedWhilePublishing,
+        SlotInFlux)
+      {
+        uint64_t region[16];
+        StateTable table;
+        TRUE(table.format(region, sizeof(region), 2));
+        table.slot(0).sequence.store(3);
+
+        StateHistogram histogram;
+        histogram.scan(table);
+
+        EQ((uint32_t)1, histogram.inFlux);
+        EQ((uint32_t)1, histogram.counts[impl::NoStateIndex]);
+      }
+
+      TEST(
+        Reader,
+        NotFormatted,
+        AttachFails)
+      {
+        uint64_t region[16] = {};
+        StateTable table;
+        FALSE(table.attach(region, sizeof(region)));
+        EQ((uint32_t)0, table.size());
+
+        FALSE(table.format(region, sizeof(region), 100));
+      }
+
+#if defined(__unix__) || defined(__APPLE__)
+      TEST(
+        SharedStateTable,
+        OwnsTheMapping,
+        NotCopyable)
+      {
+        // A copy would unmap the region a second time
+        static_assert(!std::is_copy_constructible<SharedStateTable>::value, "");
+        static_assert(!std::is_copy_assignable<SharedStateTable>::value, "");
+      }
+#endif
+
+    END
+
+  }
+}
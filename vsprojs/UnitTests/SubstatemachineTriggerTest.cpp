@@ -77,12 +77,15 @@ namespace UT {
 
       private:
         friend class BasicState<OnState, StatePolicy, true, true, true>;
-        template<class Event> void entry(const Event& ev) { entryCalls++; lastEntryEvent = ev.id; }
-        template<> void entry(const NullType& ev) { entryCalls++; lastEntryEvent = 0; }
-        template<class Event> void exit(const Event& ev) { exitCalls++; lastExitEvent = ev.id; }
-        template<> void exit(const NullType&) { exitCalls++; lastEntryEvent = 0; }
-        template<class Event> void doit(const Event& ev) { doitCalls++; lastDoitEvent = ev.id; }
-        template<> void doit(const NullType&) { doitCalls++; lastEntryEvent = 0; }
+        template<class Event> void entry(const Event& ev) { onEntry(ev); }
+        template<class Event> void onEntry(const Event& ev) { entryCalls++; lastEntryEvent = ev.id; }
+        void onEntry(const NullType&) { entryCalls++; lastEntryEvent = 0; }
+        template<class Event> void exit(const Event& ev) { onExit(ev); }
+        template<class Event> void onExit(const Event& ev) { exitCalls++; lastExitEvent = ev.id; }
+        void onExit(const NullType&) { exitCalls++; lastEntryEvent = 0; }
+        template<class Event> void doit(const Event& ev) { onDoit(ev); }
+        template<class Event> void onDoit(const Event& ev) { doitCalls++; lastDoitEvent = ev.id; }
+        void onDoit(const NullType&) { doitCalls++; lastEntryEvent = 0; }
       };
       int OnState::entryCalls = 0;
       int OnState::exitCalls = 0;
@@ -112,12 +115,15 @@ namespace UT {
 
       private:
         friend class BasicState<OffState, StatePolicy, true, true, true>;
-        template<class Event> void entry(const Event& ev) { entryCalls++; lastEntryEvent = ev.id; }
-        template<> void entry(const NullType& ev) { entryCalls++; lastEntryEvent = 0; }
-        template<class Event> void exit(const Event& ev) { exitCalls++; lastExitEvent = ev.id; }
-        template<> void exit(const NullType&) { exitCalls++; lastExitEvent = 0; }
-        template<class Event> void doit(const Event& ev) { doitCalls++; lastDoitEvent = ev.id; }
-        template<> void doit(const NullType&) { doitCalls++; lastDoitEvent = 0; }
+        template<class Event> void entry(const Event& ev) { onEntry(ev); }
+        template<class Event> void onEntry(const Event& ev) { entryCalls++; lastEntryEvent = ev.id; }
+        void onEntry(const NullType&) { entryCalls++; lastEntryEvent = 0; }
+        template<class Event> void exit(const Event& ev) { onExit(ev); }
+        template<class Event> void onExit(const Event& ev) { exitCalls++; lastExitEvent = ev.id; }
+        void onExit(const NullType&) { exitCalls++; lastExitEvent = 0; }
+        template<class Event> void doit(const Event& ev) { onDoit(ev); }
+        template<class Event> void onDoit(const Event& ev) { doitCalls++; lastDoitEvent = ev.id; }
+        void onDoit(const NullType&) { doitCalls++; lastDoitEvent = 0; }
       };
       int OffState::entryCalls = 0;
       int OffState::exitCalls = 0;
@@ -16,6 +16,12 @@
 */
 #include <vector>
 
+// Allocations of the test doubles are not the state machine's, the host test harness (see
+// tools/hosttests) does not count them.
+#if !defined(UNTRACKED_ALLOCATIONS)
+#define UNTRACKED_ALLOCATIONS
+#endif
+
 namespace UnitTests {
   namespace Helpers {
 
@@ -60,18 +66,23 @@ namespace UnitTests {
       static vector<string> records_;
 
     public:
-      static void add(string record) { records_.push_back(record); }
+      template<class Record>
+      static void add(const Record& record) {
+        UNTRACKED_ALLOCATIONS;
+        records_.push_back(string(record));
+      }
       static void reset() { checkedPosition_ = 0; records_.clear(); }
 
       static void check(vector<string> expected) {
-        for (int n = 0; n < expected.size(); n++) {
+        for (size_t n = 0; n < expected.size(); n++) {
           string exp = expected[n];
           string act = Recorder::records_[checkedPosition_ + n];
           Microsoft::VisualStudio::CppUnitTestFramework::Assert::AreEqual<string>(exp, act);
         }
         checkedPosition_ += expected.size();
       }
-      static void check(const char* expected[]) {
+      template<size_t N>
+      static void check(const char* (&expected)[N]) {
         vector<string> exp(begin(expected), end(expected));
         check(exp);
       }
@@ -90,6 +101,7 @@ namespace UnitTests {
 
       template<class StateType, class EventType>
       void perform(StateType&, const EventType&) {
+        UNTRACKED_ALLOCATIONS;
         calls++;
         ostringstream buf;
         buf << To::name << "<-" << From::name;
@@ -97,6 +109,7 @@ namespace UnitTests {
       }
 
       void perform() {
+        UNTRACKED_ALLOCATIONS;
         calls++;
         ostringstream buf;
         buf << To::name << "<-" << From::name;
@@ -110,8 +123,8 @@ namespace UnitTests {
       static int calls;
       static bool CheckReturnValue;
 
-      template<class StateType, class EventType>
-      bool eval(const StateType& activeState, const EventType& ev) {
+      template<class ActiveStateType, class EventType>
+      bool eval(const ActiveStateType& activeState, const EventType& ev) {
         if (!is_same < From, AnyState<StateType>>().value) {
           From* from = From::CreatorType::create();
           Microsoft::VisualStudio::CppUnitTestFramework::Assert::IsTrue(activeState.equals(*from));
@@ -0,0 +1,254 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#define TSM_RECORD_TRANSITIONS
+#include "../../src/transitionprofile.h"
+// Shares impl::TypeTag with the profile.
+#include "../../src/coroutinestate.h"
+#include "TestHelpers.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace TransitionProfileTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      namespace Trigger {
+        struct Next {};
+        struct Back {};
+      }
+
+      struct A : BasicState<A, StatePolicy>, SingletonCreator<A> {};
+      struct B : BasicState<B, StatePolicy>, SingletonCreator<B> {};
+      struct C : BasicState<C, StatePolicy>, SingletonCreator<C> {};
+
+      // A - Next -> B - Next -> C - Next -> A, B - Back -> A
+      using AtoB = Transition<Trigger::Next, B, A, NoGuard, NoAction>;
+      using BtoC = Transition<Trigger::Next, C, B, NoGuard, NoAction>;
+      using CtoA = Transition<Trigger::Next, A, C, NoGuard, NoAction>;
+      using BtoA = Transition<Trigger::Back, A, B, NoGuard, NoAction>;
+      using Transitions =
+        Typelist<AtoB,
+        Typelist<BtoC,
+        Typelist<CtoA,
+        Typelist<BtoA,
+        NullType>>>>;
+      using Sm = Statemachine<Transitions, InitialTransition<A, NoAction>>;
+
+      // As written by writeTransitionProfile for a workload that mostly cycles between A and B.
+      struct Profile;
+      struct ProfileCopy {
+        enum { Recorded = true, NumberOfTransitions = 4 };
+        typedef impl::IndexSequence<2, 1, 3, 0> Order;
+        typedef impl::IndexSequence<0, 3> Likely;
+      };
+      using Profiled = impl::ApplyProfile<Transitions, ProfileCopy>::Result;
+      using ProfiledSm = Statemachine<Profiled, InitialTransition<A, NoAction>>;
+
+      // Same event and same From state: the dispatcher takes the last one, so their order must not change.
+      using AtoC = Transition<Trigger::Next, C, A, NoGuard, NoAction>;
+      using Ambiguous =
+        Typelist<AtoB,
+        Typelist<AtoC,
+        Typelist<BtoA,
+        NullType>>>;
+
+      // end() tries the exiting transitions of B from the last one, whatever their event: the final
+      // transition consumes first. Swapped, the action of the exit transition would be called before.
+      struct CountExit {
+        template<class StateType, class Event>
+        void perform(StateType&, const Event&) { calls++; }
+        static int calls;
+      };
+      int CountExit::calls = 0;
+      using BtoAExit = ExitTransition<Trigger::Back, A, B, NoGuard, CountExit>;
+      using Exits =
+        Typelist<BtoAExit,
+        Typelist<FinalTransition<B>,
+        Typelist<AtoB,
+        NullType>>>;
+
+      string readFile(const char* path) {
+        ifstream file(path);
+        stringstream content;
+        content << file.rdbuf();
+        return content.str();
+      }
+    }
+
+    BEGIN(TransitionProfileTest)
+
+      INIT(
+        Initialize,
+        {
+          using namespace TransitionProfileTestImpl;
+          for (uint32_t& hits : impl::TransitionHits<Transitions>::hits) hits = 0;
+        })
+
+      TEST(
+        TransitionProfile,
+        NotRecorded,
+        TransitionsUnchanged)
+      {
+        using namespace TransitionProfileTestImpl;
+        using Result = impl::ApplyProfile<Transitions, TransitionProfile<Profile>>::Result;
+        TRUE((is_same<Transitions, Result>::value));
+      }
+
+      TEST(
+        TransitionProfile,
+        Recorded,
+        ReorderedAndLikelyMarked)
+      {
+        using namespace TransitionProfileTestImpl;
+        using Expected =
+          Typelist<CtoA,
+          Typelist<BtoC,
+          Typelist<impl::LikelyTransition<BtoA>,
+          Typelist<impl::LikelyTransition<AtoB>,
+          NullType>>>>;
+        TRUE((is_same<Expected, Profiled>::value));
+      }
+
+      TEST(
+        TransitionProfile,
+        StaleProfile,
+        ConflictingOrderDetected)
+      {
+        using namespace TransitionProfileTestImpl;
+        // A profile of the same length for other transitions would swap AtoB and AtoC
+        TRUE((impl::KeepsConflictingOrder<Transitions, ProfileCopy::Order>::value));
+        TRUE((impl::KeepsConflictingOrder<Ambiguous, impl::IndexSequence<2, 0, 1> >::value));
+        FALSE((impl::KeepsConflictingOrder<Ambiguous, impl::IndexSequence<1, 0, 2> >::value));
+        FALSE((impl::KeepsConflictingOrder<Exits, impl::IndexSequence<1, 0, 2> >::value));
+      }
+
+      TEST(
+        TransitionProfile,
+        ProfiledStatemachine,
+        DispatchesAsOriginal)
+      {
+        using namespace TransitionProfileTestImpl;
+        ProfiledSm sm;
+        sm.begin();
+        TRUE(sm.dispatch<Trigger::Next>().activeState->typeOf<B>());
+        TRUE(sm.dispatch<Trigger::Back>().activeState->typeOf<A>());
+        TRUE(sm.dispatch<Trigger::Next>().activeState->typeOf<B>());
+        TRUE(sm.dispatch<Trigger::Next>().activeState->typeOf<C>());
+        FALSE(sm.dispatch<Trigger::Back>().consumed);
+        TRUE(sm.dispatch<Trigger::Next>().activeState->typeOf<A>());
+      }
+
+      TEST(
+        TransitionProfile,
+        Recording,
+        CountsTakenTransitions)
+      {
+        using namespace TransitionProfileTestImpl;
+        Sm sm;
+        sm.begin();
+        for (int n = 0; n < 10; n++) {
+          sm.dispatch<Trigger::Next>();
+          sm.dispatch<Trigger::Back>();
+        }
+        sm.dispatch<Trigger::Next>();
+        sm.dispatch<Trigger::Next>();
+
+        const uint32_t* hits = impl::TransitionHits<Transitions>::hits;
+        EQ(11u, hits[0]);
+        EQ(1u, hits[1]);
+        EQ(0u, hits[2]);
+        EQ(10u, hits[3]);
+      }
+
+      TEST(
+        TransitionProfile,
+        WriteProfile,
+        FrequentTransitionsLast)
+      {
+        using namespace TransitionProfileTestImpl;
+        uint32_t* hits = impl::TransitionHits<Transitions>::hits;
+        hits[0] = 11;
+        hits[1] = 1;
+        hits[2] = 0;
+        hits[3] = 10;
+
+        TRUE(writeTransitionProfile<Transitions>("TransitionProfileTest.h", "UT::Classes::TransitionProfileTestImpl::Profile"));
+        const string profile = readFile("TransitionProfileTest.h");
+        remove("TransitionProfileTest.h");
+
+        TRUE(profile.find("namespace UT {\nnamespace Classes {\nnamespace TransitionProfileTestImpl {\nstruct Profile;\n}\n}\n}\n") != string::npos);
+        TRUE(profile.find("template<>\nstruct TransitionProfile< ::UT::Classes::TransitionProfileTestImpl::Profile> {") != string::npos);
+        TRUE(profile.find("NumberOfTransitions = 4") != string::npos);
+        TRUE(profile.find("typedef impl::IndexSequence<2, 1, 3, 0> Order;") != string::npos);
+        TRUE(profile.find("typedef impl::IndexSequence<0, 3> Likely;") != string::npos);
+      }
+
+      TEST(
+        TransitionProfile,
+        WriteProfile,
+        SameEventAndFromStateKeepOrder)
+      {
+        using namespace TransitionProfileTestImpl;
+        uint32_t* hits = impl::TransitionHits<Ambiguous>::hits;
+        hits[0] = 5;
+        hits[1] = 1;
+        hits[2] = 3;
+
+        TRUE(writeTransitionProfile<Ambiguous>("TransitionProfileTest.h", "Profile"));
+        const string profile = readFile("TransitionProfileTest.h");
+        remove("TransitionProfileTest.h");
+
+        TRUE(profile.find("typedef impl::IndexSequence<0, 1, 2> Order;") != string::npos);
+        TRUE(profile.find("typedef impl::IndexSequence<0, 2> Likely;") != string::npos);
+      }
+
+      TEST(
+        TransitionProfile,
+        WriteProfile,
+        ExitingTransitionsOfSameFromStateKeepOrder)
+      {
+        using namespace TransitionProfileTestImpl;
+        uint32_t* hits = impl::TransitionHits<Exits>::hits;
+        hits[0] = 4;
+        hits[1] = 0;
+        hits[2] = 1;
+
+        TRUE(writeTransitionProfile<Exits>("TransitionProfileTest.h", "Profile"));
+        const string profile = readFile("TransitionProfileTest.h");
+        remove("TransitionProfileTest.h");
+        TRUE(profile.find("typedef impl::IndexSequence<0, 1, 2> Order;") != string::npos);
+
+        CountExit::calls = 0;
+        Statemachine<Exits, InitialTransition<A, NoAction>> sm;
+        sm.begin();
+        sm.dispatch<Trigger::Next>();
+        TRUE(sm.end().consumed);
+        EQ(0, CountExit::calls);
+      }
+
+    END
+
+  }
+}
@@ -0,0 +1,222 @@
+/*
+  Copyright 2023 Stefan Grimm
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CppUnitTest.h"
+#include "NotquiteBDD.h"
+#include "../../src/transitiontable.h"
+#include "TestHelpers.h"
+
+namespace UT {
+  namespace Classes {
+
+    using namespace tsmlib;
+    using namespace UnitTests::Helpers;
+
+    namespace TransitionTableTestImpl {
+
+      using StatePolicy = State<MemoryAddressComparator, true>;
+
+      namespace Trigger {
+        struct Toggle {};
+        struct Check {};
+        struct Fail {};
+        struct Tick {};
+      }
+
+      struct IsOk {
+        template<class StateType, class EventType>
+        bool eval(const StateType&, const EventType&) { return true; }
+      };
+      struct Log {
+        template<class StateType, class EventType>
+        void perform(StateType&, const EventType&) {}
+      };
+
+      // Ready - Check -> Ready or Failed, Ready - Fail -> exit to Off, Ready - Tick -> Ready
+      struct Off;
+      struct Ready : BasicState<Ready, StatePolicy>, SingletonCreator<Ready> {
+        static const char* name;
+      };
+      const char* Ready::name = "Ready";
+      struct Failed : BasicState<Failed, StatePolicy>, SingletonCreator<Failed> {
+        static const char* name;
+      };
+      const char* Failed::name = "Failed";
+      using Inner = Statemachine<
+        Typelist<ChoiceTransition<Trigger::Check, Ready, Failed, Ready, IsOk, Log>,
+        Typelist<ExitTransition<Trigger::Fail, Off, Ready, NoGuard, NoAction>,
+        Typelist<SelfTransition<Trigger::Tick, Ready, NoGuard, Log, false>,
+        Typelist<FinalTransition<Failed>,
+        NullType>>>>,
+        InitialTransition<Ready, NoAction>>;
+
+      // Off - Toggle -> On(Inner), On - Toggle [IsOk] -> Off
+      struct Off : BasicState<Off, StatePolicy>, SingletonCreator<Off> {
+        static const char* name;
+      };
+      const char* Off::name = "Off";
+      struct On : SubstatesHolderState<On, StatePolicy, Inner>, SingletonCreator<On> {
+        static const char* name;
+      };
+      const char* On::name = "On";
+      using Sm = Statemachine<
+        Typelist<Transition<Trigger::Toggle, On, Off, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Toggle, Off, On, IsOk, NoAction>,
+        Typelist<Declaration<Trigger::Check, On>,
+        Typelist<Declaration<Trigger::Fail, On>,
+        Typelist<Declaration<Trigger::Tick, On>,
+        NullType>>>>>,
+        InitialTransition<Off, NoAction>>;
+
+      using Table = TransitionTable<Sm>;
+
+      const uint8_t OffId = LokiLight::IndexOf<Table::States, Off>::Result;
+      const uint8_t OnId = LokiLight::IndexOf<Table::States, On>::Result;
+      const uint8_t ReadyId = LokiLight::IndexOf<Table::States, Ready>::Result;
+      const uint8_t FailedId = LokiLight::IndexOf<Table::States, Failed>::Result;
+      const uint8_t CheckId = LokiLight::IndexOf<Table::Events, Trigger::Check>::Result;
+
+      // Any state - Fail -> Failed, Failed - Toggle -> Off
+      using AnySm = Statemachine<
+        Typelist<Transition<Trigger::Fail, Failed, AnyState<Off>, NoGuard, NoAction>,
+        Typelist<Transition<Trigger::Toggle, Off, Failed, NoGuard, NoAction>,
+        NullType>>,
+        InitialTransition<Off, NoAction>>;
+
+      // Entries are usable at compile time.
+      static_assert(Table::entries[0].kind == InitialKind, "The initial transition of Sm comes first");
+      static_assert(Table::entries[1].event == 0, "Toggle is the first event");
+    }
+
+    BEGIN(TransitionTableTest)
+
+      TEST(
+        TransitionTable,
+        Entries,
+        InitialTransitionAndTransitionsPerStatemachine)
+      {
+        using namespace TransitionTableTestImpl;
+        EQ((size_t)2, (size_t)Table::NumberOfStatemachines);
+        EQ((size_t)4, (size_t)Table::NumberOfStates);
+        EQ((size_t)4, (size_t)Table::NumberOfEvents);
+        // Sm: initial + 5, Inner: initial + 2 for the choice + 3.
+        EQ((size_t)12, (size_t)Table::NumberOfEntries);
+
+        const TransitionEntry& initial = Table::entries[0];
+        EQ((uint8_t)InitialKind, initial.kind);
+        EQ((uint8_t)TransitionEntry::NoState, initial.from);
+        EQ(OffId, initial.to);
+
+        const TransitionEntry& guarded = Table::entries[2];
+        EQ((uint8_t)NormalKind, guarded.kind);
+        EQ(OnId, guarded.from);
+        EQ(OffId, guarded.to);
+        TRUE(guarded.guard);
+        FALSE(guarded.action);
+
+        EQ((uint8_t)SelfKind, Table::entries[3].kind);
+        EQ((uint8_t)0, Table::entries[3].machine);
+        EQ((uint8_t)1, Table::entries[6].machine);
+        EQ(ReadyId, Table::entries[6].to);
+      }
+
+      TEST(
+        TransitionTable,
+        Entries,
+        KindsOfTheNestedStatemachine)
+      {
+        using namespace TransitionTableTestImpl;
+        const TransitionEntry& choiceTrue = Table::entries[7];
+        const TransitionEntry& choiceFalse = Table::entries[8];
+        EQ((uint8_t)ChoiceKind, choiceTrue.kind);
+        EQ(CheckId, choiceTrue.event);
+        EQ(ReadyId, choiceTrue.to);
+        TRUE(choiceTrue.guard);
+        TRUE(choiceTrue.action);
+        EQ(FailedId, choiceFalse.to);
+        FALSE(choiceFalse.guard);
+
+        EQ((uint8_t)ExitKind, Table::entries[9].kind);
+        EQ(OffId, Table::entries[9].to);
+        EQ((uint8_t)SelfKind, Table::entries[10].kind);
+        TRUE(Table::entries[10].action);
+
+        const TransitionEntry& finalEntry = Table::entries[11];
+        EQ((uint8_t)FinalKind, finalEntry.kind);
+        EQ(FailedId, finalEntry.from);
+        EQ((uint8_t)TransitionEntry::NoState, finalEntry.to);
+        EQ((uint8_t)TransitionEntry::NoEvent, finalEntry.event);
+      }
+
+      TEST(
+        TransitionTable,
+        States,
+        LevelsAndNestedStatemachines)
+      {
+        using namespace TransitionTableTestImpl;
+        EQ((uint8_t)0, Table::levels[OffId]);
+        EQ((uint8_t)0, Table::levels[OnId]);
+        EQ((uint8_t)1, Table::levels[ReadyId]);
+        EQ((uint8_t)1, Table::nested[OnId]);
+        EQ((uint8_t)0xff, Table::nested[OffId]);
+      }
+
+      TEST(
+        TransitionTable,
+        Names,
+        StaticNameOrTypeName)
+      {
+        using namespace TransitionTableTestImpl;
+        EQ(string("On"), string(stateName<Sm>(OnId)));
+        EQ(string("Failed"), string(stateName<Sm>(FailedId)));
+        EQ(string("Check"), string(eventName<Sm>(CheckId)));
+        TRUE(stateName<Sm>((uint8_t)Table::NumberOfStates) == nullptr);
+      }
+
+      TEST(
+        TransitionTable,
+        ToDot,
+        ClustersAndLabels)
+      {
+        using namespace TransitionTableTestImpl;
+        const string dot = toDot<Sm>();
+        TRUE(dot.find("digraph statemachine {") == 0);
+        TRUE(dot.find("subgraph cluster_m1 {\n    label=\"On\";") != string::npos);
+        TRUE(dot.find("[label=\"On\", peripheries=2];") != string::npos);
+        TRUE(dot.find("s" + to_string(OnId) + " -> i1 [style=dashed") != string::npos);
+        TRUE(dot.find("[label=\"Check [guard] / action\", arrowhead=diamond];") != string::npos);
+        TRUE(dot.find("[label=\"Check [else] / action\", arrowhead=diamond];") != string::npos);
+        TRUE(dot.find("s" + to_string(FailedId) + " -> f1 ") != string::npos);
+        TRUE(dot.find("s" + to_string(ReadyId) + " -> s" + to_string(OffId) + " [label=\"Fail\", style=bold];") != string::npos);
+      }
+
+      TEST(
+        TransitionTable,
+        ToDot,
+        TransitionsFromAnyStateStartAtAnyNode)
+      {
+        using namespace TransitionTableTestImpl;
+        using AnyTable = TransitionTable<AnySm>;
+        const uint8_t failedId = LokiLight::IndexOf<AnyTable::States, Failed>::Result;
+        const string dot = toDot<AnySm>();
+        TRUE(dot.find("  a0 [label=\"any\", style=dashed];") != string::npos);
+        TRUE(dot.find("  a0 -> s" + to_string(failedId) + " [label=\"Fail\"];") != string::npos);
+        TRUE(dot.find("s255") == string::npos);
+      }
+
+    END
+
+  }
+}